@@ -6,10 +6,9 @@
 #include "BNode.h"
 #include "ANodeFwd.h"
 #include "BuilderFwd.h"
-#include  <bitset>
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
-class ANode {
+class ANode : public RefCounted {
     //Types
 public:
     using LeafT = Leaf<T, SIZE, ADAPTER>;
@@ -28,21 +27,26 @@ public:
     using LeafPtr = std::unique_ptr<LeafT, LeafDeleter>;
     using ANodePtr = std::unique_ptr<ANode, ANodeDeleter>;
     using BNodePtr = std::unique_ptr<BNodeT, BNodeDeleter>;
-    using LeafCPtr = std::shared_ptr<const LeafT>;
-    using ANodeCPtr = std::shared_ptr<const ANode>;
-    using BNodeCPtr = std::shared_ptr<const BNodeT>;
+    using LeafCPtr = ConstPtr<LeafT>;
+    using ANodeCPtr = ConstPtr<ANode>;
+    using BNodeCPtr = ConstPtr<BNodeT>;
     using VarType = std::variant<LeafCPtr, BNodeCPtr>;
 
+    static constexpr size_t CHILD_PREFETCH_DISTANCE = BNodeT::CHILD_PREFETCH_DISTANCE;
+
 private:
-    using GenericCPtr = std::shared_ptr<const void>;
+    //A const LeafT or BNodeT, or null for a range of origin_
+    using ChildVarType = NodeVariant<LeafT, ANode, BNodeT>;
 
     //Members
-    std::array<GenericCPtr, MAX_COUNT> children_;
+    std::array<ChildVarType, MAX_COUNT> children_;
     std::array<size_t, MAX_COUNT> cumSize_;
     std::array<size_t, MAX_COUNT> offset_;
     uint16_t childrenCount_ = 0;
     const VarType origin_;
-    std::bitset<MAX_COUNT> isLeaf_;
+    int8_t annotationDepth_ = 1;
+    [[no_unique_address]] CachedSummary<T, ADAPTER<T, SIZE>::CACHES_SUMMARY> summary_;
+    [[no_unique_address]] CachedHash<ADAPTER<T, SIZE>::HASHES_CONTENT> hash_;
 
 
     static_assert(size_t(1) << log(SIZE) == SIZE);
@@ -69,9 +73,19 @@ public:
 
     //Universal node methods
     /**
-     * does nothing as the children are already const
+     * The children are already const, this only caches the summary and hash of the annotated ranges and the
+     * annotation depth
+     */
+    void makeConst();
+
+    /**
+     * Undoes the caching of makeConst, the node being reopened in place (see ConstPtr::takeExclusive)
      */
-    void makeConst() {}
+    void thaw() {
+        annotationDepth_ = 1;
+        summary_.reset();
+        hash_.reset();
+    }
 
     void mutate(void *context) {}
 
@@ -79,6 +93,11 @@ public:
 
     int8_t height() const;
 
+    /**
+     * Most annotations met on a path from this node down to a leaf, this one included, set by makeConst
+     */
+    int8_t annotationDepth() const { return annotationDepth_; }
+
     size_t originSize() const;
 
     size_t sizeAt(size_t pos) const { return cumSize_[pos] - (pos ? cumSize_[pos - 1] : 0); }
@@ -117,7 +136,21 @@ public:
         throw std::logic_error("All data contained by an Node annotation is intrinsically immutable");
     }
 
-    const T &operator[](size_t index) const;
+    const T operator[](size_t index) const;
+
+    /**
+     * Sum/min/max/count over [offset, offset + length), using the cached summaries of fully covered children
+     */
+    Summary<T> summarize(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+    const Summary<T> *cachedSummary() const { return summary_.get(); }
+
+    /**
+     * Hash of the values in [offset, offset + length), using the cached hashes of fully covered children
+     */
+    ContentHash contentHash(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+    const ContentHash *cachedHash() const { return hash_.get(); }
 
     auto childAt(size_t index) const -> const std::variant<const LeafT *, const BNodeT *, const VarType>;
 
@@ -160,6 +193,59 @@ public:
     template<class Visitor>
     void forEachChild(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const;
 
+    /**
+     * Read only forEachChild: the visitor gets a const reference to each child node (the origin for ranges that were
+     * not replaced) instead of its smart pointer
+     */
+    template<class Visitor>
+    void forEachChildNode(Visitor &&visitor, size_t offset, size_t length, bool asPrefix = false) const;
+
+    /**
+     * Visits the child (the origin when the slot was not replaced) holding offset as (child, childBegin, sliceBegin, sliceLength): this node maps
+     * [sliceBegin, sliceBegin + sliceLength) of its own positions onto [childBegin, childBegin + sliceLength) of the child
+     */
+    template<class Visitor>
+    decltype(auto) visitChildAt(Visitor &&visitor, size_t offset) const;
+
+    /**
+     * Requests the lines visitChildAt reads ahead of a descent into this node: the count and origin, the cumulative
+     * sizes it searches and the child offsets
+     */
+    void prefetchSearch() const {
+        __builtin_prefetch(&childrenCount_);
+        __builtin_prefetch(&origin_);
+        prefetchCumSizes<MAX_COUNT>(cumSize_.data());
+        prefetchCumSizes<MAX_COUNT>(offset_.data());
+    }
+
+    /**
+     * Requests the lines a forward walk of this node starts on (the count and origin, the cumulative sizes and the first lines of children and offsets), see prefetchChildren
+     */
+    void prefetchWalk() const {
+        prefetchSearch();
+        __builtin_prefetch(children_.data());
+        __builtin_prefetch(offset_.data());
+    }
+
+    /**
+     * Visits the origin and every replaced child slot, once per reference this node holds (slots left to the origin
+     * hold none)
+     */
+    template<class Visitor>
+    void forEachReference(Visitor &&visitor) const {
+        visitor(origin_);
+        for (size_t pos = 0; pos < childrenCount_; pos++) {
+            if (children_[pos]) {
+                visitor(children_[pos]);
+            }
+        }
+    }
+
+private:
+    template<class Visitor>
+    void forEachChildSlot(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const;
+
+public:
     std::tuple<size_t, size_t>
     nodeRangeInclusive(size_t offset, size_t length) const;
 
@@ -6,10 +6,9 @@
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 ANode<T, MAX_COUNT, SIZE, ADAPTER>::ANode(const ANode &otherNode) : childrenCount_(otherNode.childrenCount_),
-                                                                    origin_(otherNode.origin_),
-                                                                    isLeaf_(otherNode.isLeaf_) {
+                                                                    origin_(otherNode.origin_) {
     for (int i = 0; i < childrenCount_; i++) {
-        children_[i] = otherNode.children_[i];
+        children_[i] = otherNode.children_[i] ? BNodeT::copyNode(otherNode.children_[i]) : ChildVarType();
         cumSize_[i] = otherNode.cumSize_[i];
         offset_[i] = otherNode.offset_[i];
     }
@@ -18,7 +17,9 @@ ANode<T, MAX_COUNT, SIZE, ADAPTER>::ANode(const ANode &otherNode) : childrenCoun
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 ANode<T, MAX_COUNT, SIZE, ADAPTER>::ANode(ANode &&otherNode) noexcept : childrenCount_(otherNode.childrenCount_),
                                                                         origin_(std::move(otherNode.origin_)),
-                                                                        isLeaf_(otherNode.isLeaf_) {
+                                                                        annotationDepth_(otherNode.annotationDepth_),
+                                                                        summary_(std::move(otherNode.summary_)),
+                                                                        hash_(std::move(otherNode.hash_)) {
     for (int i = 0; i < childrenCount_; i++) {
         children_[i] = std::move(otherNode.children_[i]);
         cumSize_[i] = otherNode.cumSize_[i];
@@ -29,14 +30,14 @@ ANode<T, MAX_COUNT, SIZE, ADAPTER>::ANode(ANode &&otherNode) noexcept : children
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 int8_t ANode<T, MAX_COUNT, SIZE, ADAPTER>::height() const {
-    return std::visit([](const auto originPtr) {
+    return std::visit([](const auto &originPtr) {
         return originPtr->height();
     }, origin_);
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t ANode<T, MAX_COUNT, SIZE, ADAPTER>::originSize() const {
-    return std::visit([](const auto originPtr) {
+    return std::visit([](const auto &originPtr) {
         return originPtr->size();
     }, origin_);
 }
@@ -74,10 +75,10 @@ decltype(auto) ANode<T, MAX_COUNT, SIZE, ADAPTER>::visitChild(Visitor &&_visitor
     if (!children_[childPos]) {
         return std::visit(std::forward<Visitor>(_visitor), origin_);
     }
-    if (isLeaf_[childPos]) {
-        return _visitor(static_cast<const LeafT *>(children_[childPos].get()));
+    if (BNodeT::isLeaf(children_[childPos])) {
+        return _visitor(getNode<LeafCPtr>(children_[childPos]));
     }
-    return _visitor(static_cast<const BNodeT *>(children_[childPos].get()));
+    return _visitor(getNode<BNodeCPtr>(children_[childPos]));
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
@@ -104,10 +105,10 @@ size_t ANode<T, MAX_COUNT, SIZE, ADAPTER>::fillLeaf(T *destLeaf, size_t offset,
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
-const T &ANode<T, MAX_COUNT, SIZE, ADAPTER>::operator[](size_t index) const {
+const T ANode<T, MAX_COUNT, SIZE, ADAPTER>::operator[](size_t index) const {
     assert(index < size());
     auto childPos = lowerBoundPos(index + 1);
-    return visitChild([&](const auto &childPtr) -> const T & {
+    return visitChild([&](const auto &childPtr) -> const T {
         return (*childPtr)[offset_[childPos] + index - (childPos ? cumSize_[childPos - 1] : 0)];
     }, childPos);
 }
@@ -119,10 +120,10 @@ auto ANode<T, MAX_COUNT, SIZE, ADAPTER>::childAt(
     if (!children_[childPos]) {
         return {origin_};
     }
-    if (isLeaf_[childPos]) {
-        return {static_cast<const LeafT *>(children_[childPos].get())};
+    if (BNodeT::isLeaf(children_[childPos])) {
+        return {getNode<LeafCPtr>(children_[childPos])};
     }
-    return {static_cast<const BNodeT *>(children_[childPos].get())};
+    return {getNode<BNodeCPtr>(children_[childPos])};
 }
 
 
@@ -143,7 +144,7 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 template<class NODE_T>
 bool ANode<T, MAX_COUNT, SIZE, ADAPTER>::canAcceptNode(const NODE_T &incomingNode, bool asPrefix, size_t offset,
                                                        size_t length) const {
-    if constexpr (std::is_same_v<NODE_T, ANodeCPtr> || std::is_same_v<NODE_T, ANodePtr>) {
+    if constexpr (std::is_same_v<std::remove_cvref_t<decltype(*incomingNode)>, ANode>) {
         return false;
     }
     length = normalizeLength(length, offset, incomingNode->size());
@@ -151,7 +152,8 @@ bool ANode<T, MAX_COUNT, SIZE, ADAPTER>::canAcceptNode(const NODE_T &incomingNod
         return true;
     }
     if (childrenCount_ == MAX_COUNT) {
-        const void *pointerToAdd = isOrigin(incomingNode) ? nullptr : static_cast<const void *>(incomingNode.get());
+        const void *pointerToAdd = isOrigin(incomingNode) ? nullptr : static_cast<const void *>(
+                std::to_address(incomingNode));
         if (asPrefix) {
             if (pointerToAdd == (children_[0] ? children_[0].get() : nullptr) && offset + length == offset_[0]) {
                 return true;
@@ -181,8 +183,7 @@ bool ANode<T, MAX_COUNT, SIZE, ADAPTER>::canAcceptNode(const NODE_T &incomingNod
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 template<class NODE_T>
 size_t ANode<T, MAX_COUNT, SIZE, ADAPTER>::minChildRetention(const NODE_T &incomingNode) {
-    constexpr bool isBNode = std::is_same_v<std::remove_cvref_t<NODE_T>, BNodePtr> or
-                             std::is_same_v<std::remove_cvref_t<NODE_T>, BNodeCPtr>;
+    constexpr bool isBNode = std::is_same_v<std::remove_cvref_t<decltype(*incomingNode)>, BNodeT>;
 
     if constexpr (isBNode) {
         return (incomingNode->size() / incomingNode->childrenCount());
@@ -194,11 +195,12 @@ size_t ANode<T, MAX_COUNT, SIZE, ADAPTER>::minChildRetention(const NODE_T &incom
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void ANode<T, MAX_COUNT, SIZE, ADAPTER>::shiftNodes(size_t startPos, size_t newCount, int64_t sizeDelta) {
     assert(newCount > childrenCount_);
+    summary_.reset();
+    hash_.reset();
     for (size_t i = 1; i <= childrenCount_ - startPos; i++) {
         offset_[newCount - i] = offset_[childrenCount_ - i];
         cumSize_[newCount - i] = cumSize_[childrenCount_ - i] + sizeDelta;
         children_[newCount - i] = std::move(children_[childrenCount_ - i]);
-        isLeaf_[newCount - i] = isLeaf_[childrenCount_ - i];
     }
 }
 
@@ -207,13 +209,15 @@ template<class NODE_T>
 bool ANode<T, MAX_COUNT, SIZE, ADAPTER>::isOrigin(const NODE_T &incomingNode) const {
     return std::visit([&](const auto &ptr) {
         return static_cast<const void *>(ptr.get());
-    }, origin_) == static_cast<const void *>(incomingNode.get());
+    }, origin_) == static_cast<const void *>(std::to_address(incomingNode));
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 template<class NODE_T>
 void ANode<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t offset, size_t length, bool asPrefix,
                                                  void *context) {
+    summary_.reset();
+    hash_.reset();
     if constexpr (std::is_same_v<typename ANode<T, MAX_COUNT, SIZE, ADAPTER>::VarType, std::remove_cvref_t<NODE_T>>) {
         addNodeVar(std::forward<NODE_T>(incomingNode), offset, length, asPrefix);
     } else if constexpr (std::is_null_pointer_v<NODE_T>) {
@@ -228,12 +232,8 @@ void ANode<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t o
         if (!incomingNode->isConst()) {
             throw std::logic_error("Can only add const children");
         }
-        bool isLeaf;
-        if constexpr (std::is_same_v<std::remove_cvref_t<NODE_T>, LeafCPtr>) {
-            isLeaf = true;
-        } else if constexpr (std::is_same_v<std::remove_cvref_t<NODE_T>, BNodeCPtr>) {
-            isLeaf = false;
-        } else {
+        if constexpr (!std::is_same_v<std::remove_cvref_t<NODE_T>, LeafCPtr> &&
+                      !std::is_same_v<std::remove_cvref_t<NODE_T>, BNodeCPtr>) {
             throw std::logic_error("Unsupported type");
         }
         //Normalize length to the max available
@@ -243,24 +243,23 @@ void ANode<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t o
             return;
         }
         assert(canAcceptNode(incomingNode, asPrefix, offset, length));
-        GenericCPtr pointerToAdd;
+        ChildVarType pointerToAdd;
         if (!isOrigin(incomingNode)) {
-            pointerToAdd = std::static_pointer_cast<const void>(std::forward<NODE_T>(incomingNode));
+            pointerToAdd = std::forward<NODE_T>(incomingNode);
         }
         if (childrenCount_) {
             //checking if the added node fits the existing node in place
             if (asPrefix) {
-                if (pointerToAdd == children_[0] && offset + length == offset_[0]) {
+                if (pointerToAdd.get() == children_[0].get() && offset + length == offset_[0]) {
                     offset_[0] -= length;
                     for (int i = 0; i < childrenCount_; i++) {
                         cumSize_[i] += length;
                     }
                     return;
                 }
-            } else if (pointerToAdd == children_[childrenCount_ - 1] && offset == offset_[childrenCount_ - 1] +
-                                                                                  cumSize_[childrenCount_ - 1] -
-                                                                                  (childrenCount_ > 1 ? cumSize_[
-                                                                                          childrenCount_ - 2] : 0)) {
+            } else if (pointerToAdd.get() == children_[childrenCount_ - 1].get() &&
+                       offset == offset_[childrenCount_ - 1] + cumSize_[childrenCount_ - 1] -
+                                 (childrenCount_ > 1 ? cumSize_[childrenCount_ - 2] : 0)) {
                 cumSize_[childrenCount_ - 1] += length;
                 return;
             }
@@ -278,7 +277,6 @@ void ANode<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t o
         }
         offset_[destPos] = offset;
         children_[destPos] = std::move(pointerToAdd);
-        isLeaf_[destPos] = isLeaf;
         childrenCount_++;
     }
 }
@@ -303,12 +301,13 @@ ANode<T, MAX_COUNT, SIZE, ADAPTER>::addNodeVar(const ANode::VarType &incomingNod
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void ANode<T, MAX_COUNT, SIZE, ADAPTER>::removeNodes(uint16_t startPoint, uint16_t count) {
     assert(count <= childrenCount_);
+    summary_.reset();
+    hash_.reset();
     size_t sizeDelta = cumSize_[startPoint + count - 1] - (startPoint > 0 ? cumSize_[startPoint - 1] : 0);
     for (int i = startPoint; i < childrenCount_ - count; i++) {
         offset_[i] = offset_[i + count];
         cumSize_[i] = cumSize_[i + count] - sizeDelta;
         children_[i] = std::move(children_[i + count]);
-        isLeaf_[i] = isLeaf_[i + count];
     }
     childrenCount_ -= count;
 }
@@ -357,6 +356,47 @@ void ANode<T, MAX_COUNT, SIZE, ADAPTER>::compact(void *context) {
     throw std::logic_error("Unable to compact (should call canCompactFirst)");
 }
 
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void ANode<T, MAX_COUNT, SIZE, ADAPTER>::makeConst() {
+    annotationDepth_ = std::visit([](const auto &originPtr) {
+        return originPtr->annotationDepth();
+    }, origin_);
+    for (size_t i = 0; i < childrenCount_; i++) {
+        annotationDepth_ = std::max(annotationDepth_, BNodeT::annotationDepth(children_[i]));
+    }
+    annotationDepth_++;
+    if constexpr (ADAPTER<T, SIZE>::CACHES_SUMMARY) {
+        summary_.set(summarize());
+    }
+    if constexpr (ADAPTER<T, SIZE>::HASHES_CONTENT) {
+        hash_.set(contentHash());
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+Summary<T> ANode<T, MAX_COUNT, SIZE, ADAPTER>::summarize(size_t offset, size_t length) const {
+    Summary<T> result;
+    if (offset >= size() || !length) {
+        return result;
+    }
+    forEachChild([&](const auto &childPtr, size_t childOffset, size_t childLen) {
+        result += summaryOf(childPtr, childOffset, childLen);
+    }, offset, length, false);
+    return result;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+ContentHash ANode<T, MAX_COUNT, SIZE, ADAPTER>::contentHash(size_t offset, size_t length) const {
+    ContentHash result;
+    if (offset >= size() || !length) {
+        return result;
+    }
+    forEachChild([&](const auto &childPtr, size_t childOffset, size_t childLen) {
+        result += hashOf(childPtr, childOffset, childLen);
+    }, offset, length, false);
+    return result;
+}
+
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto ANode<T, MAX_COUNT, SIZE, ADAPTER>::createNodePtr(const ANode &src) -> ANode::ANodePtr {
     static auto &alloc = StdFixedAllocator<ANode>::oneAndOnly();
@@ -382,12 +422,10 @@ void ANode<T, MAX_COUNT, SIZE, ADAPTER>::compact(uint16_t fromNode, uint16_t nod
         expectedSize += childRetainedSize(pos);
         if (!children_[pos]) {
             builder.addNode(origin_, offset_[pos], childRetainedSize(pos));
-        } else if (isLeaf_[pos]) {
-            builder.addNode(std::static_pointer_cast<const LeafT>(std::move(children_[pos])), offset_[pos],
-                            childRetainedSize(pos));
+        } else if (BNodeT::isLeaf(children_[pos])) {
+            builder.addNode(takeNode<LeafCPtr>(children_[pos]), offset_[pos], childRetainedSize(pos));
         } else {
-            builder.addNode(std::static_pointer_cast<const BNodeT>(std::move(children_[pos])), offset_[pos],
-                            childRetainedSize(pos));
+            builder.addNode(takeNode<BNodeCPtr>(children_[pos]), offset_[pos], childRetainedSize(pos));
         }
     }
     size_t newSize = builder.size();
@@ -397,14 +435,13 @@ void ANode<T, MAX_COUNT, SIZE, ADAPTER>::compact(uint16_t fromNode, uint16_t nod
         newSize = builder.size();
         assert(expectedSize == newSize);
     }
-    std::visit([&](auto &&nodePtr) {
+    visitNode([&](auto &&nodePtr) {
         if constexpr (is_unique_ptr_v<decltype(nodePtr)>) {
             throw std::logic_error("Builder must return const nodes");
         } else if constexpr (std::is_same_v<ANodeCPtr, std::remove_cvref_t<decltype(nodePtr)>>) {
             throw std::logic_error("Builder should not return an ANode");
         } else {
-            children_[fromNode] = std::static_pointer_cast<const void>(nodePtr);
-            isLeaf_.set(fromNode, std::is_same_v<LeafCPtr, std::remove_cvref_t<decltype(nodePtr)>>);
+            children_[fromNode] = std::move(nodePtr);
         }
     }, builder.close(false));
 
@@ -421,42 +458,42 @@ ANode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChildMove(Visitor &&visitor, size_t o
     size_t firstNodePos, lastNodePos;
     std::tie(firstNodePos, lastNodePos) = nodeRangeInclusive(offset, length);
     size_t currentOffset = offset - (firstNodePos ? cumSize_[firstNodePos - 1] : 0);
-    auto visitorInternal = [&](auto &&child, bool isLeaf, size_t childOffset, size_t childLen) {
+    auto visitorInternal = [&](ChildVarType &child, size_t childOffset, size_t childLen) {
         if (!child) {
             if (origin_.index() == 0) {
                 visitor(std::get<LeafCPtr>(origin_), childOffset, childLen);
             } else {
                 visitor(std::get<BNodeCPtr>(origin_), childOffset, childLen);
             }
-        } else if (isLeaf) {
-            visitor(std::static_pointer_cast<const LeafT>(std::move(child)), childOffset, childLen);
+        } else if (BNodeT::isLeaf(child)) {
+            visitor(takeNode<LeafCPtr>(child), childOffset, childLen);
         } else {
-            visitor(std::static_pointer_cast<const BNodeT>(std::move(child)), childOffset, childLen);
+            visitor(takeNode<BNodeCPtr>(child), childOffset, childLen);
         }
     };
 
     if (asPrefix) {
         if (firstNodePos != lastNodePos) {
-            visitorInternal(std::move(children_[lastNodePos]), isLeaf_[lastNodePos], offset_[lastNodePos],
+            visitorInternal(children_[lastNodePos], offset_[lastNodePos],
                             length + offset - cumSize_[lastNodePos - 1]);
             length = cumSize_[lastNodePos - 1] - offset;
             for (auto i = lastNodePos - 1; i > firstNodePos; i--) {
-                visitorInternal(std::move(children_[i]), isLeaf_[i], offset_[i], sizeAt(i));
+                visitorInternal(children_[i], offset_[i], sizeAt(i));
                 length -= sizeAt(i);
             }
         }
-        visitorInternal(std::move(children_[firstNodePos]), isLeaf_[firstNodePos],
+        visitorInternal(children_[firstNodePos],
                         offset_[firstNodePos] + currentOffset,
                         length);
     } else {
         for (auto i = firstNodePos; i < lastNodePos; i++) {
             size_t len = sizeAt(i) - currentOffset;
-            visitorInternal(std::move(children_[i]), isLeaf_[i], offset_[i] + currentOffset,
+            visitorInternal(children_[i], offset_[i] + currentOffset,
                             sizeAt(i) - currentOffset);
             currentOffset = 0;
             length -= len;
         }
-        visitorInternal(std::move(children_[lastNodePos]), isLeaf_[lastNodePos], offset_[lastNodePos] + currentOffset,
+        visitorInternal(children_[lastNodePos], offset_[lastNodePos] + currentOffset,
                         std::min(sizeAt(lastNodePos) - currentOffset, length));
     }
 }
@@ -465,58 +502,99 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 template<class Visitor>
 void
 ANode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChild(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const {
-    auto visitorInternal = [&](const auto &child, bool isLeaf, size_t childOffset, size_t childLen) {
+    forEachChildSlot([&](const ChildVarType &child, size_t childOffset, size_t childLen) {
         if (!child) {
             if (origin_.index() == 0) {
                 visitor(std::get<LeafCPtr>(origin_), childOffset, childLen);
             } else {
                 visitor(std::get<BNodeCPtr>(origin_), childOffset, childLen);
             }
-        } else if (isLeaf) {
-            visitor(std::static_pointer_cast<const LeafT>(child), childOffset, childLen);
+        } else if (BNodeT::isLeaf(child)) {
+            child.template visitAs<LeafCPtr>([&](const LeafCPtr &leafPtr) {
+                visitor(leafPtr, childOffset, childLen);
+            });
         } else {
-            visitor(std::static_pointer_cast<const BNodeT>(child), childOffset, childLen);
+            child.template visitAs<BNodeCPtr>([&](const BNodeCPtr &bNodePtr) {
+                visitor(bNodePtr, childOffset, childLen);
+            });
         }
+    }, offset, length, asPrefix);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class Visitor>
+void
+ANode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChildNode(Visitor &&visitor, size_t offset, size_t length,
+                                                     bool asPrefix) const {
+    forEachChildSlot([&](const ChildVarType &child, size_t childOffset, size_t childLen) {
+        auto visitorInternal = [&](const auto &node) {
+            visitor(node, childOffset, childLen);
+        };
+        if (!child) {
+            visitConstNode(visitorInternal, origin_);
+        } else {
+            visitConstNode(visitorInternal, child);
+        }
+    }, offset, length, asPrefix);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class Visitor>
+decltype(auto) ANode<T, MAX_COUNT, SIZE, ADAPTER>::visitChildAt(Visitor &&visitor, size_t offset) const {
+    size_t pos = cumUpperBound(cumSize_.data(), childrenCount_, offset);
+    assert(pos < childrenCount_);
+    auto visitorInternal = [&](const auto &node) -> decltype(auto) {
+        return visitor(node, offset_[pos], pos ? cumSize_[pos - 1] : 0, sizeAt(pos));
     };
+    if (!children_[pos]) {
+        return visitConstNode(visitorInternal, origin_);
+    }
+    return visitConstNode(visitorInternal, children_[pos]);
+}
 
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class Visitor>
+void
+ANode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChildSlot(Visitor &&visitor, size_t offset, size_t length,
+                                                     bool asPrefix) const {
     length = std::min(length, size() - offset);
     size_t firstNodePos, lastNodePos;
     std::tie(firstNodePos, lastNodePos) = nodeRangeInclusive(offset, length);
     size_t currentOffset = offset - (firstNodePos ? cumSize_[firstNodePos - 1] : 0);
     if (asPrefix) {
         if (firstNodePos != lastNodePos) {
-            visitorInternal(children_[lastNodePos], isLeaf_[lastNodePos], offset_[lastNodePos],
-                            length + offset - cumSize_[lastNodePos - 1]);
+            visitor(children_[lastNodePos], offset_[lastNodePos],
+                    length + offset - cumSize_[lastNodePos - 1]);
             length = cumSize_[lastNodePos - 1] - offset;
             for (auto i = lastNodePos - 1; i > firstNodePos; i--) {
-                visitorInternal(children_[i], isLeaf_[i], offset_[i], sizeAt(i));
+                visitor(children_[i], offset_[i], sizeAt(i));
                 length -= sizeAt(i);
             }
         }
-        visitorInternal(children_[firstNodePos], isLeaf_[firstNodePos], offset_[firstNodePos] + currentOffset, length);
+        visitor(children_[firstNodePos], offset_[firstNodePos] + currentOffset, length);
     } else {
         for (auto i = firstNodePos; i < lastNodePos; i++) {
+            prefetchChildren<CHILD_PREFETCH_DISTANCE>(children_, i, lastNodePos);
             size_t len = sizeAt(i) - currentOffset;
-            visitorInternal(children_[i], isLeaf_[i], offset_[i] + currentOffset, len);
+            visitor(children_[i], offset_[i] + currentOffset, len);
             currentOffset = 0;
             length -= len;
         }
-        visitorInternal(children_[lastNodePos], isLeaf_[lastNodePos], offset_[lastNodePos] + currentOffset,
-                        std::min(sizeAt(lastNodePos) - currentOffset, length));
+        visitor(children_[lastNodePos], offset_[lastNodePos] + currentOffset,
+                std::min(sizeAt(lastNodePos) - currentOffset, length));
     }
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 std::tuple<size_t, size_t> ANode<T, MAX_COUNT, SIZE, ADAPTER>::nodeRangeInclusive(size_t offset, size_t length) const {
-    size_t firstNodePos =
-            std::upper_bound(cumSize_.begin(), cumSize_.begin() + childrenCount_, offset) - cumSize_.begin();
+    size_t firstNodePos = cumUpperBound(cumSize_.data(), childrenCount_, offset);
     size_t lastNodePos = lowerBoundPos(offset + length);
     return {firstNodePos, lastNodePos};
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t ANode<T, MAX_COUNT, SIZE, ADAPTER>::lowerBoundPos(size_t offset) const {
-    return std::lower_bound(cumSize_.begin(), cumSize_.begin() + childrenCount_, offset) - cumSize_.begin();
+    return cumLowerBound(cumSize_.data(), childrenCount_, offset);
 }
 
 
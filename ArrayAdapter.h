@@ -3,62 +3,71 @@
 #define EXPERIMENTS_ARRAYADAPTER_H
 
 #include "ArrayAdapterFwd.h"
+#include "ConstPtr.h"
+#include "ContentHash.h"
 #include <cstring>
 #include "arrow/table.h"
 #include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * Backing array of a leaf, the reference count of its const handles sits in front of the values so a const array is
+ * shared without a control block
+ */
+template<class T, size_t SIZE>
+struct CountedArray : public RefCounted {
+    T values[SIZE];
+};
 
 template<class T, size_t SIZE>
 struct ArrayAdapter {
 private:
-    using Allocator = StdFixedSizeArrayAllocator<T, SIZE>;
-    using Deleter = DeleterForAllocator<T, StdFixedSizeArrayAllocator<T, SIZE>>;
+    using Array = CountedArray<T, SIZE>;
+    using Allocator = StdFixedAllocator<Array>;
     inline static Allocator &alloc = Allocator::oneAndOnly();
 public:
-    using ArrayPtr = std::unique_ptr<T[], Deleter>;
-    using ArrayCPtr = std::shared_ptr<const T>;
+    using ArrayPtr = std::unique_ptr<Array, DeleterForFixedAllocator<Array>>;
+    using ArrayCPtr = ConstPtr<Array>;
     using ValueType = T;
 
+    //const nodes cache the sum/min/max of their values
+    static constexpr bool CACHES_SUMMARY = std::is_arithmetic_v<T>;
+
+    //hashing every value costs more than building the leaf, see HashedArrayAdapter to cache a hash of them as well
+    static constexpr bool HASHES_CONTENT = false;
+
     using DeclaredType = std::variant<ArrayPtr, ArrayCPtr>;
 
 
     static ArrayPtr createLeaf(void *context = nullptr) {
         assert(context == nullptr);
-        return ArrayPtr(alloc.allocate(1), Deleter());
+        return ArrayPtr(new(alloc.allocate(1)) Array);
     }
 
     static const T *constArray(const DeclaredType &leaf) {
         if (leaf.index() == 0) {
-            return &std::get<0>(leaf)[0];
+            return std::get<0>(leaf)->values;
         } else {
-            return &(std::get<1>(leaf).get()[0]);
+            return std::get<1>(leaf)->values;
         }
     }
 
     static const T &at(const DeclaredType &leaf, size_t pos) {
-        if (leaf.index() == 0) {
-            return std::get<0>(leaf)[pos];
-        } else {
-            return std::get<1>(leaf).get()[pos];
-        }
+        return constArray(leaf)[pos];
     }
 
     static void copy(DeclaredType &dest, size_t destOffset, const DeclaredType &src, size_t srcOffset, size_t length) {
         if (dest.index() == 0) {
-            if (src.index() == 0) {
-                memcpy(&std::get<ArrayPtr>(dest)[destOffset], &std::get<ArrayPtr>(src)[srcOffset],
-                       length * sizeof(T));
-            } else {
-                memcpy(&std::get<ArrayPtr>(dest)[destOffset], &std::get<ArrayCPtr>(src).get()[srcOffset],
-                       length * sizeof(T));
-            }
+            memcpy(&std::get<ArrayPtr>(dest)->values[destOffset], &constArray(src)[srcOffset], length * sizeof(T));
         } else {
             throw std::logic_error("Cannot write to a const leaf");
         }
     }
 
     static void getValues(T *destLeaf, const DeclaredType &src, size_t srcOffset, size_t length) {
-        const T *data = src.index() ? std::get<ArrayCPtr>(src).get() : static_cast<const T *>(std::get<ArrayPtr>(
-                src).get());
+        const T *data = constArray(src);
         if constexpr (std::is_trivially_copyable<T>::value) {
             memcpy(destLeaf, &data[srcOffset], length * sizeof(T));
         } else {
@@ -69,11 +78,11 @@ public:
     }
 
     static void setAt(DeclaredType &leaf, size_t pos, const T &value) {
-        std::get<0>(leaf)[pos] = value;
+        std::get<0>(leaf)->values[pos] = value;
     }
 
     static void setValues(DeclaredType &dest, size_t offset, const T *srcLeaf, size_t length) {
-        T *data = &std::get<ArrayPtr>(dest)[offset];
+        T *data = &std::get<ArrayPtr>(dest)->values[offset];
         if constexpr (std::is_trivially_copyable<T>::value) {
             std::memcpy(data, srcLeaf, length * sizeof(T));
         } else {
@@ -84,23 +93,22 @@ public:
     }
 
     static DeclaredType mutateCopy(const DeclaredType &src) {
-        T *resultPointer = alloc.allocate(1);
-        getValues(resultPointer, src, 0, SIZE);
-        return ArrayPtr(resultPointer, Deleter());
+        ArrayPtr result = createLeaf();
+        getValues(result->values, src, 0, SIZE);
+        return result;
     }
 
     static void mutate(DeclaredType &leaf, void *context) {
         assert(context == nullptr);
         if (leaf.index() == 1) {
-            leaf = mutateCopy(leaf);
+            //an array no other leaf shares gets written in place
+            leaf = std::get<1>(leaf).isExclusive() ? DeclaredType(std::get<1>(leaf).takeExclusive()) : mutateCopy(leaf);
         }
     }
 
     static void makeConst(DeclaredType &leaf) {
         if (leaf.index() == 0) {
-            ArrayPtr &pointer = std::get<0>(leaf);
-            T *data = pointer.release();
-            leaf = DeclaredType(ArrayCPtr(data, Deleter(), alloc));
+            leaf = DeclaredType(ArrayCPtr(std::get<0>(std::move(leaf))));
         }
     }
 
@@ -109,7 +117,21 @@ public:
     }
 
     static void shiftData(DeclaredType &buf, size_t from, size_t to, size_t length) {
-        memmove(&std::get<ArrayPtr>(buf)[to], &std::get<ArrayPtr>(buf)[from], length * sizeof(T));
+        T *data = std::get<ArrayPtr>(buf)->values;
+        memmove(&data[to], &data[from], length * sizeof(T));
+    }
+
+    /**
+     * Visits the backing array as (address, bytes, useCount, isControlBlock), the count sits in the array itself
+     */
+    template<class Visitor>
+    static void forEachAllocation(const DeclaredType &leaf, Visitor &&visitor) {
+        if (leaf.index() == 0) {
+            visitor(static_cast<const void *>(std::get<0>(leaf).get()), sizeof(Array), size_t(1), false);
+        } else {
+            visitor(static_cast<const void *>(std::get<1>(leaf).get()), sizeof(Array), std::get<1>(leaf).use_count(),
+                    false);
+        }
     }
 
     static bool isMutable(const DeclaredType &buf) { return buf.index() == 0; }
@@ -119,6 +141,15 @@ public:
     }
 };
 
+/**
+ * ArrayAdapter whose const nodes also cache a hash of their values (see ContentHash), for trees compared or used as
+ * cache keys more often than they are built
+ */
+template<class T, size_t SIZE>
+struct HashedArrayAdapter : public ArrayAdapter<T, SIZE> {
+    static constexpr bool HASHES_CONTENT = true;
+};
+
 template<class T, size_t SIZE>
 struct IndexAdapter;
 
@@ -130,6 +161,9 @@ struct SpaceProvider {
 
     inline static constexpr size_t NULL_ENTRY = std::numeric_limits<size_t>::max();
 
+    //Typical shared_ptr control block with a custom deleter: vtable pointer, both counts, the pointer and the deleter
+    inline static constexpr size_t CONTROL_BLOCK_BYTES = sizeof(void *) + 2 * sizeof(int) + 2 * sizeof(void *);
+
 
     struct TranslationUnit {
 
@@ -166,9 +200,14 @@ struct SpaceProvider {
     struct RefId {
         const size_t firstReference = 0;
         const size_t size;
+        /**
+         * Releases the provider had seen when the address was handed out: an address is only recycled once released,
+         * so (address, epoch) names a single registration even though the address alone doesn't (see contentHash)
+         */
+        const size_t epoch = 0;
 
-        RefId(size_t firstReference, size_t size, std::shared_ptr<size_t> ownerPtr) :
-                firstReference(firstReference), size(size), ownerPtr_(ownerPtr) {}
+        RefId(size_t firstReference, size_t size, std::shared_ptr<size_t> ownerPtr, size_t epoch) :
+                firstReference(firstReference), size(size), epoch(epoch), ownerPtr_(ownerPtr) {}
 
         RefId(RefId &&refId) = default;
 
@@ -178,7 +217,7 @@ struct SpaceProvider {
             return firstReference + pos;
         }
 
-        void getValues(size_t *destLeaf, size_t srcOffset, size_t length) {
+        void getValues(size_t *destLeaf, size_t srcOffset, size_t length) const {
             assert(srcOffset <= BlockSize);
             assert(srcOffset + length <= BlockSize);
             for (size_t i = 0; i < length; i++) {
@@ -190,6 +229,16 @@ struct SpaceProvider {
             return *ownerPtr_;
         }
 
+        /**
+         * Visits the pooled owner entry together with its shared_ptr control block as a single allocation. The
+         * control block layout is up to the standard library, so its size is an estimate.
+         */
+        template<class Visitor>
+        void forEachAllocation(Visitor &&visitor) const {
+            visitor(static_cast<const void *>(ownerPtr_.get()), sizeof(size_t) + CONTROL_BLOCK_BYTES,
+                    size_t(ownerPtr_.use_count()), true);
+        }
+
     private:
         friend class SpaceProvider;
 
@@ -202,9 +251,9 @@ struct SpaceProvider {
 
         CopyList copyList;
 
-        RefIdWithTracking(size_t firstReference, size_t size, std::shared_ptr<size_t> ownerPtr,
+        RefIdWithTracking(size_t firstReference, size_t size, std::shared_ptr<size_t> ownerPtr, size_t epoch,
                           AllocationSession &allocationSession) :
-                RefId(firstReference, size, ownerPtr), allocationSession_(allocationSession),
+                RefId(firstReference, size, ownerPtr, epoch), allocationSession_(allocationSession),
                 copyList(copyListAlloc.allocate(1), Deleter()) {
             std::fill(copyList.get(), copyList.get() + BlockSize, NULL_ENTRY);
         }
@@ -230,7 +279,7 @@ struct SpaceProvider {
             }
         }
 
-        void getValues(size_t *destLeaf, size_t srcOffset, size_t length) {
+        void getValues(size_t *destLeaf, size_t srcOffset, size_t length) const {
             assert(srcOffset <= BlockSize);
             assert(srcOffset + length <= BlockSize);
             memcpy(destLeaf, &copyList[srcOffset], length * sizeof(size_t));
@@ -245,6 +294,15 @@ struct SpaceProvider {
         void shiftData(size_t from, size_t to, size_t length) {
             memmove(&copyList[to], &copyList[from], length * sizeof(size_t));
         }
+
+        /**
+         * The copy list (until made const), then the owner entry
+         */
+        template<class Visitor>
+        void forEachAllocation(Visitor &&visitor) const {
+            visitor(static_cast<const void *>(copyList.get()), BlockSize * sizeof(size_t), size_t(1), false);
+            RefId::forEachAllocation(visitor);
+        }
     };
 
 
@@ -252,44 +310,123 @@ private:
     using BlockAllocator = StdFixedAllocator<size_t>;
     using BlockDeleter = DeleterForFixedAllocator<size_t>;
 
+    /**
+     * The address bookkeeping, shared by the provider and the deleter of every RefId it handed out: an index may well
+     * outlive the provider (and whatever owns it), its last RefIds then recycle into a state nobody allocates from and
+     * the listener, detached by the provider on destruction, isn't called any longer.
+     */
+    struct State {
+        std::atomic<size_t> nextId = BlockSize;//Start one step off zero
+
+        //blocks whose last reference is gone, handed out again by nextAddress
+        std::vector<size_t> freeBlocks_;
+        SpinLock freeBlocksLock_;
+
+        //releases so far, counted before the address goes back to freeBlocks_ (see RefId::epoch)
+        std::atomic<size_t> epoch = 0;
+
+        //held around every call of the listener, so that once detached it's not running either. Recursive as a release
+        //may drop data holding RefIds of its own (e.g. a provider over another frame of the same space)
+        std::recursive_mutex listenerMutex_;
+        std::function<void(size_t, size_t)> releaseListener_;
+
+        /**
+         * Notifies the listener, then recycles the blocks spanned by [refId, refId + size) as single blocks: ranges
+         * mapped by mapBlock come back one block at a time, so they only ever serve newBlock
+         */
+        void removingReference(size_t refId, size_t size) {
+            {
+                std::lock_guard<std::recursive_mutex> guard(listenerMutex_);
+                if (releaseListener_) {
+                    releaseListener_(refId, size);
+                }
+            }
+            epoch.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<SpinLock> guard(freeBlocksLock_);
+            for (size_t address = refId; address < refId + std::max(size, size_t(1)); address += BlockSize) {
+                freeBlocks_.push_back(address);
+            }
+        }
+
+        size_t nextAddress() {
+            {
+                std::lock_guard<SpinLock> guard(freeBlocksLock_);
+                if (!freeBlocks_.empty()) {
+                    size_t result = freeBlocks_.back();
+                    freeBlocks_.pop_back();
+                    return result;
+                }
+            }
+            auto result = (nextId += BlockSize) - BlockSize;//We want the previous value
+            return result;
+        }
+    };
+
     struct DeleterForReference {
-        SpaceProvider &spaceProvider_;
+        std::shared_ptr<State> state_;
+        //rows mapped at the address
+        size_t size_;
 
-        DeleterForReference(SpaceProvider &spaceProvider) : spaceProvider_(spaceProvider) {}
+        DeleterForReference(const std::shared_ptr<State> &state, size_t size) : state_(state), size_(size) {}
 
         void operator()(size_t *__ptr) {
-            spaceProvider_.removingReference(*__ptr);
+            state_->removingReference(*__ptr, size_);
             auto &allocator = StdFixedAllocator<size_t>::oneAndOnly();
             allocator.destroy(__ptr);
             allocator.deallocate(__ptr, 1);
         }
     };
 
-    std::atomic<size_t> nextId = BlockSize;//Start one step off zero
-
+    std::shared_ptr<State> state_ = std::make_shared<State>();
 
     inline static Allocator &copyListAlloc = Allocator::oneAndOnly();
 public:
+    SpaceProvider() = default;
+
+    SpaceProvider(const SpaceProvider &) = delete;
 
-    void removingReference(size_t refId) {
-        //TODO notify listeners
+    SpaceProvider &operator=(const SpaceProvider &) = delete;
+
+    ~SpaceProvider() {
+        setReleaseListener(nullptr);
+    }
+
+    /**
+     * Sets the function called with (address, size) when the last RefId of a block or of a mapped range is gone, on
+     * the thread releasing it, before the address can be handed out again. Meant to be set once, before any address
+     * is given out. The provider drops it on destruction, releases coming later only recycle the addresses.
+     */
+    void setReleaseListener(std::function<void(size_t, size_t)> listener) {
+        std::lock_guard<std::recursive_mutex> guard(state_->listenerMutex_);
+        state_->releaseListener_ = std::move(listener);
     }
 
     size_t nextAddress() {
-        auto result = (nextId += BlockSize) - BlockSize;//We want the previous value
-        return result;
+        return state_->nextAddress();
+    }
+
+    /**
+     * Epoch for an address just handed out: read after taking it, so it counts the release that recycled it
+     */
+    size_t currentEpoch() const {
+        return state_->epoch.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Blocks released and not handed out again yet
+     */
+    size_t freeBlockCount() {
+        std::lock_guard<SpinLock> guard(state_->freeBlocksLock_);
+        return state_->freeBlocks_.size();
     }
 
     RefId mapBlock(size_t size) {
         static auto &blockAllocator = BlockAllocator::oneAndOnly();
 
         size_t *p = blockAllocator.allocate(1);
-        *p = nextId;
-        nextId += (size / BlockSize) * BlockSize;
-        if (size % BlockSize) {
-            nextId += BlockSize;
-        }
-        return RefId(*p, size, std::shared_ptr<size_t>(p, DeleterForReference(*this)));
+        //a single fetch_add, so that concurrent mappings and new blocks get disjoint ranges
+        *p = state_->nextId.fetch_add(std::max(size_t(1), (size + BlockSize - 1) / BlockSize) * BlockSize);
+        return RefId(*p, size, std::shared_ptr<size_t>(p, DeleterForReference(state_, size)), currentEpoch());
     }
 
     std::unique_ptr<AllocationSession> newAllocationSession() {
@@ -311,7 +448,9 @@ auto SpaceProvider<BlockSize>::AllocationSession::newBlock() -> SpaceProvider::R
 
     size_t *p = blockAllocator.allocate(1);
     *p = spaceProvider_.nextAddress();
-    return RefIdWithTracking(*p, BlockSize, std::shared_ptr<size_t>(p, DeleterForReference(spaceProvider_)), *this);
+    return RefIdWithTracking(*p, BlockSize,
+                             std::shared_ptr<size_t>(p, DeleterForReference(spaceProvider_.state_, BlockSize)),
+                             spaceProvider_.currentEpoch(), *this);
 
 }
 
@@ -320,7 +459,16 @@ template<size_t SIZE>
 struct IndexAdapter<size_t, SIZE> {
     using ValueType = size_t;
 
+    //values are row addresses, aggregating them has no meaning
+    static constexpr bool CACHES_SUMMARY = false;
+
+    //the same addresses are the same rows, so hashing them tells equal indices apart from different ones
+    static constexpr bool HASHES_CONTENT = true;
+
 private:
+    //spreads the epochs of a recycled address far apart from one another and from the addresses in use
+    static constexpr uint64_t EPOCH_STRIDE = 0x9e3779b97f4a7c15ULL % ContentHash::PRIME;
+
     using Provider = SpaceProvider<SIZE>;
     using ProviderSession = typename Provider::AllocationSession;
 
@@ -362,6 +510,18 @@ public:
         }, src);
     }
 
+    /**
+     * The addresses of a block are consecutive, so their hash takes O(log(length)) rather than a pass over them, and
+     * a single multiplication for whole blocks. The run is shifted by the epoch of the block (see RefId::epoch), so an
+     * address recycled for other rows doesn't hash like it did before; addresses never released hash as themselves.
+     */
+    static ContentHash contentHash(const DeclaredType &leaf, size_t offset, size_t length) {
+        static const SequenceHash wholeBlock(SIZE);
+        size_t epoch = std::visit([](const auto &ref) { return ref.epoch; }, leaf);
+        uint64_t first = ContentHash::reduce(at(leaf, offset)) + ContentHash::mulMod(epoch, EPOCH_STRIDE);
+        return length == SIZE ? wholeBlock(first) : hashSequence(first, length);
+    }
+
     static void setAt(DeclaredType &leaf, size_t pos, const ValueType &value) {
         std::get<0>(leaf)[pos] = value;
     }
@@ -404,6 +564,11 @@ public:
         std::get<ArrayPtr>(buf).shiftData(from, to, length);
     }
 
+    template<class Visitor>
+    static void forEachAllocation(const DeclaredType &leaf, Visitor &&visitor) {
+        std::visit([&](const auto &ref) { ref.forEachAllocation(visitor); }, leaf);
+    }
+
     static bool isMutable(const DeclaredType &buf) { return buf.index() == 0; }
 
     static bool isNull(const DeclaredType &buf) {
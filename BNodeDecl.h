@@ -3,11 +3,13 @@
 
 #include "Leaf.h"
 #include "bTraits.h"
+#include "NodeVariant.h"
+#include "Search.h"
 #include <type_traits>
 #include "ANodeFwd.h"
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
-class BNode {
+class BNode : public RefCounted {
     //Types
     using LeafType = Leaf<T, SIZE, ADAPTER>;
     using ANodeType = ANode<T, MAX_COUNT, SIZE, ADAPTER>;
@@ -20,14 +22,20 @@ class BNode {
     using BNodeDeleter = DeleterForFixedAllocator<BNode>;
 
     using LeafPtr = std::unique_ptr<LeafType, LeafDeleter>;
-    using LeafCPtr = std::shared_ptr<const LeafType>;
+    using LeafCPtr = ConstPtr<LeafType>;
     using ANodePtr = std::unique_ptr<ANodeType, ANodeDeleter>;
-    using ANodeCPtr = std::shared_ptr<const ANodeType>;
+    using ANodeCPtr = ConstPtr<ANodeType>;
 public:
     using Allocator = StdFixedAllocator<BNode>;
     using BNodePtr = std::unique_ptr<BNode, BNodeDeleter>;
-    using BNodeCPtr = std::shared_ptr<const BNode>;
-    using VarType = std::variant<LeafPtr, ANodePtr, BNodePtr, LeafCPtr, ANodeCPtr, BNodeCPtr>;
+    using BNodeCPtr = ConstPtr<BNode>;
+    /**
+     * One tagged word per child (see NodeVariant), so children_ takes 8 bytes per slot instead of a variant of smart
+     * pointers
+     */
+    using VarType = NodeVariant<LeafType, ANodeType, BNode>;
+
+    static constexpr size_t CHILD_PREFETCH_DISTANCE = ChildPrefetch<T, MAX_COUNT, SIZE, ADAPTER>::DISTANCE;
 private:
 
     //Members
@@ -35,6 +43,9 @@ private:
     std::array<size_t, MAX_COUNT> cumSize_;
     uint16_t childrenCount_ = 0;
     const int8_t height_;
+    int8_t annotationDepth_ = 0;
+    [[no_unique_address]] CachedSummary<T, ADAPTER<T, SIZE>::CACHES_SUMMARY> summary_;
+    [[no_unique_address]] CachedHash<ADAPTER<T, SIZE>::HASHES_CONTENT> hash_;
 private:
     //VarType Access
 
@@ -42,10 +53,10 @@ private:
     static auto copyNode(const std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> &nodePtr) -> VarType;
 
     template<class NODE_T>
-    static VarType copyNode(const std::shared_ptr<const NODE_T> &nodePtr) { return nodePtr; }
+    static VarType copyNode(const ConstPtr<NODE_T> &nodePtr) { return nodePtr; }
 
 
-    const T &childValueAt(const VarType &node, size_t index) const;
+    const T childValueAt(const VarType &node, size_t index) const;
 
     template<class NODE_T>
     static void makeConstInternal(VarType &node, bool isRoot);
@@ -59,23 +70,36 @@ public:
     BNode(const BNode &otherNode);
 
     BNode(BNode &&otherNode) : childrenCount_(otherNode.childrenCount_), cumSize_(std::move(otherNode.cumSize_)),
-                               children_(std::move(otherNode.children_)), height_(otherNode.height_) {
+                               children_(std::move(otherNode.children_)), height_(otherNode.height_),
+                               annotationDepth_(otherNode.annotationDepth_), summary_(std::move(otherNode.summary_)),
+                               hash_(std::move(otherNode.hash_)) {
         otherNode.childrenCount_ = 0;
     }
 
     int8_t height() const { return height_; }
 
+    /**
+     * Most annotations (ANodes) met on a path from this node down to a leaf, set by makeConst
+     */
+    int8_t annotationDepth() const { return annotationDepth_; }
+
+    static int8_t annotationDepth(const VarType &node);
+
     static auto copyNode(const VarType &node) -> VarType;
 
     template<class NODE>
     static int8_t height(const std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>> &node) { return node->height(); }
 
     template<class NODE>
-    static int8_t height(const std::shared_ptr<NODE> &node) { return node->height(); }
+    static int8_t height(const ConstPtr<NODE> &node) { return node->height(); }
 
     static int8_t height(const VarType &node);
 
-    VarType &childAt(size_t pos) { return children_[pos]; }
+    VarType &childAt(size_t pos) {
+        summary_.reset();
+        hash_.reset();
+        return children_[pos];
+    }
 
     const VarType &childAt(size_t pos) const { return children_[pos]; }
 
@@ -87,6 +111,15 @@ public:
 
     void makeConst(bool isRoot = false);
 
+    /**
+     * Drops what makeConst cached, for a const node reopened in place rather than copied (see ConstPtr::takeExclusive)
+     */
+    void thaw() {
+        annotationDepth_ = 0;
+        summary_.reset();
+        hash_.reset();
+    }
+
     void makeSeamConst(bool onFront);
 
     void updateCap(size_t startPos);
@@ -113,7 +146,6 @@ public:
     static size_t setValues(const VarType &child, const T *srcLeaf, size_t offset, size_t length);
 
     size_t setValues(const T *srcLeaf, size_t offset, size_t length);
-    //TODO - consider an internal implementation that builds a shared_ptr from the begining
 
     size_t sizeAt(size_t pos) const { return cumSize_[pos] - (pos ? cumSize_[pos - 1] : 0); }
 
@@ -130,7 +162,21 @@ public:
 
     bool isDeepBalanced(bool isRoot = false) const;
 
-    const T &operator[](size_t index) const;
+    const T operator[](size_t index) const;
+
+    /**
+     * Sum/min/max/count over [offset, offset + length), using the cached summaries of fully covered const children
+     */
+    Summary<T> summarize(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+    const Summary<T> *cachedSummary() const { return summary_.get(); }
+
+    /**
+     * Hash of the values in [offset, offset + length), using the cached hashes of fully covered const children
+     */
+    ContentHash contentHash(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+    const ContentHash *cachedHash() const { return hash_.get(); }
     //TODO - non-const indexing operation needs a special wrapper object that acts as a
 
     template<class Visitor>
@@ -139,6 +185,50 @@ public:
     template<class Visitor>
     void forEachChild(Visitor &&visitor, size_t childOffset, size_t childLen, bool asPrefix) const;
 
+    /**
+     * Read only forEachChild: the visitor gets a const reference to each child node instead of its smart pointer
+     */
+    template<class Visitor>
+    void forEachChildNode(Visitor &&visitor, size_t offset, size_t length, bool asPrefix = false) const;
+
+    /**
+     * Visits the child holding offset as (child, childBegin, sliceBegin, sliceLength): this node maps
+     * [sliceBegin, sliceBegin + sliceLength) of its own positions onto [childBegin, childBegin + sliceLength) of the child
+     */
+    template<class Visitor>
+    decltype(auto) visitChildAt(Visitor &&visitor, size_t offset) const;
+
+    /**
+     * Requests the lines visitChildAt searches (the count and the cumulative sizes), ahead of a descent into this node
+     */
+    void prefetchSearch() const {
+        __builtin_prefetch(&childrenCount_);
+        prefetchCumSizes<MAX_COUNT>(cumSize_.data());
+    }
+
+    /**
+     * Requests the lines a forward walk of this node starts on (the count, the cumulative sizes and the first line of children), see prefetchChildren
+     */
+    void prefetchWalk() const {
+        prefetchSearch();
+        __builtin_prefetch(children_.data());
+    }
+
+    /**
+     * Visits every child slot as its VarType, once per reference this node holds
+     */
+    template<class Visitor>
+    void forEachReference(Visitor &&visitor) const {
+        for (size_t pos = 0; pos < childrenCount_; pos++) {
+            visitor(children_[pos]);
+        }
+    }
+
+private:
+    template<class Visitor>
+    void forEachChildSlot(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const;
+
+public:
     //Utility factories
 
     static void makeConst(VarType &node, bool isRoot = false);
@@ -175,7 +265,7 @@ private:
     openInternal(VarType &dest, const std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> &nodePtr) {}
 
     template<class NODE_T>
-    static void openInternal(VarType &dest, const std::shared_ptr<const NODE_T> &nodePtr);
+    static void openInternal(VarType &dest, ConstPtr<NODE_T> &&nodePtr);
 
 public:
     static auto open(VarType &node) -> VarType &;
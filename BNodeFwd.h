@@ -6,4 +6,14 @@
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER = ArrayAdapter>
 class BNode;
 
+/**
+ * How many children ahead the range walks of the nodes of an instantiation (forEachChild and friends) prefetch, see
+ * prefetchChildren. Specialize it to tune a node shape, e.g. deeper for wide leaves whose values take longer to arrive:
+ * template<> struct ChildPrefetch<int, 16, 512, ArrayAdapter> { static constexpr size_t DISTANCE = 4; };
+ */
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+struct ChildPrefetch {
+    static constexpr size_t DISTANCE = 2;
+};
+
 #endif //EXPERIMENTS_BNODEFWD_H
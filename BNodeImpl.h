@@ -16,15 +16,15 @@ auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::copyNode(
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::copyNode(const BNode::VarType &node) -> BNode::VarType {
-    return std::visit([](const auto &nodePtr) {
+    return visitNode([](const auto &nodePtr) {
         return copyNode(nodePtr);
     }, node);
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
-const T &BNode<T, MAX_COUNT, SIZE, ADAPTER>::childValueAt(const BNode::VarType &node, size_t index) const {
-    return std::visit([&](const auto &nodePtr) -> const T & {
-        return std::as_const(*nodePtr)[index];
+const T BNode<T, MAX_COUNT, SIZE, ADAPTER>::childValueAt(const BNode::VarType &node, size_t index) const {
+    return visitConstNode([&](const auto &child) -> const T {
+        return child[index];
     }, node);
 }
 
@@ -33,8 +33,8 @@ template<class NODE_T>
 void BNode<T, MAX_COUNT, SIZE, ADAPTER>::makeConstInternal(BNode::VarType &node, bool isRoot) {
     using PtrDeleter = DeleterForFixedAllocator<NODE_T>;
     using UniquePtr = std::unique_ptr<NODE_T, PtrDeleter>;
-    std::get<UniquePtr>(node)->size(false);//updating size structures
-    node = VarType(makeConstFromPtr(std::get<UniquePtr>(std::move(node)), isRoot));
+    getNode<UniquePtr>(node)->size(false);//updating size structures
+    node = VarType(makeConstFromPtr(takeNode<UniquePtr>(node), isRoot));
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
@@ -58,7 +58,7 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::makeConst(BNode::VarType &node, bool is
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void BNode<T, MAX_COUNT, SIZE, ADAPTER>::makeSeamConst(BNode::VarType &node, bool onFront) {
-    std::visit([&](auto &&nodePtr) {
+    visitNode([&](auto &&nodePtr) {
         if constexpr (is_unique_ptr_v<decltype(nodePtr)>) {
             nodePtr->makeSeamConst(onFront);
         }
@@ -83,11 +83,11 @@ BNode<T, MAX_COUNT, SIZE, ADAPTER>::BNode(const BNode &otherNode) : childrenCoun
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 int8_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::height(const BNode::VarType &node) {
-    return std::visit([&](const auto &nodePtr) ->int8_t {
-        if (!nodePtr) {
-            return 0;
-        }
-        return nodePtr->height();
+    if (!node) {
+        return 0;
+    }
+    return visitConstNode([](const auto &child) -> int8_t {
+        return child.height();
     }, node);
 }
 
@@ -113,10 +113,32 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::makeConst(bool isRoot) {
             cumSize_[i] += rollingDelta;
         }
     }
+    annotationDepth_ = 0;
+    for (int i = 0; i < childrenCount_; i++) {
+        annotationDepth_ = std::max(annotationDepth_, annotationDepth(children_[i]));
+    }
+    if constexpr (ADAPTER<T, SIZE>::CACHES_SUMMARY) {
+        summary_.set(summarize());
+    }
+    if constexpr (ADAPTER<T, SIZE>::HASHES_CONTENT) {
+        hash_.set(contentHash());
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+int8_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::annotationDepth(const BNode::VarType &node) {
+    if (!node) {
+        return 0;
+    }
+    return visitConstNode([](const auto &child) -> int8_t {
+        return child.annotationDepth();
+    }, node);
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void BNode<T, MAX_COUNT, SIZE, ADAPTER>::updateCap(size_t startPos) {
+    summary_.reset();
+    hash_.reset();
     auto prevSize = startPos == 0 ? 0 : cumSize_[startPos - 1];
     for (size_t i = startPos; i < childrenCount_; i++) {
         prevSize = cumSize_[i] = sizeOf(children_[i]) + prevSize;
@@ -151,6 +173,8 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::moveNodes(BNode &srcNode, size_t srcPos
         cumSrcSize = srcNode.cumSize_[srcPos + i] = cumSrcSize + sizeOf(srcNode.children_[srcPos + i]);
     }
     srcNode.childrenCount_ -= count;
+    srcNode.summary_.reset();
+    srcNode.hash_.reset();
     childrenCount_ = newCount;
     updateCap(destPos);
 }
@@ -170,6 +194,8 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::addNodes(const BNode &srcNode, size_t s
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::removeNode(bool fromFront) -> BNode::VarType {
     assert(childrenCount_);
+    summary_.reset();
+    hash_.reset();
     VarType removedNode = std::move(children_[fromFront ? 0 : childrenCount_ - 1]);
     childrenCount_--;
     if (fromFront) {
@@ -186,7 +212,7 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 template<class NODE_T>
 void BNode<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, bool asPrefix) {
 
-    if constexpr (is_shared_ptr_v<NODE_T>) {
+    if constexpr (is_const_ptr_v<NODE_T>) {
         if (!incomingNode->isBalanced()) {
             assert(incomingNode->isBalanced());
         }
@@ -218,12 +244,14 @@ auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::nodeAt(size_t nodePos) const -> const B
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::nodeAt(size_t nodePos) -> VarType & {
     assert(nodePos < childrenCount_);
+    summary_.reset();
+    hash_.reset();
     return children_[nodePos];
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::fillLeaf(const BNode::VarType &child, T *destLeaf, size_t offset, size_t length) {
-    return std::visit([&](const auto &nodePtr) {
+    return visitNode([&](const auto &nodePtr) {
         return nodePtr->fillLeaf(destLeaf, offset, length);
     }, child);
 }
@@ -251,7 +279,7 @@ size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::fillLeaf(T *destLeaf, size_t offset,
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t
 BNode<T, MAX_COUNT, SIZE, ADAPTER>::setValues(const BNode::VarType &child, const T *srcLeaf, size_t offset, size_t length) {
-    return std::visit([&](const auto &nodePtr) -> size_t {
+    return visitNode([&](const auto &nodePtr) -> size_t {
         std::remove_cvref_t<decltype(nodePtr)> x;
         if constexpr (is_unique_ptr_v<decltype(nodePtr)>) {
             return nodePtr->setValues(srcLeaf, offset, length);
@@ -265,6 +293,8 @@ size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::setValues(const T *srcLeaf, size_t of
     if (offset >= size()) {
         return 0;
     }
+    summary_.reset();
+    hash_.reset();
     length = std::min(length, size() - offset);
     auto totalLen = length;
     for (size_t childPos = lowerBoundPos(offset + 1);
@@ -281,7 +311,7 @@ size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::setValues(const T *srcLeaf, size_t of
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
-const T &BNode<T, MAX_COUNT, SIZE, ADAPTER>::operator[](size_t index) const {
+const T BNode<T, MAX_COUNT, SIZE, ADAPTER>::operator[](size_t index) const {
     assert(index < size());
     auto childPos = lowerBoundPos(index + 1);
     if (childPos) {
@@ -291,6 +321,30 @@ const T &BNode<T, MAX_COUNT, SIZE, ADAPTER>::operator[](size_t index) const {
     }
 }
 
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+Summary<T> BNode<T, MAX_COUNT, SIZE, ADAPTER>::summarize(size_t offset, size_t length) const {
+    Summary<T> result;
+    if (offset >= size() || !length) {
+        return result;
+    }
+    forEachChild([&](const auto &childPtr, size_t childOffset, size_t childLen) {
+        result += summaryOf(childPtr, childOffset, childLen);
+    }, offset, length, false);
+    return result;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+ContentHash BNode<T, MAX_COUNT, SIZE, ADAPTER>::contentHash(size_t offset, size_t length) const {
+    ContentHash result;
+    if (offset >= size() || !length) {
+        return result;
+    }
+    forEachChild([&](const auto &childPtr, size_t childOffset, size_t childLen) {
+        result += hashOf(childPtr, childOffset, childLen);
+    }, offset, length, false);
+    return result;
+}
+
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::createNodePtr(const BNode &src) -> BNode::BNodePtr {
     static auto &alloc = StdFixedAllocator<BNode>::oneAndOnly();
@@ -309,7 +363,7 @@ auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::createNodePtr(BNode &&src) -> BNode::BN
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::sizeOf(const BNode::VarType &node) {
-    return std::visit([](const auto &nodePtr) -> size_t {
+    return visitNode([](const auto &nodePtr) -> size_t {
         if (!nodePtr) {
             return 0;
         }
@@ -319,7 +373,7 @@ size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::sizeOf(const BNode::VarType &node) {
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::childrenCount(const BNode::VarType &node) {
-    return std::visit([](const auto &nodePtr) -> size_t {
+    return visitNode([](const auto &nodePtr) -> size_t {
         if constexpr (std::is_same_v<std::remove_const_t<decltype(*nodePtr)>,Leaf>) {
             return 0;
         }
@@ -337,7 +391,7 @@ size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::isConst(const BNode::VarType &node) {
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 bool BNode<T, MAX_COUNT, SIZE, ADAPTER>::isBalanced(const BNode::VarType &node) {
-    return std::visit([](const auto &nodePtr) {
+    return visitNode([](const auto &nodePtr) {
         if (!nodePtr) {
             return false;
         }
@@ -347,14 +401,14 @@ bool BNode<T, MAX_COUNT, SIZE, ADAPTER>::isBalanced(const BNode::VarType &node)
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 bool BNode<T, MAX_COUNT, SIZE, ADAPTER>::isOneSideBalanced(const VarType &node, bool isRoot, bool onFront) {
-    return isConst(node) || std::visit([&](const auto &nodePtr) {
+    return isConst(node) || visitNode([&](const auto &nodePtr) {
         return nodePtr->isOneSideBalanced(isRoot, onFront);
     }, node);
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 int8_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::heightOf(const BNode::VarType &node) {
-    return std::visit([](const auto &nodePtr) -> int8_t {
+    return visitNode([](const auto &nodePtr) -> int8_t {
         if (!nodePtr) {
             return 0;
         }
@@ -364,7 +418,14 @@ int8_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::heightOf(const BNode::VarType &node)
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 template<class NODE_T>
-void BNode<T, MAX_COUNT, SIZE, ADAPTER>::openInternal(BNode::VarType &dest, const std::shared_ptr<const NODE_T> &nodePtr) {
+void BNode<T, MAX_COUNT, SIZE, ADAPTER>::openInternal(BNode::VarType &dest, ConstPtr<NODE_T> &&nodePtr) {
+    if (nodePtr.isExclusive()) {
+        //only reachable through dest, so it gets mutated in place rather than copied
+        auto thawed = nodePtr.takeExclusive();
+        thawed->thaw();
+        dest = std::move(thawed);
+        return;
+    }
     static auto &alloc = StdFixedAllocator<NODE_T>::oneAndOnly();
     auto pointer = alloc.allocate(1);
     alloc.construct(pointer, *nodePtr);
@@ -373,8 +434,8 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::openInternal(BNode::VarType &dest, cons
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto BNode<T, MAX_COUNT, SIZE, ADAPTER>::open(BNode::VarType &node) -> VarType & {
-    std::visit([&](const auto &nodePtr) {
-        openInternal(node, nodePtr);
+    visitNode([&](auto &nodePtr) {
+        openInternal(node, std::move(nodePtr));
     }, node);
     return node;
 }
@@ -413,33 +474,61 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::makeSeamConst(bool onFront) {
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 template<class Visitor>
 void BNode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChild(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const {
-    length = std::min(length, size() - offset);
-    auto visitorInternal = [&](const auto &child, size_t childOffset, size_t childLen) {
-        std::visit([&](const auto &ptr) {
+    forEachChildSlot([&](const VarType &child, size_t childOffset, size_t childLen) {
+        visitNode([&](const auto &ptr) {
             visitor(ptr, childOffset, childLen);
         }, child);
-    };
+    }, offset, length, asPrefix);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class Visitor>
+void
+BNode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChildNode(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const {
+    forEachChildSlot([&](const VarType &child, size_t childOffset, size_t childLen) {
+        visitConstNode([&](const auto &node) {
+            visitor(node, childOffset, childLen);
+        }, child);
+    }, offset, length, asPrefix);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class Visitor>
+decltype(auto) BNode<T, MAX_COUNT, SIZE, ADAPTER>::visitChildAt(Visitor &&visitor, size_t offset) const {
+    size_t pos = cumUpperBound(cumSize_.data(), childrenCount_, offset);
+    assert(pos < childrenCount_);
+    return visitConstNode([&](const auto &node) -> decltype(auto) {
+        return visitor(node, size_t(0), pos ? cumSize_[pos - 1] : 0, sizeAt(pos));
+    }, children_[pos]);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class Visitor>
+void
+BNode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChildSlot(Visitor &&visitor, size_t offset, size_t length, bool asPrefix) const {
+    length = std::min(length, size() - offset);
     size_t firstNodePos, lastNodePos;
     std::tie(firstNodePos, lastNodePos) = nodeRangeInclusive(offset, length);
     size_t currentOffset = offset - (firstNodePos?cumSize_[firstNodePos - 1]:0);
     if (asPrefix) {
         if (firstNodePos != lastNodePos) {
-            visitorInternal(children_[lastNodePos], 0, length + offset - cumSize_[lastNodePos - 1]);
+            visitor(children_[lastNodePos], 0, length + offset - cumSize_[lastNodePos - 1]);
             length = cumSize_[lastNodePos - 1] - offset;
             for (auto i = lastNodePos - 1; i > firstNodePos; i--) {
-                visitorInternal(children_[i], 0, sizeAt(i));
+                visitor(children_[i], 0, sizeAt(i));
                 length -= sizeAt(i);
             }
         }
-        visitorInternal(children_[firstNodePos], currentOffset, length);
+        visitor(children_[firstNodePos], currentOffset, length);
     } else {
         for (auto i = firstNodePos; i < lastNodePos; i++) {
+            prefetchChildren<CHILD_PREFETCH_DISTANCE>(children_, i, lastNodePos);
             size_t len = sizeAt(i) - currentOffset;
-            visitorInternal(children_[i], currentOffset, len);
+            visitor(children_[i], currentOffset, len);
             currentOffset = 0;
             length -= len;
         }
-        visitorInternal(children_[lastNodePos], currentOffset, std::min(sizeAt(lastNodePos) - currentOffset, length));
+        visitor(children_[lastNodePos], currentOffset, std::min(sizeAt(lastNodePos) - currentOffset, length));
     }
 }
 
@@ -476,15 +565,14 @@ void BNode<T, MAX_COUNT, SIZE, ADAPTER>::forEachChildMove(Visitor &&visitor, siz
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 std::tuple<size_t, size_t>
 BNode<T, MAX_COUNT, SIZE, ADAPTER>::nodeRangeInclusive(size_t offset, size_t length) const {
-    size_t firstNodePos =
-            std::upper_bound(cumSize_.begin(), cumSize_.begin() + childrenCount_, offset) - cumSize_.begin();
+    size_t firstNodePos = cumUpperBound(cumSize_.data(), childrenCount_, offset);
     size_t lastNodePos = lowerBoundPos(offset + length);
     return {firstNodePos, lastNodePos};
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t BNode<T, MAX_COUNT, SIZE, ADAPTER>::lowerBoundPos(size_t offset) const {
-    return std::lower_bound(cumSize_.begin(), cumSize_.begin() + childrenCount_, offset) - cumSize_.begin();
+    return cumLowerBound(cumSize_.data(), childrenCount_, offset);
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
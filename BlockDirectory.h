@@ -0,0 +1,141 @@
+#ifndef EXPERIMENTS_BLOCKDIRECTORY_H
+#define EXPERIMENTS_BLOCKDIRECTORY_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/**
+ * Maps the address ranges handed out by a SpaceProvider to what got registered at them, for any number of concurrent
+ * readers and writers. Addresses are dense multiples of BLOCK_SIZE (the provider recycles released ones), so the
+ * directory is a two level table of pages of BLOCK_SIZE wide slots rather than an ordered map: a mapping spanning
+ * several blocks is pointed at by each of their slots, and finding the mapping of an address takes two loads.
+ *
+ * Readers take no lock. Writers never wait on one another either, they claim the slots of their range with a compare
+ * and swap each and only meet on the creation of a page, so threads registering different ranges (the only thing
+ * that can happen, the provider never hands out a live address twice) go through in parallel.
+ *
+ * erase frees the mapping right away, which is safe as long as nobody reads the range any longer. That is the case
+ * for a DataFrameSpace, which only erases an address once the last index referencing it is gone.
+ */
+template<class VALUE, size_t BLOCK_SIZE, size_t PAGE_BLOCKS = (1 << 14), size_t PAGE_COUNT = (1 << 14)>
+class BlockDirectory {
+public:
+    struct Mapping {
+        size_t address;
+        size_t size;
+        VALUE value;
+    };
+
+private:
+    using Page = std::array<std::atomic<const Mapping *>, PAGE_BLOCKS>;
+
+    std::array<std::atomic<Page *>, PAGE_COUNT> pages_{};
+
+    static size_t blocksOf(size_t size) { return std::max(size_t(1), (size + BLOCK_SIZE - 1) / BLOCK_SIZE); }
+
+    /**
+     * The slot of the block at address, or nullptr when it lies in a page never written to (create = false)
+     */
+    std::atomic<const Mapping *> *slotFor(size_t address, bool create) {
+        size_t block = address / BLOCK_SIZE;
+        if (block / PAGE_BLOCKS >= PAGE_COUNT) {
+            throw std::logic_error("Address beyond the block directory");
+        }
+        auto &pagePtr = pages_[block / PAGE_BLOCKS];
+        Page *page = pagePtr.load(std::memory_order_acquire);
+        if (!page && create) {
+            auto *newPage = new Page();
+            if (pagePtr.compare_exchange_strong(page, newPage, std::memory_order_acq_rel)) {
+                page = newPage;
+            } else {
+                delete newPage;
+            }
+        }
+        return page ? &(*page)[block % PAGE_BLOCKS] : nullptr;
+    }
+
+public:
+    BlockDirectory() = default;
+
+    BlockDirectory(const BlockDirectory &) = delete;
+
+    BlockDirectory &operator=(const BlockDirectory &) = delete;
+
+    ~BlockDirectory() {
+        //the slot of its first block owns a mapping, collected before any gets deleted
+        std::vector<const Mapping *> mappings;
+        for (size_t pageNo = 0; pageNo < PAGE_COUNT; pageNo++) {
+            Page *page = pages_[pageNo].load(std::memory_order_relaxed);
+            for (size_t slot = 0; page && slot < PAGE_BLOCKS; slot++) {
+                const Mapping *mapping = (*page)[slot].load(std::memory_order_relaxed);
+                if (mapping && mapping->address / BLOCK_SIZE == pageNo * PAGE_BLOCKS + slot) {
+                    mappings.push_back(mapping);
+                }
+            }
+        }
+        for (const Mapping *mapping: mappings) {
+            delete mapping;
+        }
+        for (auto &pagePtr: pages_) {
+            delete pagePtr.load(std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Publishes value for [address, address + size), address being the start of a block
+     * @throws std::logic_error when part of the range is registered already, in which case nothing is
+     */
+    void insert(size_t address, size_t size, VALUE value) {
+        size_t blocks = blocksOf(size);
+        if ((address / BLOCK_SIZE + blocks - 1) / PAGE_BLOCKS >= PAGE_COUNT) {
+            throw std::logic_error("Address beyond the block directory");
+        }
+        auto *mapping = new Mapping{address, size, std::move(value)};
+        for (size_t block = 0; block < blocks; block++) {
+            const Mapping *expected = nullptr;
+            if (!slotFor(address + block * BLOCK_SIZE, true)->compare_exchange_strong(expected, mapping,
+                                                                                      std::memory_order_release,
+                                                                                      std::memory_order_relaxed)) {
+                while (block-- > 0) {
+                    slotFor(address + block * BLOCK_SIZE, false)->store(nullptr, std::memory_order_relaxed);
+                }
+                delete mapping;
+                throw std::logic_error("Address registered already");
+            }
+        }
+    }
+
+    /**
+     * @return the mapping holding address, nullptr if there is none
+     */
+    const Mapping *find(size_t address) const {
+        size_t block = address / BLOCK_SIZE;
+        if (block / PAGE_BLOCKS >= PAGE_COUNT) {
+            return nullptr;
+        }
+        const Page *page = pages_[block / PAGE_BLOCKS].load(std::memory_order_acquire);
+        return page ? (*page)[block % PAGE_BLOCKS].load(std::memory_order_acquire) : nullptr;
+    }
+
+    /**
+     * Drops the mapping starting at address, if any. The range must not be read any longer.
+     */
+    void erase(size_t address) {
+        auto *slot = slotFor(address, false);
+        const Mapping *mapping = slot ? slot->load(std::memory_order_acquire) : nullptr;
+        if (!mapping || mapping->address != address) {
+            return;
+        }
+        for (size_t block = 0; block < blocksOf(mapping->size); block++) {
+            slotFor(address + block * BLOCK_SIZE, false)->store(nullptr, std::memory_order_release);
+        }
+        delete mapping;
+    }
+};
+
+#endif //EXPERIMENTS_BLOCKDIRECTORY_H
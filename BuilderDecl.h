@@ -6,6 +6,39 @@
 #include "Leaf.h"
 #include "BuilderFwd.h"
 #include <limits>
+#include <vector>
+
+/**
+ * When close() rewrites annotations into plain BNodes: trees with more than maxAnnotationDepth nested ANodes on a root
+ * to leaf path, and annotations keeping alive an origin over maxOriginRatio times their own size. Zero turns the
+ * respective check off, the default for both: flattening trades a rebuild of the affected paths (and the merge of the
+ * leaf slices it creates, see FlatteningReport) for shallower reads, which only pays for trees that get read a lot more
+ * than they get edited.
+ */
+struct FlatteningPolicy {
+    int8_t maxAnnotationDepth = 0;
+    size_t maxOriginRatio = 0;
+};
+
+/**
+ * What flattening did: annotations dissolved, const subtrees kept as they were, and leaves re-sliced (const copies
+ * sharing the arrays, the values only get copied if the rebuild opens them: balancing merges one into a neighbour, or
+ * the first piece gets a root grown over it)
+ */
+struct FlatteningReport {
+    size_t annotationsFlattened = 0;
+    size_t subtreesShared = 0;
+    size_t leavesSliced = 0;
+    size_t valuesSliced = 0;
+
+    FlatteningReport &operator+=(const FlatteningReport &other) {
+        annotationsFlattened += other.annotationsFlattened;
+        subtreesShared += other.subtreesShared;
+        leavesSliced += other.leavesSliced;
+        valuesSliced += other.valuesSliced;
+        return *this;
+    }
+};
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 class Builder {
@@ -24,11 +57,11 @@ public:
     using BNodeDeleter = DeleterForFixedAllocator<BNodeT>;
 
     using LeafPtr = std::unique_ptr<LeafT, LeafDeleter>;
-    using LeafCPtr = std::shared_ptr<const LeafT>;
+    using LeafCPtr = ConstPtr<LeafT>;
     using BNodePtr = std::unique_ptr<BNodeT, BNodeDeleter>;
     using ANodePtr = std::unique_ptr<ANodeT, ANodeDeleter>;
-    using ANodeCPtr = std::shared_ptr<const ANodeT>;
-    using BNodeCPtr = std::shared_ptr<const BNodeT>;
+    using ANodeCPtr = ConstPtr<ANodeT>;
+    using BNodeCPtr = ConstPtr<BNodeT>;
     using VarType = typename BNodeT::VarType;
 private:
     using ANodeVarType = typename ANodeT::VarType;
@@ -36,11 +69,23 @@ private:
     int8_t maxMutationLevel_ = std::numeric_limits<int8_t>::max();
     VarType root_;
     void *context_ = nullptr;
+    FlatteningPolicy flatteningPolicy_;
+    FlatteningReport flatteningReport_;
+
+    static constexpr size_t MULTI_GET_BATCH = 64;
 
     static constexpr size_t maxHeight() {
         return (64 - log(SIZE / 2)) / log(MAX_COUNT / 2) + (((64 - log(SIZE / 2)) % log(MAX_COUNT / 2)) ? 1 : 0);
     }
 
+    /**
+     * Open BNodes along the right spine, spine_[h] being the one of height h + 1, cached between appends so that the
+     * common one (a balanced node landing next to a balanced last child) touches only its parent. Any other mutation
+     * drops the cache and the next append walks the spine down from the root again.
+     */
+    std::array<BNodeT *, maxHeight()> spine_{};
+    bool spineValid_ = false;
+
     class MutationLevelKeeper {
         Builder &builder_;
         int8_t restoreLevel_;
@@ -74,6 +119,10 @@ public:
 
     void setContext(void *context) { context_ = context; }
 
+    void setFlatteningPolicy(const FlatteningPolicy &policy) { flatteningPolicy_ = policy; }
+
+    const FlatteningReport &flatteningReport() const { return flatteningReport_; }
+
 private:
 
     auto getPeer(const Side side, std::array<BNodeT *, maxHeight()> parents, int8_t targetHeight) -> VarType *;
@@ -90,11 +139,28 @@ private:
     template<class NODE_T>
     bool addToExisting(const bool asPrefix, NODE_T &&incomingNode, size_t offset, size_t length);
 
-    auto getANodeConst(const VarType &node) -> const ANodeT *;
+    void cacheSpine();
 
-    auto getBNodeConst(const VarType &node) -> const BNodeT *;
+    /**
+     * Appends the whole incoming node straight to its parent on the cached right spine, when that needs neither a
+     * new node nor any balancing: the parent has room, and both the incoming node and the current last child are
+     * balanced. Leaves incomingNode untouched and returns false otherwise.
+     */
+    template<class NODE_T>
+    bool appendToSpine(NODE_T &&incomingNode);
 
-    auto getLeafConst(const VarType &node) -> const LeafT &;
+    /**
+     * Makes const the children of parent that fell behind the right spine, so the size updates of later appends stop
+     * walking them. The child before the last is the one balancing borrows from, so BNodes get frozen once they are
+     * second to last, leaves one append later (topping up a short last leaf then doesn't copy its peer).
+     */
+    void freezeBehindSpine(BNodeT &parent);
+
+    static auto getANodeConst(const VarType &node) -> const ANodeT *;
+
+    static auto getBNodeConst(const VarType &node) -> const BNodeT *;
+
+    static auto getLeafConst(const VarType &node) -> const LeafT &;
 
     bool pruneSingleChildRoots(std::array<BNodeT *, maxHeight()> &parents);
 
@@ -111,8 +177,7 @@ private:
 
     template<class NODE>
     void balanceAgainstANode(Builder::Side &side, std::array<BNodeT *, maxHeight()> &parents,
-                             const std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>> &currentNode,
-                             VarType *peer);
+                             NODE *currentNode, VarType *peer);
 //Contract: parents[height] - the parent of the node of height, i.e. parent[child.height] is parent of child
     /**
      *
@@ -123,7 +188,7 @@ private:
      */
     bool balanceLeaf(Side side, std::array<BNodeT *, maxHeight()> &parents);
 
-    bool balanceBNode(Builder::Side side, std::array<BNodeT *, maxHeight()> &parents, BNodePtr &currentNode);
+    bool balanceBNode(Builder::Side side, std::array<BNodeT *, maxHeight()> &parents, BNodeT *currentNode);
 
     /**
      *
@@ -156,20 +221,84 @@ private:
                      bool asPrefix = false);
 
     template<class NODE_T>
-    void addChildren(std::shared_ptr<const NODE_T> &&incomingNode, size_t offset = 0,
+    void addChildren(ConstPtr<NODE_T> &&incomingNode, size_t offset = 0,
                      size_t length = std::numeric_limits<size_t>::max(),
                      bool asPrefix = false);
 
     template<class NODE_T>
-    void addChildren(const std::shared_ptr<const NODE_T> &incomingNode, size_t offset = 0,
+    void addChildren(const ConstPtr<NODE_T> &incomingNode, size_t offset = 0,
                      size_t length = std::numeric_limits<size_t>::max(),
                      bool asPrefix = false);
 
 
+    bool needsFlattening(const auto &node) const;
+
+    /**
+     * Replaces a root breaking the flattening policy with a fresh tree over the same leaves
+     */
+    void flattenAnnotations();
+
+    void addFlattened(Builder &target, const auto &nodePtr, size_t offset, size_t length);
+
     template<class NODE_T>
     static auto annotateNode(NODE_T &&incomingNode, size_t offset = 0,
                              size_t length = std::numeric_limits<size_t>::max()) -> VarType;
 
+    /**
+     * [begin, pos) and [pos, end) of the const node. Descends along the path to pos only, the children on either side
+     * of the path get grouped into a node per level (see groupChildren) which is concatenated with what the levels
+     * below left on that side: the heights concatenated grow with the level, so the concats add up to O(MAX_COUNT * log(n)).
+     */
+    static auto splitNode(const auto &node, size_t begin, size_t end, size_t pos, void *context)
+    -> std::pair<VarType, VarType>;
+
+    /**
+     * [from, to) of the children of the const node as a single const tree: a node of the same height over them when
+     * they are all whole and balanced, the only case for a BNode, a builder over the pieces otherwise (annotations)
+     */
+    static auto groupChildren(const auto &node, size_t from, size_t to, void *context) -> VarType;
+
+    /**
+     * [offset, offset + length) of the const leaf as a const leaf sharing its array, nothing when length is 0
+     */
+    static auto sliceLeaf(const LeafT &leaf, size_t offset, size_t length) -> VarType;
+
+    /**
+     * The const nodes a and b, of the same height and in this order, as nodes of that height appended to out: a and b
+     * themselves when both are balanced, otherwise their children (values for leaves) spread evenly over one node or
+     * two balanced ones. Returns false, leaving out untouched, when that would need to reopen an annotation.
+     */
+    static bool mergeSeam(const VarType &a, const VarType &b, void *context, std::vector<VarType> &out);
+
+    /**
+     * The const BNode node with the const, shorter, incoming tree put on its back (front when onFront), appended to out
+     * as nodes of the height of node: the children along the spine get copied down to the level of the root of
+     * incoming, which lands next to the edge child there (or gets merged with it, see mergeSeam), and every copy gets
+     * its children spread over two nodes when it overflows. Returns false, leaving out untouched, when the spine
+     * runs through an annotation.
+     */
+    static bool graft(const VarType &node, const VarType &incoming, bool onFront, void *context,
+                      std::vector<VarType> &out);
+
+    /**
+     * The const trees, in order, appended whole to a single builder: the fallback of concat for seams running through
+     * annotations, which rebuilds the seams too but descends from the root for every subtree it balances
+     */
+    static auto appendAll(std::initializer_list<const VarType *> parts, void *context) -> VarType;
+
+    /**
+     * Groups the const nodes of a level, in order, into as few const BNodes of height as fit them, spreading the
+     * children evenly so every node but a lone root holds at least MAX_COUNT / 2
+     */
+    static auto packLevel(std::vector<VarType> &&level, int8_t height) -> std::vector<VarType>;
+
+    static auto packLevels(std::vector<VarType> &&leaves) -> VarType;
+
+    /**
+     * The const trees, in order, concatenated one after the other
+     */
+    static auto concatAll(std::initializer_list<const VarType *> parts, void *context) -> VarType;
+
 public:
     //Utilities
 
@@ -190,20 +319,165 @@ public:
 
     auto close(bool allowAnodeRoot = true) -> VarType;
 
+    /**
+     * Cuts the const tree root into [0, pos) and [pos, size). The subtrees hanging off either side of the path to pos
+     * are reused whole, only the leaf holding pos gets sliced (sharing its array), and each level adds a node of its
+     * siblings and a concat to either half (see splitNode), so the cost is O(MAX_COUNT * log(n) + SIZE). Both halves come
+     * out balanced (see isDeepBalanced).
+     */
+    static auto split(const VarType &root, size_t pos, void *context = nullptr) -> std::pair<VarType, VarType>;
+
+    /**
+     * left followed by right, both const and kept whole: the shorter one gets grafted onto the spine of the taller one
+     * at the level of its root (see graft), so only the nodes along that spine get copied, in
+     * O(MAX_COUNT * (|height(left) - height(right)| + 1) + SIZE). Spines running through annotations fall back to
+     * appending both to a builder.
+     */
+    static auto concat(const VarType &left, const VarType &right, void *context = nullptr) -> VarType;
+
+    /**
+     * The const tree root without [offset, offset + length): one split on each side of the range and a concat of the
+     * remaining halves, so everything but the two seams is shared with root. length is clipped to the end of root.
+     * Two splits and a concat: O(MAX_COUNT * log(n) + SIZE).
+     */
+    static auto erase(const VarType &root, size_t offset, size_t length, void *context = nullptr) -> VarType;
+
+    /**
+     * The const tree root with [srcOffset, srcOffset + length) cut out and put back at dstOffset, dstOffset being the
+     * position of the moved range in the result (i.e. in root without the range). Three splits cut root into the
+     * four pieces around the range and its destination, which get concatenated in their new order, so it's three splits
+     * and three concats: O(MAX_COUNT * log(n) + SIZE), about three times an erase.
+     */
+    static auto moveRange(const VarType &root, size_t srcOffset, size_t length, size_t dstOffset,
+                          void *context = nullptr) -> VarType;
+
+    /**
+     * Builds a const tree over the leaves, in order, bottom-up in a single pass: each level is packed into the next
+     * one without any descent or rebalancing. Every leaf but a lone one must be balanced (SIZE / 2 values or more).
+     */
+    static auto bulkLoad(std::vector<LeafPtr> &&leaves) -> VarType;
+
+    /**
+     * Copies values[0, count) into evenly filled leaves and bulk loads them
+     */
+    static auto bulkLoad(const T *values, size_t count, void *context = nullptr) -> VarType;
+
+    /**
+     * bulkLoad spread over up to threadCount threads of the WorkerPool (the calling one included): every thread loads
+     * one run of whole leaves into a subtree, using the allocation context contextFor(partition) returns, then the
+     * subtrees are concatenated pairwise in log2(threadCount) rounds. The subtrees are about as tall as one another, so
+     * each concat only rebuilds the nodes along its seam (see concat). contextFor is called on the calling thread, once
+     * per partition; IndexAdapter sessions are not thread safe, each partition needs one of its own.
+     */
+    template<class ContextFactory>
+    static auto parallelBulkLoad(const T *values, size_t count, size_t threadCount, ContextFactory &&contextFor)
+    -> VarType;
+
+    static auto parallelBulkLoad(const T *values, size_t count, size_t threadCount) -> VarType {
+        return parallelBulkLoad(values, count, threadCount, [](size_t) -> void * { return nullptr; });
+    }
+
+    class SourceCursor;
+
+    /**
+     * Appends the ranges (offset, length) of the const tree source, sorted by offset and not overlapping, in a single
+     * walk of source (see SourceCursor) instead of a descent from its root per range
+     */
+    void addRanges(const VarType &source, const std::vector<std::pair<size_t, size_t>> &sortedRanges);
+
     size_t size() const { return BNodeT::sizeOf(root_); };
 
     int8_t height() const { return BNodeT::height(root_); };
 
 
-    const T &operator[](size_t index) {
-        return std::visit([index](const auto &ptr) -> const T & {
-            return (*ptr)[index];
+    const T operator[](size_t index) {
+        return visitConstNode([index](const auto &node) -> const T {
+            return node[index];
         }, root_);
     }
 
+    /**
+     * out[i] = value at positions[i], for count positions in any order. The lookups descend together a level at a time,
+     * in batches of MULTI_GET_BATCH, prefetching the lines every node of the next level gets searched on (prefetchSearch)
+     * before it is read so the cache misses of a batch overlap instead of stalling one lookup at a time. Positions are taken in the given order: sorted input
+     * gets its shared paths cached for free, sorting random input costs more than it saves
+     */
+    static void multiGet(const VarType &node, const size_t *positions, size_t count, T *out);
+
+    void multiGet(const size_t *positions, size_t count, T *out) const { multiGet(root_, positions, count, out); }
+
+    /**
+     * Visits (leaf, offset, length) for every leaf piece of [offset, offset + len) in node. Read only: the walk goes
+     * through const references (visitConstNode / forEachChildNode), mutable and const children share one instantiation
+     */
     static void forEachLeaf(auto &&visitor, const auto &node, size_t offset, size_t len);
     static void forEachLeafPtr(auto &&visitor, const auto &node, size_t offset, size_t len);
+    static void forEachLeafOf(auto &&visitor, const auto &node, size_t offset, size_t len);
+
+    /**
+     * Sum/min/max/count over [offset, offset + len) of node. Const subtrees fully inside the range answer from the
+     * summary cached at makeConst, so only the edges get reduced leaf by leaf (on raw spans) in O(log n * MAX_COUNT)
+     */
+    static auto summarize(const auto &node, size_t offset = 0, size_t len = std::numeric_limits<size_t>::max())
+    -> Summary<T>;
+
+    /**
+     * Hash of the values in [offset, offset + len) of node (see ContentHash), answered from the hashes cached at
+     * makeConst for the const subtrees fully inside the range like summarize. Equal ranges of two trees hash the same
+     * whatever their shapes, so it serves as a cache key for results derived from the range.
+     */
+    static auto contentHash(const auto &node, size_t offset = 0, size_t len = std::numeric_limits<size_t>::max())
+    -> ContentHash;
+
+};
+
+/**
+ * Appends ranges of a const source tree to builders, in increasing position order. The path down to the end of the
+ * last range is kept, so the next range only climbs up to the lowest node covering its start, and nodes a range covers
+ * whole get added as they are: over a sorted batch every source node is entered at most once and the work follows the
+ * nodes added, not the number of ranges times the height. Holds a reference to the source, which must be const.
+ */
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+class Builder<T, MAX_COUNT, SIZE, ADAPTER>::SourceCursor {
+    /**
+     * Internal node of the path covering [begin, end) of the source, tree position p is position
+     * localBegin + p - begin of the node
+     */
+    struct Frame {
+        const void *node;
+        bool isANode;
+        size_t begin;
+        size_t end;
+        size_t localBegin;
+    };
+
+    VarType source_;
+    std::vector<Frame> path_;
+    size_t position_ = 0;
+
+    template<class Visitor>
+    static void visitFrame(const Frame &frame, Visitor &&visitor) {
+        if (frame.isANode) {
+            visitor(*static_cast<const ANodeT *>(frame.node));
+        } else {
+            visitor(*static_cast<const BNodeT *>(frame.node));
+        }
+    }
+
+public:
+    explicit SourceCursor(const VarType &source);
 
+    const VarType &source() const { return source_; }
+
+    /**
+     * End of the last range appended, the next one cannot start before it
+     */
+    size_t position() const { return position_; }
+
+    /**
+     * Appends [offset, offset + length) of the source to target, clipped to the source size
+     */
+    void append(Builder &target, size_t offset, size_t length);
 };
 
 #endif //EXPERIMENTS_BUILDERDECL_H
@@ -2,6 +2,9 @@
 #define EXPERIMENTS_BUILDERIMPL_H
 
 #include "BuilderDecl.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <exception>
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::getPeer(const Builder::Side side,
@@ -9,7 +12,7 @@ auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::getPeer(const Builder::Side side,
                                                    int8_t targetHeight) -> Builder::VarType * {
     VarType *peer = nullptr;
     auto rootHeight = BNodeT::heightOf(root_);
-    BNodeT *pRoot = std::get<BNodePtr>(root_).get();//Because it must be open and BNodeT if we are digging below it
+    BNodeT *pRoot = getNode<BNodePtr>(root_);//Because it must be open and BNodeT if we are digging below it
     //If it encounters an ANodeT then just return it
     //common path is formed of BNodes
     for (int height = rootHeight; height > targetHeight; height--) {
@@ -18,12 +21,12 @@ auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::getPeer(const Builder::Side side,
             peer = &pRoot->childAt(side == Front ? 1 : (pRoot->childrenCount() - 2));
         } else if (peer && BNodeT::isBNode(*peer)) {
             BNodeT::open(*peer);
-            auto &bNodePeer = std::get<BNodePtr>(*peer);
+            BNodeT *bNodePeer = getNode<BNodePtr>(*peer);
             peer = &(bNodePeer->childAt(side == Front ? 0 : (bNodePeer->childrenCount() - 1)));
         }
         auto &rootCandidate = pRoot->childAt(side == Front ? 0 : (pRoot->childrenCount() - 1));
         if (BNodeT::isBNode(rootCandidate)) {
-            pRoot = std::get<BNodePtr>(rootCandidate).get();
+            pRoot = getNode<BNodePtr>(rootCandidate);
         } else {
             //if pRoot is not a BNodeT it means we reached the end
             assert(height == targetHeight + 1);
@@ -48,8 +51,8 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::addToExisting(const bool asPrefix, NO
     int currentHeight = rootHeight;
     parents[rootHeight] = nullptr;
     while (currentHeight > incomingNode->height() && rollingParent->index() == 2) {
-        BNodePtr &parentAsBNode = std::get<BNodePtr>(*rollingParent);
-        parents[currentHeight - 1] = parentAsBNode.get();
+        BNodeT *parentAsBNode = getNode<BNodePtr>(*rollingParent);
+        parents[currentHeight - 1] = parentAsBNode;
         rollingParent = &parentAsBNode->childAt(asPrefix ? 0 : parentAsBNode->childrenCount() - 1);
         currentHeight--;
         if (!BNodeT::isConst(*rollingParent)) {
@@ -66,7 +69,7 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::addToExisting(const bool asPrefix, NO
         return false;
     }
     if (BNodeT::isANode(*lastOpenParent)) {
-        ANodePtr &parentANode = std::get<ANodePtr>(*lastOpenParent);
+        ANodeT *parentANode = getNode<ANodePtr>(*lastOpenParent);
         if (parentANode->height() <= maxMutationLevel_ &&
             parentANode->canAcceptNode(incomingNode, asPrefix, offset, length)) {
             if (!isConst && !incomingNode->isDeepBalanced(true)) {
@@ -107,6 +110,7 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::addToExisting(const bool asPrefix, NO
         root_ = VarType(std::move(newNode));
     }
     assert(lastOpenParentPtr->childrenCount() < MAX_COUNT);
+    BNodeT *appendedTo = lastOpenParentPtr;
     while (lastOpenParentPtr->height() > incomingNode->height() + 1) {
         BNodePtr newNode = BNodeT::createNodePtr(BNodeT(lastOpenParentPtr->height() - 1));
         BNodeT *nextParent = newNode.get();
@@ -118,16 +122,71 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::addToExisting(const bool asPrefix, NO
     } else {
         lastOpenParentPtr->addNode(annotateNode(std::forward<NODE_T>(incomingNode), offset, length), asPrefix);
     }
+    if (!asPrefix) {
+        freezeBehindSpine(*appendedTo);
+    }
+    return true;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::cacheSpine() {
+    spine_.fill(nullptr);
+    VarType *node = &root_;
+    while (node->index() == 2) {
+        BNodeT *bNode = getNode<BNodePtr>(*node);
+        spine_[bNode->height() - 1] = bNode;
+        node = &bNode->childAt(bNode->childrenCount() - 1);
+    }
+    spineValid_ = true;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class NODE_T>
+bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::appendToSpine(NODE_T &&incomingNode) {
+    constexpr bool isConst = is_const_ptr_v<std::remove_cvref_t<NODE_T>>;
+    if (maxMutationLevel_ != std::numeric_limits<int8_t>::max() || root_.index() != 2) {
+        return false;
+    }
+    if (!spineValid_) {
+        cacheSpine();
+    }
+    int8_t height = incomingNode->height();
+    BNodeT *parent = height < heightOf(root_) ? spine_[height] : nullptr;
+    if (!parent || parent->childrenCount() == MAX_COUNT ||
+        !(isConst ? incomingNode->isBalanced() : incomingNode->isDeepBalanced()) ||
+        !BNodeT::isOneSideBalanced(parent->childAt(parent->childrenCount() - 1), false, false)) {
+        return false;
+    }
+    parent->addNode(std::forward<NODE_T>(incomingNode));
+    if (height > 0) {
+        //the spine below now runs through the incoming node
+        spineValid_ = false;
+    }
+    freezeBehindSpine(*parent);
     return true;
 }
 
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::freezeBehindSpine(BNodeT &parent) {
+    size_t lag = parent.height() > 1 ? 2 : 3;
+    if (parent.childrenCount() < lag) {
+        return;
+    }
+    VarType &child = parent.childAt(parent.childrenCount() - lag);
+    if (!BNodeT::isConst(child) && !BNodeT::isANode(child) && isDeepBalanced(child)) {
+        //const children are skipped when the cumulative sizes catch up, so they have to be current before
+        parent.size();
+        BNodeT::makeConst(child);
+    }
+}
+
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::getANodeConst(const Builder::VarType &node) -> const ANodeT * {
     switch (node.index()) {
         case 1:
-            return std::get<ANodePtr>(node).get();
+            return getNode<ANodePtr>(node);
         case 4:
-            return std::get<ANodeCPtr>(node).get();
+            return getNode<ANodeCPtr>(node);
         default:
             throw std::logic_error("Not an ANodeT");
     }
@@ -138,9 +197,9 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::getBNodeConst(const Builder::VarType &node) -> const BNodeT * {
     switch (node.index()) {
         case 2:
-            return std::get<BNodePtr>(node).get();
+            return getNode<BNodePtr>(node);
         case 5:
-            return std::get<BNodeCPtr>(node).get();
+            return getNode<BNodeCPtr>(node);
         default:
             throw std::logic_error("Not a BNodeT");
     }
@@ -150,9 +209,9 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::getLeafConst(const Builder::VarType &node) -> const LeafT & {
     switch (node.index()) {
         case 0:
-            return *std::get<LeafPtr>(node);
+            return *getNode<LeafPtr>(node);
         case 3:
-            return *std::get<LeafCPtr>(node);
+            return *getNode<LeafCPtr>(node);
         default:
             throw std::logic_error("Not LeafT");
     }
@@ -165,8 +224,8 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::updateParents(Builder::Side side, std
     VarType *currentNode = &root_;
     for (auto height = BNodeT::heightOf(root_) - 1; BNodeT::isBNode(*currentNode) && height >= minHeight; height--) {
         BNodeT::open(*currentNode);
-        BNodePtr &bNodeCurrent = std::get<BNodePtr>(*currentNode);
-        parents[height] = bNodeCurrent.get();
+        BNodeT *bNodeCurrent = getNode<BNodePtr>(*currentNode);
+        parents[height] = bNodeCurrent;
         currentNode = &bNodeCurrent->childAt(side == Front ? 0 : bNodeCurrent->childrenCount() - 1);
     }
 }
@@ -175,8 +234,7 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 template<class NODE>
 void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceAgainstANode(Builder::Side &side,
                                                                std::array<BNodeT *, maxHeight()> &parents,
-                                                               const std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>> &currentNode,
-                                                               VarType *peer) {
+                                                               NODE *currentNode, VarType *peer) {
     const ANodeT *aNodePeer = this->getANodeConst(*peer);
     if (aNodePeer->canAcceptNode(currentNode, side == Front)) {
         this->removeNodeAndAddToPeer<std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>>>(side, parents, *peer,
@@ -212,14 +270,14 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceLeaf(Builder::Side side, std::
     if (BNodeT::isBalanced(node) || BNodeT::isBalanced(node)) {
         return false;
     }
-    LeafPtr &currentNode = std::get<LeafPtr>(node);
+    LeafT *currentNode = getNode<LeafPtr>(node);
     auto peer = getPeer(side, parents, 0);
     if (BNodeT::isANode(*peer)) {
         balanceAgainstANode(side, parents, currentNode, peer);
         return true;
     } //else if peer is a LeafT
     BNodeT::open(*peer);
-    LeafPtr &leafPeer = std::get<LeafPtr>(*peer);
+    LeafT *leafPeer = getNode<LeafPtr>(*peer);
     if (leafPeer->size() + currentNode->size() >= SIZE) {
         size_t transferSize = SIZE / 2 - currentNode->size();
         if (side == Front) {
@@ -233,7 +291,7 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceLeaf(Builder::Side side, std::
         if (side == Front) {
             if (currentNode->available() >= leafPeer->size()) {
                 currentNode->add(*leafPeer);
-                *peer = std::move(currentNode);
+                *peer = takeNode<LeafPtr>(node);
             } else {
                 auto newLeaf = LeafT::createLeafPtr(LeafT::createLeaf(context_));
                 newLeaf->add(*currentNode);
@@ -259,7 +317,7 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceLeaf(Builder::Side side, std::
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceBNode(Builder::Side side, std::array<BNodeT *, maxHeight()> &parents,
-                                                        BNodePtr &currentNode) {
+                                                        BNodeT *currentNode) {
     if (currentNode->isBalanced()) {
         return false;
     }
@@ -270,7 +328,7 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceBNode(Builder::Side side, std:
         return true;
     } //else if peer is a BNodeT
     BNodeT::open(*peer);
-    BNodePtr &bNodePeer = std::get<BNodePtr>(*peer);
+    BNodeT *bNodePeer = getNode<BNodePtr>(*peer);
     if (bNodePeer->childrenCount() + currentNode->childrenCount() >= MAX_COUNT) {
         size_t transferCount = MAX_COUNT / 2 - currentNode->childrenCount();
         if (side == Front) {
@@ -306,13 +364,13 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::pruneEmptyParentsAndSingleRoots(
     int pos;
     treeChanged = pruneSingleChildRoots(parents, pos) || treeChanged;
     if (pos >= 0 && BNodeT::isBNode(root_)) {
-        parents[pos] = std::get<BNodePtr>(root_).get();
+        parents[pos] = getNode<BNodePtr>(root_);
     }
     while (pos > 0) {
         if (parents[pos]) {
             auto &candidate = parents[pos]->childAt(side == Front ? 0 : (parents[pos]->childrenCount() - 1));
             if (candidate.index() == 2) {
-                parents[pos - 1] = std::get<BNodePtr>(candidate).get();
+                parents[pos - 1] = getNode<BNodePtr>(candidate);
             }
         } else {
             parents[pos - 1] = nullptr;
@@ -329,9 +387,9 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::removeNodeAndAddToPeer(const Side sid
                                                                   std::array<BNodeT *, maxHeight()> &parents,
                                                                   VarType &peer, int8_t targetHeight) {
     BNodeT::open(peer);
-    ANodeT *peerPtr = std::get<ANodePtr>(peer).get();
+    ANodeT *peerPtr = getNode<ANodePtr>(peer);
     VarType removedNode = parents[targetHeight]->removeNode(side == Front);
-    peerPtr->addNode(closeNode(std::get<NODE_PTR>(std::move(removedNode)), true), 0,
+    peerPtr->addNode(closeNode(takeNode<NODE_PTR>(removedNode), true), 0,
                      std::numeric_limits<size_t>::max(), side == Front,context_);
     pruneEmptyParentsAndSingleRoots(side, parents, targetHeight);
 }
@@ -360,7 +418,7 @@ Builder<T, MAX_COUNT, SIZE, ADAPTER>::balance(Builder::Side side, std::array<BNo
                 if (BNodeT::isBalanced(currentNode)) {
                     return treeChanged; // all ANodes subnodes are always balanced
                 }
-                ANodePtr &aNodePtr = std::get<ANodePtr>(currentNode);
+                ANodeT *aNodePtr = getNode<ANodePtr>(currentNode);
                 int height = aNodePtr->height();
                 MutationLevelKeeper mutationLevelKeeper(*this, height - 1);
                 {
@@ -375,9 +433,9 @@ Builder<T, MAX_COUNT, SIZE, ADAPTER>::balance(Builder::Side side, std::array<BNo
                 return true;
             }
             case 2: {
-                BNodePtr &bNodePtr = std::get<BNodePtr>(currentNode);
+                BNodeT *bNodePtr = getNode<BNodePtr>(currentNode);
                 int height = bNodePtr->height();
-                parents[height - 1] = bNodePtr.get();
+                parents[height - 1] = bNodePtr;
                 if (balance(side, parents, height - 1)) {
                     treeChanged = true;
                     continue; //if anything happened below we try again in case the current node changed
@@ -408,15 +466,15 @@ bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::pruneSingleChildRoots(std::array<BNod
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::pruneSingleChildRoots(std::array<BNodeT *, maxHeight()> &parents, int &pos) {
-    bool treeChanged;
+    bool treeChanged = false;
     for (pos = heightOf(root_) - 1;
-         BNodeT::isBNode(root_) && std::get<BNodePtr>(root_)->childrenCount() == 1; pos--) {
+         BNodeT::isBNode(root_) && getNode<BNodePtr>(root_)->childrenCount() == 1; pos--) {
         parents[pos] = nullptr;
-        VarType newRoot = std::move(std::get<BNodePtr>(root_)->childAt(0));
+        VarType newRoot = std::move(getNode<BNodePtr>(root_)->childAt(0));
         root_ = std::move(newRoot);
         if (BNodeT::isBNode(root_)) {
             BNodeT::open(root_);
-            parents[pos - 1] = std::get<BNodePtr>(root_).get();
+            parents[pos - 1] = getNode<BNodePtr>(root_);
         } else if (pos > 0) {
             parents[pos - 1] = nullptr;
         }
@@ -429,7 +487,7 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 void
 Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(Builder::VarType &&incomingNode, size_t offset, size_t length,
                                                   bool asPrefix) {
-    std::visit([&](auto &&nodePtr) {
+    visitNode([&](auto &&nodePtr) {
         addChildren(std::move(nodePtr), offset, length, asPrefix);
     }, std::move(incomingNode));
 }
@@ -438,7 +496,7 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 void
 Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(const Builder::VarType &incomingNode, size_t offset, size_t length,
                                                   bool asPrefix) {
-    std::visit([&](const auto &nodePtr) {
+    visitNode([&](const auto &nodePtr) {
         addNode(nodePtr, offset, length, asPrefix);
     }, incomingNode);
 }
@@ -479,7 +537,7 @@ Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 template<class NODE_T>
 void
-Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(std::shared_ptr<const NODE_T> &&incomingNode, size_t offset /* = 0 */,
+Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(ConstPtr<NODE_T> &&incomingNode, size_t offset /* = 0 */,
                                                   size_t length /* = std::numeric_limits<size_t>::max() */,
                                                   bool asPrefix /*= false */) {
 
@@ -488,7 +546,7 @@ Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(std::shared_ptr<const NODE_T>
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 template<class NODE_T>
-void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(const std::shared_ptr<const NODE_T> &incomingNode,
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addChildren(const ConstPtr<NODE_T> &incomingNode,
                                                        size_t offset /*= 0*/,
                                                        size_t length /*= std::numeric_limits<size_t>::max()*/,
                                                        bool asPrefix /*= false*/) {
@@ -532,7 +590,7 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
                              std::is_same_v<std::remove_cvref_t<NODE_T>, BNodeCPtr> or
                              std::is_same_v<std::remove_cvref_t<NODE_T>, LeafCPtr>;
     if constexpr (std::is_same_v<std::remove_cvref_t<NODE_T>, VarType>) {
-        std::visit([&](auto &&nodePtr) {
+        visitNode([&](auto &&nodePtr) {
             if constexpr (is_unique_ptr_v<std::remove_cvref_t<decltype(nodePtr)>>) {
                 addNode(std::move(nodePtr), offset, length, asPrefix);
             } else {
@@ -556,6 +614,13 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
         if (!incomingNode) {
             return;
         }
+        if constexpr (!isANode) {
+            if (!asPrefix && offset == 0 && length >= incomingNode->size() &&
+                appendToSpine(std::forward<NODE_T>(incomingNode))) {
+                return;
+            }
+        }
+        spineValid_ = false;
         length = std::min(length, incomingNode->size() - offset);
         if (!length) {
             return;
@@ -622,18 +687,18 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
                             if (!BNodeT::isConst(root_) || std::is_same_v<std::remove_cvref_t<NODE_T>, BNodeCPtr>) {
                                 BNodeT::open(root_);
                                 if constexpr (std::is_same_v<std::remove_cvref_t<NODE_T>, BNodePtr>) {
-                                    std::get<BNodePtr>(root_)->moveNodes(*incomingNode, 0,
+                                    getNode<BNodePtr>(root_)->moveNodes(*incomingNode, 0,
                                                                          asPrefix ? 0 : rootChildrenCount,
                                                                          incomingNode->childrenCount());
                                 } else {
-                                    std::get<BNodePtr>(root_)->addNodes(*incomingNode, 0,
+                                    getNode<BNodePtr>(root_)->addNodes(*incomingNode, 0,
                                                                         asPrefix ? 0 : rootChildrenCount,
                                                                         incomingNode->childrenCount());
                                 }
                             } else {
                                 if constexpr (std::is_same_v<std::remove_cvref_t<NODE_T>, BNodePtr>) {
                                     auto openedIncoming = openNode(std::forward<NODE_T>(incomingNode), context_);
-                                    openedIncoming->addNodes(*std::get<BNodeCPtr>(root_), 0,
+                                    openedIncoming->addNodes(*getNode<BNodeCPtr>(root_), 0,
                                                              asPrefix ? openedIncoming->childrenCount() : 0,
                                                              rootChildrenCount);
                                     root_ = std::forward<NODE_T>(openedIncoming);
@@ -646,7 +711,7 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
                     }
                 }
                 if constexpr (isANode) {
-                    if (BNodeT::isBalanced(root_) && std::visit([&](auto &&rootPtr) {
+                    if (BNodeT::isBalanced(root_) && visitNode([&](auto &&rootPtr) {
                         if (incomingNode->canAcceptNode(rootPtr, !asPrefix)) {
                             auto openedIncoming = openNode(std::forward<NODE_T>(incomingNode), context_);
                             if constexpr (is_unique_ptr_v<decltype(rootPtr)>) {
@@ -667,7 +732,7 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
                 if (BNodeT::isANode(root_)) {
                     if (getANodeConst(root_)->canAcceptNode(incomingNode, asPrefix, offset, length)) {
                         BNodeT::open(root_);
-                        std::get<ANodePtr>(root_)->addNode(closeNode(std::forward<NODE_T>(incomingNode), true),
+                        getNode<ANodePtr>(root_)->addNode(closeNode(std::forward<NODE_T>(incomingNode), true),
                                                            offset, length, asPrefix, context_);
                         return;
                     }
@@ -695,7 +760,7 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
                         } else {
                             if (rootConstLeaf.available() >= length) {
                                 BNodeT::open(root_);
-                                std::get<LeafPtr>(root_)->add(*incomingNode, offset, length);
+                                getNode<LeafPtr>(root_)->add(*incomingNode, offset, length);
                             } else {
                                 LeafT newLeaf = LeafT::createLeaf(context_);
                                 newLeaf.add(rootConstLeaf);
@@ -719,17 +784,17 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addNode(NODE_T &&incomingNode, size_t
                                                 VarType(openNode(std::forward<NODE_T>(incomingNode), context_)) :
                                                 VarType(std::forward<NODE_T>(incomingNode)) :
                                   VarType(annotateNode(std::forward<NODE_T>(incomingNode), offset, length));
-                std::visit([&](auto &&rootPtr) {
+                visitNode([&](auto &&rootPtr) {
                     BNodePtr newRoot = BNodeT::createNodePtr(BNodeT(rootPtr->height() + 1));
                     if (asPrefix) {
                         newRoot->addNode(std::move(newNode));
-                        if (is_shared_ptr_v<std::remove_cvref_t<decltype(rootPtr)>>) {
+                        if (is_const_ptr_v<std::remove_cvref_t<decltype(rootPtr)>>) {
                             newRoot->addNode(openNode(std::move(rootPtr), context_));
                         } else {
                             newRoot->addNode(std::move(rootPtr));
                         }
                     } else {
-                        if (is_shared_ptr_v<std::remove_cvref_t<decltype(rootPtr)>>) {
+                        if (is_const_ptr_v<std::remove_cvref_t<decltype(rootPtr)>>) {
                             newRoot->addNode(openNode(std::move(rootPtr), context_));
                         } else {
                             newRoot->addNode(std::move(rootPtr));
@@ -755,6 +820,7 @@ template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class A
 template<class NODE_T>
 void Builder<T, MAX_COUNT, SIZE, ADAPTER>::swapAdd(NODE_T &&incomingNode, size_t offset, size_t length, bool asPrefix,
                                                    bool writeInFull) {
+    spineValid_ = false;
     VarType oldNode = std::move(root_);
     if (!writeInFull) {
         root_ = annotateNode(std::forward<NODE_T>(incomingNode), offset, length);
@@ -790,14 +856,18 @@ Builder<T, MAX_COUNT, SIZE, ADAPTER>::annotateNode(NODE_T &&incomingNode, size_t
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::close(bool allowAnodeRoot) -> VarType {
+    spineValid_ = false;
     do {
         auto originalSize = size();
         if (BNodeT::isANode(root_) && !BNodeT::isBalanced(root_)) {
             Builder builder(heightOf(root_) - 1);
             builder.setContext(context_);
+            builder.setFlatteningPolicy(flatteningPolicy_);
             builder.addNode(std::move(root_));
             assert(originalSize == builder.size());
-            return builder.close();
+            auto result = builder.close();
+            flatteningReport_ += builder.flatteningReport_;
+            return result;
         }
         balanceAll();
         if (sizeOf(root_)) {
@@ -808,11 +878,507 @@ auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::close(bool allowAnodeRoot) -> VarType
         }
         pushDownAnnotations();
     } while (true);
+    flattenAnnotations();
     return std::move(root_);
 }
 
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::needsFlattening(const auto &node) const {
+    if (flatteningPolicy_.maxAnnotationDepth && node.annotationDepth() > flatteningPolicy_.maxAnnotationDepth) {
+        return true;
+    }
+    if constexpr (std::is_same_v<std::remove_cvref_t<decltype(node)>, ANodeT>) {
+        return flatteningPolicy_.maxOriginRatio && node.originSize() > flatteningPolicy_.maxOriginRatio * node.size();
+    }
+    return false;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::flattenAnnotations() {
+    //the depth is cached by makeConst, so a compliant tree costs a single check
+    if (!root_ || !visitConstNode([&](const auto &root) { return needsFlattening(root); }, root_)) {
+        return;
+    }
+    Builder builder;
+    builder.setContext(context_);
+    //every piece added complies already
+    builder.setFlatteningPolicy({0, 0});
+    visitNode([&](const auto &rootPtr) {
+        addFlattened(builder, rootPtr, 0, rootPtr->size());
+    }, root_);
+    size_t originalSize = size();
+    root_ = builder.close();
+    assert(originalSize == size());
+    flatteningReport_ += builder.flatteningReport_;
+}
+
+/*
+ * Adds [offset, offset + length) of node to target as whole const subtrees that comply with the policy, descending
+ * through the ones that don't, and as const leaves sharing the array of the original where only part of a leaf is
+ * covered. Pieces are only ever added whole, so target creates no annotations of its own.
+ */
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void
+Builder<T, MAX_COUNT, SIZE, ADAPTER>::addFlattened(Builder &target, const auto &nodePtr, size_t offset, size_t length) {
+    if constexpr (!is_const_ptr_v<decltype(nodePtr)>) {
+        throw std::logic_error("Only const trees get flattened");
+    } else {
+        using NodeType = std::remove_cvref_t<decltype(*nodePtr)>;
+        bool whole = offset == 0 && length >= nodePtr->size();
+        if constexpr (std::is_same_v<NodeType, LeafT>) {
+            if (whole) {
+                target.addNode(nodePtr);
+                flatteningReport_.subtreesShared++;
+            } else {
+                //a copy of a const leaf shares its array
+                LeafT piece(*nodePtr);
+                piece.slice(offset, length);
+                piece.makeConst();
+                target.addNode(LeafT::createLeafCPtr(std::move(piece)));
+                flatteningReport_.leavesSliced++;
+                flatteningReport_.valuesSliced += length;
+            }
+        } else {
+            if (whole && !needsFlattening(*nodePtr)) {
+                target.addNode(nodePtr);
+                flatteningReport_.subtreesShared++;
+                return;
+            }
+            if constexpr (std::is_same_v<NodeType, ANodeT>) {
+                flatteningReport_.annotationsFlattened++;
+            }
+            nodePtr->forEachChild([&](const auto &child, size_t childOffset, size_t childLength) {
+                addFlattened(target, child, childOffset, childLength);
+            }, offset, length, false);
+        }
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::split(const VarType &root, size_t pos, void *context)
+-> std::pair<VarType, VarType> {
+    size_t size = sizeOf(root);
+    if (!size) {
+        return {};
+    }
+    if (!BNodeT::isConst(root)) {
+        throw std::logic_error("Only const trees can be split");
+    }
+    if (pos == 0 || pos >= size) {
+        return pos ? std::make_pair(BNodeT::copyNode(root), VarType()) : std::make_pair(VarType(), BNodeT::copyNode(root));
+    }
+    return visitConstNode([&](const auto &node) {
+        return splitNode(node, 0, size, pos, context);
+    }, root);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::splitNode(const auto &node, size_t begin, size_t end, size_t pos,
+                                                     void *context) -> std::pair<VarType, VarType> {
+    using NodeType = std::remove_cvref_t<decltype(node)>;
+    if constexpr (std::is_same_v<NodeType, LeafT>) {
+        return {sliceLeaf(node, begin, pos - begin), sliceLeaf(node, pos, end - pos)};
+    } else {
+        return node.visitChildAt([&](const auto &child, size_t childBegin, size_t sliceBegin, size_t sliceLength) {
+            //[begin, end) may cover only part of the node (origin of an annotation), so the slice gets clipped
+            size_t localBegin = std::max(sliceBegin, begin);
+            size_t localEnd = std::min(sliceBegin + sliceLength, end);
+            auto [left, right] = splitNode(child, childBegin + localBegin - sliceBegin,
+                                           childBegin + localEnd - sliceBegin, childBegin + pos - sliceBegin, context);
+            return std::make_pair(concat(groupChildren(node, begin, localBegin, context), left, context),
+                                  concat(right, groupChildren(node, localEnd, end, context), context));
+        }, pos);
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::groupChildren(const auto &node, size_t from, size_t to, void *context)
+-> VarType {
+    if (from >= to) {
+        return {};
+    }
+    std::vector<VarType> children;
+    bool whole = true;
+    node.forEachChild([&](const auto &child, size_t childOffset, size_t childLength) {
+        if constexpr (is_const_ptr_v<decltype(child)>) {
+            whole = whole && childOffset == 0 && childLength == child->size() && child->isBalanced() &&
+                    child->height() == node.height() - 1;
+            if (whole) {
+                children.emplace_back(child);
+            }
+        } else {
+            whole = false;
+        }
+    }, from, to - from, false);
+    if (whole) {
+        return children.size() == 1 ? std::move(children.front()) :
+               std::move(packLevel(std::move(children), node.height()).front());
+    }
+    Builder builder;
+    builder.setContext(context);
+    node.forEachChild([&](const auto &child, size_t childOffset, size_t childLength) {
+        builder.addNode(child, childOffset, childLength);
+    }, from, to - from, false);
+    return builder.close();
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::sliceLeaf(const LeafT &leaf, size_t offset, size_t length) -> VarType {
+    if (!length) {
+        return {};
+    }
+    //const nodes are reference counted in place, so the leaf can be shared from its address
+    if (offset == 0 && length == leaf.size()) {
+        return LeafCPtr(&leaf);
+    }
+    //a copy of a const leaf shares its array
+    LeafT piece(leaf);
+    piece.slice(offset, length);
+    piece.makeConst();
+    return LeafT::createLeafCPtr(std::move(piece));
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::mergeSeam(const VarType &a, const VarType &b, void *context,
+                                                     std::vector<VarType> &out) {
+    if (BNodeT::isBalanced(a) && BNodeT::isBalanced(b)) {
+        out.push_back(BNodeT::copyNode(a));
+        out.push_back(BNodeT::copyNode(b));
+        return true;
+    }
+    if (BNodeT::isLeaf(a) && BNodeT::isLeaf(b)) {
+        const LeafT &first = getLeafConst(a);
+        const LeafT &second = getLeafConst(b);
+        //over SIZE values split in two halves, each above SIZE / 2
+        size_t total = first.size() + second.size();
+        size_t pieces = total > SIZE ? 2 : 1;
+        for (size_t piece = 0; piece < pieces; piece++) {
+            size_t from = total * piece / pieces;
+            size_t to = total * (piece + 1) / pieces;
+            LeafT leaf = LeafT::createLeaf(context);
+            if (from < first.size()) {
+                leaf.add(first, from, std::min(to, first.size()) - from);
+            }
+            if (to > first.size()) {
+                size_t secondFrom = std::max(from, first.size()) - first.size();
+                leaf.add(second, secondFrom, to - first.size() - secondFrom);
+            }
+            out.emplace_back(makeConstFromPtr(LeafT::createLeafPtr(std::move(leaf)), pieces == 1));
+        }
+        return true;
+    }
+    if (BNodeT::isBNode(a) && BNodeT::isBNode(b)) {
+        const BNodeT &first = *getBNodeConst(a);
+        const BNodeT &second = *getBNodeConst(b);
+        std::vector<VarType> children;
+        children.reserve(first.childrenCount() + second.childrenCount());
+        for (const BNodeT *node: {&first, &second}) {
+            for (size_t i = 0; i < node->childrenCount(); i++) {
+                children.push_back(BNodeT::copyNode(node->childAt(i)));
+            }
+        }
+        for (auto &node: packLevel(std::move(children), first.height())) {
+            out.push_back(std::move(node));
+        }
+        return true;
+    }
+    return false;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+bool Builder<T, MAX_COUNT, SIZE, ADAPTER>::graft(const VarType &node, const VarType &incoming, bool onFront,
+                                                 void *context, std::vector<VarType> &out) {
+    if (!BNodeT::isBNode(node)) {
+        return false;
+    }
+    const BNodeT &parent = *getBNodeConst(node);
+    size_t edge = onFront ? 0 : parent.childrenCount() - 1;
+    const VarType &edgeChild = parent.childAt(edge);
+    std::vector<VarType> seam;
+    bool grafted = parent.height() - 1 > BNodeT::heightOf(incoming) ?
+                   graft(edgeChild, incoming, onFront, context, seam) :
+                   onFront ? mergeSeam(incoming, edgeChild, context, seam) :
+                   mergeSeam(edgeChild, incoming, context, seam);
+    if (!grafted) {
+        return false;
+    }
+    std::vector<VarType> children;
+    children.reserve(parent.childrenCount() + seam.size());
+    for (size_t i = 0; i < parent.childrenCount(); i++) {
+        if (i != edge) {
+            children.push_back(BNodeT::copyNode(parent.childAt(i)));
+        } else {
+            std::move(seam.begin(), seam.end(), std::back_inserter(children));
+        }
+    }
+    for (auto &packed: packLevel(std::move(children), parent.height())) {
+        out.push_back(std::move(packed));
+    }
+    return true;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::concat(const VarType &left, const VarType &right, void *context) -> VarType {
+    if (!sizeOf(left) || !sizeOf(right)) {
+        return sizeOf(left) ? BNodeT::copyNode(left) : sizeOf(right) ? BNodeT::copyNode(right) : VarType();
+    }
+    if (!BNodeT::isConst(left) || !BNodeT::isConst(right)) {
+        throw std::logic_error("Only const trees can be concatenated");
+    }
+    int8_t leftHeight = BNodeT::heightOf(left);
+    int8_t rightHeight = BNodeT::heightOf(right);
+    std::vector<VarType> level;
+    bool joined = leftHeight == rightHeight ? mergeSeam(left, right, context, level) :
+                  leftHeight > rightHeight ? graft(left, right, false, context, level) :
+                  graft(right, left, true, context, level);
+    if (!joined) {
+        return appendAll({&left, &right}, context);
+    }
+    //two nodes at most, the root overflowing grows the tree by a level
+    for (int8_t height = BNodeT::heightOf(level.front()) + 1; level.size() > 1; height++) {
+        level = packLevel(std::move(level), height);
+    }
+    return std::move(level.front());
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::concatAll(std::initializer_list<const VarType *> parts, void *context)
+-> VarType {
+    VarType result;
+    for (const VarType *node: parts) {
+        result = concat(result, *node, context);
+    }
+    return result;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::appendAll(std::initializer_list<const VarType *> parts, void *context)
+-> VarType {
+    Builder builder;
+    builder.setContext(context);
+    //an empty slot reads as a null mutable leaf, which addNode refuses from a const reference
+    for (const VarType *node: parts) {
+        if (*node) {
+            builder.addNode(*node);
+        }
+    }
+    return builder.close();
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::erase(const VarType &root, size_t offset, size_t length, void *context)
+-> VarType {
+    size_t size = sizeOf(root);
+    length = offset < size ? std::min(length, size - offset) : 0;
+    if (!length) {
+        return BNodeT::copyNode(root);
+    }
+    auto [left, rest] = split(root, offset, context);
+    auto right = split(rest, length, context).second;
+    return concat(left, right, context);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::moveRange(const VarType &root, size_t srcOffset, size_t length,
+                                                     size_t dstOffset, void *context) -> VarType {
+    size_t size = sizeOf(root);
+    if (srcOffset > size || length > size - srcOffset || dstOffset > size - length) {
+        throw std::logic_error("Moved range out of the tree bounds");
+    }
+    if (!length || srcOffset == dstOffset) {
+        return BNodeT::copyNode(root);
+    }
+    //cuts c0 < c1 < c2 leave pieces p0 p1 p2 p3, either way the result is p0 p2 p1 p3: the range goes left over
+    //[dstOffset, srcOffset) or right over [srcOffset + length, dstOffset + length)
+    size_t cuts[3] = {dstOffset, srcOffset, srcOffset + length};
+    if (dstOffset > srcOffset) {
+        cuts[0] = srcOffset;
+        cuts[1] = srcOffset + length;
+        cuts[2] = dstOffset + length;
+    }
+    auto [p0, rest0] = split(root, cuts[0], context);
+    auto [p1, rest1] = split(rest0, cuts[1] - cuts[0], context);
+    auto [p2, p3] = split(rest1, cuts[2] - cuts[1], context);
+    return concatAll({&p0, &p2, &p1, &p3}, context);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::packLevel(std::vector<VarType> &&level, int8_t height)
+-> std::vector<VarType> {
+    //n children over ceil(n / MAX_COUNT) nodes, evenly: each gets floor or ceil of the average, which is above
+    //MAX_COUNT / 2 as soon as there are two nodes
+    size_t nodeCount = (level.size() + MAX_COUNT - 1) / MAX_COUNT;
+    std::vector<VarType> result;
+    result.reserve(nodeCount);
+    size_t pos = 0;
+    for (size_t i = 0; i < nodeCount; i++) {
+        size_t end = level.size() * (i + 1) / nodeCount;
+        auto node = BNodeT::createNodePtr(BNodeT(height));
+        for (; pos < end; pos++) {
+            node->addNode(std::move(level[pos]));
+        }
+        VarType packed(std::move(node));
+        BNodeT::makeConst(packed, nodeCount == 1);
+        result.push_back(std::move(packed));
+    }
+    return result;
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::packLevels(std::vector<VarType> &&leaves) -> VarType {
+    if (leaves.empty()) {
+        return {};
+    }
+    std::vector<VarType> level = std::move(leaves);
+    for (int8_t height = 1; level.size() > 1; height++) {
+        level = packLevel(std::move(level), height);
+    }
+    return std::move(level.front());
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::bulkLoad(std::vector<LeafPtr> &&leaves) -> VarType {
+    std::vector<VarType> level;
+    level.reserve(leaves.size());
+    for (auto &leaf: leaves) {
+        if (leaves.size() > 1 && !leaf->isBalanced()) {
+            throw std::logic_error("Bulk loaded leaves must be balanced");
+        }
+        level.emplace_back(makeConstFromPtr(std::move(leaf), leaves.size() == 1));
+    }
+    return packLevels(std::move(level));
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::bulkLoad(const T *values, size_t count, void *context) -> VarType {
+    //same even spread as packLevel, so no leaf but a lone one ends up below SIZE / 2
+    size_t leafCount = (count + SIZE - 1) / SIZE;
+    std::vector<VarType> level;
+    level.reserve(leafCount);
+    size_t pos = 0;
+    for (size_t i = 0; i < leafCount; i++) {
+        size_t end = count * (i + 1) / leafCount;
+        auto leaf = LeafT::createLeaf(context);
+        leaf.add(values + pos, end - pos);
+        level.emplace_back(makeConstFromPtr(LeafT::createLeafPtr(std::move(leaf)), leafCount == 1));
+        pos = end;
+    }
+    return packLevels(std::move(level));
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+template<class ContextFactory>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::parallelBulkLoad(const T *values, size_t count, size_t threadCount,
+                                                            ContextFactory &&contextFor) -> VarType {
+    //partitions start on leaf boundaries, so only the very last leaf may be short, and hold at least one full BNode,
+    //below that the seams would cost more than the load
+    size_t leafCount = (count + SIZE - 1) / SIZE;
+    size_t partitionCount = std::clamp<size_t>(leafCount / MAX_COUNT, 1, std::max<size_t>(threadCount, 1));
+    std::vector<void *> contexts(partitionCount);
+    for (size_t i = 0; i < partitionCount; i++) {
+        contexts[i] = contextFor(i);
+    }
+    std::vector<VarType> subtrees(partitionCount);
+    std::vector<std::exception_ptr> errors(partitionCount);
+    auto load = [&](size_t partition) {
+        try {
+            size_t begin = leafCount * partition / partitionCount * SIZE;
+            size_t end = std::min(count, leafCount * (partition + 1) / partitionCount * SIZE);
+            subtrees[partition] = bulkLoad(values + begin, end - begin, contexts[partition]);
+        } catch (...) {
+            errors[partition] = std::current_exception();
+        }
+    };
+    WorkerPool::oneAndOnly().run(partitionCount, load);
+    for (const auto &error: errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    for (size_t stride = 1; stride < partitionCount; stride *= 2) {
+        for (size_t i = 0; i + stride < partitionCount; i += 2 * stride) {
+            subtrees[i] = concat(subtrees[i], subtrees[i + stride], contexts[i]);
+            subtrees[i + stride] = {};
+        }
+    }
+    return std::move(subtrees[0]);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::addRanges(const VarType &source,
+                                                     const std::vector<std::pair<size_t, size_t>> &sortedRanges) {
+    SourceCursor cursor(source);
+    for (const auto &[offset, length]: sortedRanges) {
+        cursor.append(*this, offset, length);
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+Builder<T, MAX_COUNT, SIZE, ADAPTER>::SourceCursor::SourceCursor(const VarType &source) {
+    if (source) {
+        if (!BNodeT::isConst(source)) {
+            throw std::logic_error("Only const trees can be appended by range");
+        }
+        source_ = BNodeT::copyNode(source);
+    }
+    path_.reserve(maxHeight());
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::SourceCursor::append(Builder &target, size_t offset, size_t length) {
+    if (offset < position_) {
+        throw std::logic_error("Ranges must be appended in order and cannot overlap");
+    }
+    size_t size = BNodeT::sizeOf(source_);
+    size_t end = std::min(size, offset + std::min(length, size));
+    size_t pos = offset;
+    while (pos < end) {
+        while (!path_.empty() && pos >= path_.back().end) {
+            path_.pop_back();
+        }
+        if (path_.empty()) {
+            if ((pos == 0 && end == size) || BNodeT::heightOf(source_) == 0) {
+                target.addNode(source_, pos, end - pos);
+                pos = end;
+            } else {
+                visitConstNode([&](const auto &root) {
+                    path_.push_back({&root, std::is_same_v<std::remove_cvref_t<decltype(root)>, ANodeT>, 0, size, 0});
+                }, source_);
+            }
+            continue;
+        }
+        Frame frame = path_.back();
+        visitFrame(frame, [&](const auto &node) {
+            node.visitChildAt([&](const auto &child, size_t childBegin, size_t sliceBegin, size_t sliceLength) {
+                using ChildType = std::remove_cvref_t<decltype(child)>;
+                //the frame may cover only part of the node (origin of an annotation), so the slice gets clipped
+                size_t localBegin = std::max(sliceBegin, frame.localBegin);
+                size_t localEnd = std::min(sliceBegin + sliceLength, frame.localBegin + frame.end - frame.begin);
+                size_t childTreeBegin = frame.begin + localBegin - frame.localBegin;
+                size_t childTreeEnd = childTreeBegin + localEnd - localBegin;
+                size_t childLocalBegin = childBegin + localBegin - sliceBegin;
+                bool isWhole = childLocalBegin == 0 && localEnd - localBegin == child.size();
+                if (isWhole && pos == childTreeBegin && end >= childTreeEnd) {
+                    //const nodes are reference counted in place, so the child can be shared from its address
+                    target.addNode(ConstPtr<ChildType>(&child));
+                    pos = childTreeEnd;
+                } else if constexpr (std::is_same_v<ChildType, LeafT>) {
+                    size_t to = std::min(end, childTreeEnd);
+                    target.addNode(LeafCPtr(&child), childLocalBegin + pos - childTreeBegin, to - pos);
+                    pos = to;
+                } else {
+                    path_.push_back({&child, std::is_same_v<ChildType, ANodeT>, childTreeBegin, childTreeEnd,
+                                     childLocalBegin});
+                }
+            }, frame.localBegin + pos - frame.begin);
+        });
+    }
+    position_ = std::max(position_, end);
+}
+
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void Builder<T, MAX_COUNT, SIZE, ADAPTER>::pushDownAnnotations() {
+    spineValid_ = false;
     if (!BNodeT::isANode(root_)) {
         return;
     }
@@ -824,19 +1390,21 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::pushDownAnnotations() {
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balance(Builder::Side side) {
+    spineValid_ = false;
     std::array<BNodeT *, maxHeight()> parents{nullptr};
     auto rootHeight = BNodeT::heightOf(root_);
     if (rootHeight == 0) {
         return;
     }
     if (!BNodeT::isConst(root_) && BNodeT::isBNode(root_)) {
-        parents[rootHeight - 1] = std::get<BNodePtr>(root_);
+        parents[rootHeight - 1] = getNode<BNodePtr>(root_);
         balance(side, parents, rootHeight - 1);
     }
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceAll() {
+    spineValid_ = false;
     int8_t balancedHeight;
     bool repeat = false;
     do {
@@ -845,9 +1413,9 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceAll() {
         std::array<BNodeT *, maxHeight()> parents{nullptr};
         while (BNodeT::isBNode(root_) && getBNodeConst(root_)->childrenCount() == 1) {
             if (BNodeT::isConst(root_)) {
-                root_ = BNodeT::copyNode(std::get<BNodeCPtr>(root_)->childAt(0));
+                root_ = BNodeT::copyNode(getNode<BNodeCPtr>(root_)->childAt(0));
             } else {
-                auto v = std::move(std::get<BNodePtr>(root_)->childAt(0));
+                auto v = std::move(getNode<BNodePtr>(root_)->childAt(0));
                 root_ = std::move(v);
             }
         }
@@ -857,7 +1425,7 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceAll() {
         }
         if (!BNodeT::isConst(root_) && BNodeT::isBNode(root_)) {
             size_t sizeB4 = sizeOf(root_);
-            parents[rootHeight - 1] = std::get<BNodePtr>(root_).get();
+            parents[rootHeight - 1] = getNode<BNodePtr>(root_);
             balance(Side::Front, parents, rootHeight - 1);
             size_t sizeAfter = sizeOf(root_);
             assert(sizeB4 == sizeAfter);
@@ -868,7 +1436,7 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceAll() {
         }
         balancedHeight = std::min(balancedHeight, rootHeight);
         if (!BNodeT::isConst(root_) && BNodeT::isBNode(root_)) {
-            parents[rootHeight - 1] = std::get<BNodePtr>(root_).get();
+            parents[rootHeight - 1] = getNode<BNodePtr>(root_);
             balance(Side::Back, parents, rootHeight - 1);
             if (!BNodeT::isOneSideBalanced(root_, true, true)) {
                 repeat = true;
@@ -881,29 +1449,113 @@ void Builder<T, MAX_COUNT, SIZE, ADAPTER>::balanceAll() {
 
 }
 
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void Builder<T, MAX_COUNT, SIZE, ADAPTER>::multiGet(const VarType &node, const size_t *positions, size_t count, T *out) {
+    if (!count) {
+        return;
+    }
+    //kind follows the NodeVariant tags: 0 - leaf, 1 - annotation, 2 - bNode
+    struct Probe {
+        const void *node;
+        int8_t kind;
+        size_t offset;
+        size_t slot;
+    };
+    auto probeFor = [](const auto &probeNode, size_t offset, size_t slot) -> Probe {
+        using NodeType = std::remove_cvref_t<decltype(probeNode)>;
+        int8_t kind = std::is_same_v<NodeType, LeafT> ? 0 : std::is_same_v<NodeType, ANodeT> ? 1 : 2;
+        return {&probeNode, kind, offset, slot};
+    };
+
+    std::array<Probe, MULTI_GET_BATCH> probes;
+    for (size_t batchStart = 0; batchStart < count; batchStart += MULTI_GET_BATCH) {
+        size_t batchSize = std::min(MULTI_GET_BATCH, count - batchStart);
+        for (size_t i = 0; i < batchSize; i++) {
+            size_t slot = batchStart + i;
+            assert(positions[slot] < BNodeT::sizeOf(node));
+            probes[i] = visitConstNode([&](const auto &root) {
+                return probeFor(root, positions[slot], slot);
+            }, node);
+        }
+        for (bool descending = true; descending;) {
+            descending = false;
+            for (size_t i = 0; i < batchSize; i++) {
+                Probe &probe = probes[i];
+                if (!probe.kind) {
+                    continue;
+                }
+                descending = true;
+                auto descend = [&](const auto &parent) {
+                    parent.visitChildAt([&](const auto &child, size_t childBegin, size_t sliceBegin, size_t) {
+                        child.prefetchSearch();
+                        probe = probeFor(child, childBegin + probe.offset - sliceBegin, probe.slot);
+                    }, probe.offset);
+                };
+                if (probe.kind == 1) {
+                    descend(*static_cast<const ANodeT *>(probe.node));
+                } else {
+                    descend(*static_cast<const BNodeT *>(probe.node));
+                }
+            }
+        }
+        if constexpr (LeafT::hasContiguousData) {
+            for (size_t i = 0; i < batchSize; i++) {
+                __builtin_prefetch(static_cast<const LeafT *>(probes[i].node)->data() + probes[i].offset);
+            }
+        }
+        for (size_t i = 0; i < batchSize; i++) {
+            out[probes[i].slot] = static_cast<const LeafT *>(probes[i].node)->at(probes[i].offset);
+        }
+    }
+}
+
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void
 Builder<T, MAX_COUNT, SIZE, ADAPTER>::forEachLeafPtr(auto &&visitor, const auto &nodePtr, size_t offset, size_t len) {
-    using NodeType = decltype(nodePtr);
-    constexpr bool isLeaf = std::is_same_v<std::remove_cvref_t<NodeType>, LeafPtr> or
-                            std::is_same_v<std::remove_cvref_t<NodeType>, LeafCPtr>;
-    if constexpr (isLeaf) {
-        size_t localLen = std::min(len, nodePtr->size() - offset);
-        visitor(*nodePtr, offset, localLen);
+    forEachLeafOf(visitor, *nodePtr, offset, len);
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+void
+Builder<T, MAX_COUNT, SIZE, ADAPTER>::forEachLeafOf(auto &&visitor, const auto &node, size_t offset, size_t len) {
+    if constexpr (std::is_same_v<std::remove_cvref_t<decltype(node)>, LeafT>) {
+        visitor(node, offset, std::min(len, node.size() - offset));
     } else {
-        nodePtr->forEachChild([&](const auto &child, size_t childOffset, size_t childLength) {
-            forEachLeaf(visitor, child, childOffset, childLength);
-        }, offset, len, false);
+        node.forEachChildNode([&](const auto &child, size_t childOffset, size_t childLength) {
+            forEachLeafOf(visitor, child, childOffset, childLength);
+        }, offset, len);
     }
 }
 
 template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
 void Builder<T, MAX_COUNT, SIZE, ADAPTER>::forEachLeaf(auto &&visitor, const auto &node, size_t offset, size_t len) {
-    if constexpr (is_unique_ptr_v<decltype(node)> || is_shared_ptr_v<decltype(node)>) {
+    if constexpr (is_unique_ptr_v<decltype(node)> || is_const_ptr_v<decltype(node)>) {
         forEachLeafPtr(visitor, node, offset, len);
     } else {
-        std::visit([&](const auto &nodePtr) {
-            forEachLeafPtr(visitor, nodePtr, offset, len);
+        visitConstNode([&](const auto &root) {
+            forEachLeafOf(visitor, root, offset, len);
+        }, node);
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::summarize(const auto &node, size_t offset, size_t len) -> Summary<T> {
+    if constexpr (is_unique_ptr_v<decltype(node)> || is_const_ptr_v<decltype(node)>) {
+        return node ? summaryOf(node, offset, len) : Summary<T>();
+    } else {
+        return visitNode([&](const auto &nodePtr) {
+            return nodePtr ? summaryOf(nodePtr, offset, len) : Summary<T>();
+        }, node);
+    }
+}
+
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+auto Builder<T, MAX_COUNT, SIZE, ADAPTER>::contentHash(const auto &node, size_t offset, size_t len) -> ContentHash {
+    if constexpr (is_unique_ptr_v<decltype(node)> || is_const_ptr_v<decltype(node)>) {
+        return node ? hashOf(node, offset, len) : ContentHash();
+    } else {
+        return visitNode([&](const auto &nodePtr) {
+            return nodePtr ? hashOf(nodePtr, offset, len) : ContentHash();
         }, node);
     }
 }
@@ -0,0 +1,154 @@
+#ifndef EXPERIMENTS_CONSTPTR_H
+#define EXPERIMENTS_CONSTPTR_H
+
+#include "AllocatorHelpers.h"
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/**
+ * Reference count embedded in nodes that get published as const. A copy starts from zero because copying a const node
+ * is how it gets opened for mutation, the copy is a new object nobody refers to yet.
+ */
+class RefCounted {
+    mutable std::atomic<uint32_t> refCount_{0};
+public:
+    RefCounted() = default;
+
+    RefCounted(const RefCounted &) {}
+
+    RefCounted &operator=(const RefCounted &) { return *this; }
+
+    void addRef() const { refCount_.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @return true when the last reference was released and the node must be deleted
+     */
+    bool releaseRef() const { return refCount_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    uint32_t useCount() const { return refCount_.load(std::memory_order_relaxed); }
+
+    /**
+     * Acquires the releases of the other references, so a node found exclusive can be written to
+     */
+    bool isExclusive() const { return refCount_.load(std::memory_order_acquire) == 1; }
+};
+
+/**
+ * Shared handle to a const node, a single pointer using the count embedded in the node (no control block). The node
+ * goes back to its StdFixedAllocator when the last handle is dropped.
+ */
+template<class NODE>
+class ConstPtr {
+    const NODE *ptr_ = nullptr;
+
+    void releaseInternal() {
+        if (ptr_ && ptr_->releaseRef()) {
+            DeleterForFixedAllocator<NODE>()(const_cast<NODE *>(ptr_));
+        }
+    }
+
+public:
+    using element_type = const NODE;
+
+    ConstPtr() = default;
+
+    ConstPtr(std::nullptr_t) {}
+
+    ConstPtr(std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>> &&node) : ptr_(node.release()) {
+        if (ptr_) {
+            ptr_->addRef();
+        }
+    }
+
+    /**
+     * Shares a node already owned by some other handle, the count lives in the node so a raw pointer is enough
+     */
+    explicit ConstPtr(const NODE *node) : ptr_(node) {
+        if (ptr_) {
+            ptr_->addRef();
+        }
+    }
+
+    ConstPtr(const ConstPtr &other) : ptr_(other.ptr_) {
+        if (ptr_) {
+            ptr_->addRef();
+        }
+    }
+
+    ConstPtr(ConstPtr &&other) noexcept: ptr_(std::exchange(other.ptr_, nullptr)) {}
+
+    ConstPtr &operator=(const ConstPtr &other) {
+        ConstPtr(other).swap(*this);
+        return *this;
+    }
+
+    ConstPtr &operator=(ConstPtr &&other) noexcept {
+        ConstPtr(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~ConstPtr() { releaseInternal(); }
+
+    /**
+     * Takes over a reference already accounted for in the node count (see release)
+     */
+    static ConstPtr adopt(const NODE *node) {
+        ConstPtr result;
+        result.ptr_ = node;
+        return result;
+    }
+
+    /**
+     * Gives up the reference without decrementing the count, the caller becomes responsible for it
+     */
+    const NODE *release() { return std::exchange(ptr_, nullptr); }
+
+    void reset() { ConstPtr().swap(*this); }
+
+    /**
+     * True when this handle is the only reference to the node, i.e. nothing else can reach it
+     */
+    bool isExclusive() const { return ptr_ && ptr_->isExclusive(); }
+
+    /**
+     * Hands an exclusive node back as a mutable one instead of copying it (transient reopening): the count goes back to
+     * zero, as for a node that was never made const
+     */
+    std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>> takeExclusive() {
+        assert(isExclusive());
+        ptr_->releaseRef();
+        return std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>>(const_cast<NODE *>(std::exchange(ptr_, nullptr)));
+    }
+
+    void swap(ConstPtr &other) noexcept { std::swap(ptr_, other.ptr_); }
+
+    const NODE *get() const { return ptr_; }
+
+    const NODE &operator*() const { return *ptr_; }
+
+    const NODE *operator->() const { return ptr_; }
+
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+    size_t use_count() const { return ptr_ ? ptr_->useCount() : 0; }
+
+    friend bool operator==(const ConstPtr &left, const ConstPtr &right) { return left.ptr_ == right.ptr_; }
+
+    friend bool operator==(const ConstPtr &left, std::nullptr_t) { return left.ptr_ == nullptr; }
+};
+
+/**
+ * Counterpart of std::make_shared for nodes: allocates from the node pool and returns a const handle
+ */
+template<class NODE, class... ARGS>
+ConstPtr<NODE> makeCPtr(ARGS &&... args) {
+    static auto &alloc = StdFixedAllocator<NODE>::oneAndOnly();
+    auto pointer = alloc.allocate(1);
+    alloc.construct(pointer, NODE(std::forward<ARGS>(args)...));
+    return std::unique_ptr<NODE, DeleterForFixedAllocator<NODE>>(pointer);
+}
+
+#endif //EXPERIMENTS_CONSTPTR_H
@@ -0,0 +1,196 @@
+#ifndef EXPERIMENTS_CONTENTHASH_H
+#define EXPERIMENTS_CONTENTHASH_H
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+/**
+ * Polynomial hash of a sequence of values modulo the Mersenne prime 2^61 - 1: hash = sum(h(v[i]) * BASE^(n - 1 - i)).
+ * Like Summary it is a monoid, the default constructed value hashes the empty sequence and operator+= appends a hash
+ * of the following range, so a node combines the hashes of its children (and of the slices it takes of them) without
+ * going back to the values. It depends on the values only, not on how they are split across leaves and nodes, so
+ * equal hashes are expected from trees of different shapes holding the same rows.
+ *
+ * Not a cryptographic hash: collisions are unlikely (about n / 2^61 for two sequences of length n) but not
+ * impossible, so equality of hashes means "probably equal" and is meant for dedup candidates and cache keys.
+ */
+struct ContentHash {
+    static constexpr uint64_t PRIME = (uint64_t(1) << 61) - 1;
+    static constexpr uint64_t BASE = 0x5851f42d4c957f2dULL % PRIME;
+
+    uint64_t hash = 0;
+    //BASE^length, never 0 as PRIME is prime
+    uint64_t scale = 1;
+
+    /**
+     * Folds a value below 2^64 to below PRIME
+     */
+    static uint64_t reduce(uint64_t value) {
+        value = (value & PRIME) + (value >> 61);
+        return value >= PRIME ? value - PRIME : value;
+    }
+
+    /**
+     * left * right modulo PRIME for left below 2^63 and right below PRIME, only partially reduced: the result is below
+     * 2^61 + 5, so it can take a few additions and still be a valid left operand, with a single reduce at the end
+     */
+    static uint64_t mulModLazy(uint64_t left, uint64_t right) {
+        __uint128_t product = __uint128_t(left) * right;
+        uint64_t folded = (uint64_t(product) & PRIME) + uint64_t(product >> 61);
+        return (folded & PRIME) + (folded >> 61);
+    }
+
+    static uint64_t mulMod(uint64_t left, uint64_t right) { return reduce(mulModLazy(left, right)); }
+
+    /**
+     * The bits of a value, folded below 2^61 + 8. Integers and floating point values are taken as they are (bitwise equality),
+     * other types through std::hash.
+     */
+    template<class T>
+    static uint64_t valueHash(const T &value) {
+        uint64_t bits = 0;
+        if constexpr (std::is_arithmetic_v<T> && sizeof(T) <= sizeof(uint64_t)) {
+            if constexpr (std::is_integral_v<T>) {
+                //sign extended, so that equal values of different integer types hash the same
+                bits = uint64_t(int64_t(value));
+            } else {
+                std::memcpy(&bits, &value, sizeof(T));
+            }
+        } else {
+            bits = std::hash<T>{}(value);
+        }
+        return (bits & PRIME) + (bits >> 61);
+    }
+
+    template<class T>
+    void add(const T &value) {
+        hash = reduce(mulModLazy(hash, BASE) + valueHash(value));
+        scale = mulMod(scale, BASE);
+    }
+
+    ContentHash &operator+=(const ContentHash &other) {
+        hash = reduce(mulModLazy(hash, other.scale) + other.hash);
+        scale = mulMod(scale, other.scale);
+        return *this;
+    }
+
+    friend ContentHash operator+(ContentHash left, const ContentHash &right) { return left += right; }
+
+    bool operator==(const ContentHash &other) const = default;
+};
+
+/**
+ * Hash of a contiguous span. LANES interleaved Horner chains stepping by BASE^LANES keep the multiplications independent
+ * of one another and are only partially reduced on the way, they get weighted by BASE^(LANES - 1)..BASE^0 at the end.
+ */
+template<class T>
+ContentHash hashSpan(const T *data, size_t length) {
+    constexpr size_t LANES = 8;
+    uint64_t baseLanes = 1;
+    for (size_t lane = 0; lane < LANES; lane++) {
+        baseLanes = ContentHash::mulMod(baseLanes, ContentHash::BASE);
+    }
+    uint64_t lanes[LANES] = {};
+    uint64_t laneScale = 1;
+    size_t pos = 0;
+    for (; pos + LANES <= length; pos += LANES) {
+        for (size_t lane = 0; lane < LANES; lane++) {
+            //below 2^61 + 5 plus below 2^61 + 8, a valid operand for the next round
+            lanes[lane] = ContentHash::mulModLazy(lanes[lane], baseLanes) + ContentHash::valueHash(data[pos + lane]);
+        }
+        laneScale = ContentHash::mulMod(laneScale, baseLanes);
+    }
+    ContentHash result{0, laneScale};
+    uint64_t weight = 1;
+    for (size_t lane = LANES; lane-- > 0;) {
+        result.hash = ContentHash::reduce(result.hash + ContentHash::mulMod(lanes[lane], weight));
+        weight = ContentHash::mulMod(weight, ContentHash::BASE);
+    }
+    for (; pos < length; pos++) {
+        result.add(data[pos]);
+    }
+    return result;
+}
+
+/**
+ * Hash of first, first + 1, ..., first + length - 1 for any first, values being below 2^61 (which hash as themselves).
+ * It is first * G(n) + D(n) with G(n) = sum(BASE^k) and D(n) = sum(i * BASE^(n - 1 - i)) for k, i < n, both built in
+ * O(log(length)) along the bits of length by doubling the run and appending one value, then each hash costs one
+ * multiplication.
+ */
+class SequenceHash {
+    uint64_t geometric_ = 0;
+    uint64_t ramp_ = 0;
+    uint64_t scale_ = 1;
+
+public:
+    explicit SequenceHash(size_t length) {
+        size_t runLength = 0;
+        for (int bit = std::bit_width(length) - 1; bit >= 0; bit--) {
+            if (runLength) {
+                //the run followed by itself shifted by runLength
+                ramp_ = ContentHash::reduce(ContentHash::mulMod(ramp_, scale_) +
+                                            ContentHash::mulMod(runLength, geometric_) + ramp_);
+                geometric_ = ContentHash::reduce(ContentHash::mulMod(geometric_, scale_) + geometric_);
+                scale_ = ContentHash::mulMod(scale_, scale_);
+                runLength *= 2;
+            }
+            if ((length >> bit) & 1) {
+                ramp_ = ContentHash::reduce(ContentHash::mulMod(ramp_, ContentHash::BASE) + runLength);
+                geometric_ = ContentHash::reduce(ContentHash::mulMod(geometric_, ContentHash::BASE) + 1);
+                scale_ = ContentHash::mulMod(scale_, ContentHash::BASE);
+                runLength++;
+            }
+        }
+    }
+
+    ContentHash operator()(uint64_t first) const {
+        return {ContentHash::reduce(ContentHash::mulMod(ContentHash::reduce(first), geometric_) + ramp_), scale_};
+    }
+};
+
+inline ContentHash hashSequence(uint64_t first, size_t length) { return SequenceHash(length)(first); }
+
+/**
+ * Hash cached by a node when it is made const, with the same copy semantics as CachedSummary. A zero scale marks it
+ * empty, so the cache costs no more than the hash. Disabled caches take no space.
+ */
+template<bool ENABLED>
+class CachedHash {
+    ContentHash hash_{0, 0};
+public:
+    CachedHash() = default;
+
+    CachedHash(const CachedHash &) {}
+
+    CachedHash(CachedHash &&) = default;
+
+    CachedHash &operator=(const CachedHash &) {
+        reset();
+        return *this;
+    }
+
+    CachedHash &operator=(CachedHash &&) = default;
+
+    void set(const ContentHash &hash) { hash_ = hash; }
+
+    void reset() { hash_.scale = 0; }
+
+    const ContentHash *get() const { return hash_.scale ? &hash_ : nullptr; }
+};
+
+template<>
+class CachedHash<false> {
+public:
+    void set(const ContentHash &hash) {}
+
+    void reset() {}
+
+    const ContentHash *get() const { return nullptr; }
+};
+
+#endif //EXPERIMENTS_CONTENTHASH_H
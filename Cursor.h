@@ -0,0 +1,164 @@
+#ifndef EXPERIMENTS_CURSOR_H
+#define EXPERIMENTS_CURSOR_H
+
+#include "Builder.h"
+
+#include <vector>
+
+/**
+ * Finger into a tree: keeps the root to leaf path of the current position, so moving only climbs up to the lowest
+ * node covering both the old and the new position before descending again. Sequential scans cost O(1) amortized per
+ * element and jumps over k elements O(log k) instead of a full descent from the root. The cursor reads the nodes in
+ * place, any mutation of the tree invalidates it.
+ */
+template<class T, size_t MAX_COUNT, size_t SIZE, template<class, size_t> class ADAPTER>
+class Cursor {
+public:
+    using BuilderT = Builder<T, MAX_COUNT, SIZE, ADAPTER>;
+    using LeafT = typename BuilderT::LeafT;
+    using BNodeT = typename BuilderT::BNodeT;
+    using ANodeT = typename BuilderT::ANodeT;
+    using VarType = typename BuilderT::VarType;
+
+private:
+    /**
+     * Internal node of the path, covering [begin, end) of the tree: tree position p is position
+     * localBegin + p - begin of the node
+     */
+    struct Frame {
+        const void *node;
+        bool isANode;
+        size_t begin;
+        size_t end;
+        size_t localBegin;
+    };
+
+    std::vector<Frame> path_;
+    const LeafT *leaf_ = nullptr;
+    size_t leafBegin_ = 0;
+    size_t leafEnd_ = 0;
+    size_t leafLocalBegin_ = 0;
+    size_t position_ = 0;
+    size_t size_ = 0;
+
+    template<class Visitor>
+    static decltype(auto) visitFrame(const Frame &frame, Visitor &&visitor) {
+        if (frame.isANode) {
+            return visitor(*static_cast<const ANodeT *>(frame.node));
+        }
+        return visitor(*static_cast<const BNodeT *>(frame.node));
+    }
+
+    /**
+     * @return true when node is a leaf, i.e. the descent is over
+     */
+    template<class NODE>
+    bool enter(const NODE &node, size_t begin, size_t end, size_t localBegin) {
+        if constexpr (std::is_same_v<NODE, LeafT>) {
+            leaf_ = &node;
+            leafBegin_ = begin;
+            leafEnd_ = end;
+            leafLocalBegin_ = localBegin;
+            return true;
+        } else {
+            path_.push_back({&node, std::is_same_v<NODE, ANodeT>, begin, end, localBegin});
+            return false;
+        }
+    }
+
+    void descend() {
+        bool reachedLeaf = false;
+        while (!reachedLeaf) {
+            Frame frame = path_.back();
+            size_t frameLocalEnd = frame.localBegin + frame.end - frame.begin;
+            reachedLeaf = visitFrame(frame, [&](const auto &node) {
+                return node.visitChildAt([&](const auto &child, size_t childBegin, size_t sliceBegin,
+                                             size_t sliceLength) {
+                    //the frame may cover only part of the node (origin of an annotation), so the slice gets clipped
+                    size_t localBegin = std::max(sliceBegin, frame.localBegin);
+                    size_t localEnd = std::min(sliceBegin + sliceLength, frameLocalEnd);
+                    size_t begin = frame.begin + localBegin - frame.localBegin;
+                    return enter(child, begin, begin + localEnd - localBegin, childBegin + localBegin - sliceBegin);
+                }, frame.localBegin + position_ - frame.begin);
+            });
+        }
+    }
+
+public:
+    explicit Cursor(const VarType &root, size_t position = 0) : size_(BNodeT::sizeOf(root)) {
+        if (!size_) {
+            return;
+        }
+        path_.reserve(16);
+        visitConstNode([&](const auto &node) {
+            enter(node, 0, size_, 0);
+        }, root);
+        seek(position);
+    }
+
+    size_t size() const { return size_; }
+
+    size_t position() const { return position_; }
+
+    bool atEnd() const { return position_ >= size_; }
+
+    /**
+     * Positions at or past size() (including moves before the first element) leave the cursor at end
+     */
+    void seek(size_t position) {
+        position_ = position;
+        if (position_ >= size_ || (position_ >= leafBegin_ && position_ < leafEnd_)) {
+            return;
+        }
+        while (path_.size() > 1 && (position_ < path_.back().begin || position_ >= path_.back().end)) {
+            path_.pop_back();
+        }
+        descend();
+    }
+
+    void advance(ptrdiff_t delta) { seek(position_ + delta); }
+
+    Cursor &operator+=(ptrdiff_t delta) {
+        advance(delta);
+        return *this;
+    }
+
+    Cursor &operator-=(ptrdiff_t delta) {
+        advance(-delta);
+        return *this;
+    }
+
+    Cursor &operator++() {
+        if (++position_ >= leafEnd_) {
+            seek(position_);
+        }
+        return *this;
+    }
+
+    Cursor &operator--() {
+        seek(position_ - 1);
+        return *this;
+    }
+
+    const T operator*() const {
+        assert(!atEnd());
+        return leaf_->at(leafOffset());
+    }
+
+    //Current leaf span: [leafOffset(), leafOffset() + spanLength()) of leaf() holds the positions from position() on
+
+    const LeafT &leaf() const { return *leaf_; }
+
+    size_t leafOffset() const { return leafLocalBegin_ + position_ - leafBegin_; }
+
+    size_t spanLength() const { return leafEnd_ - position_; }
+
+    const T *data() const requires LeafT::hasContiguousData { return leaf_->data() + leafOffset(); }
+
+    /**
+     * Moves to the first position after the current leaf span
+     */
+    void nextSpan() { seek(leafEnd_); }
+};
+
+#endif //EXPERIMENTS_CURSOR_H
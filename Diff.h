@@ -0,0 +1,315 @@
+#ifndef EXPERIMENTS_DIFF_H
+#define EXPERIMENTS_DIFF_H
+
+#include "NodeVariant.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * One difference between two versions of a tree: [oldOffset, oldOffset + oldLength) of the old version became
+ * [newOffset, newOffset + newLength) of the new one. Between two changes both versions read the same nodes.
+ */
+struct TreeChange {
+    size_t oldOffset = 0;
+    size_t oldLength = 0;
+    size_t newOffset = 0;
+    size_t newLength = 0;
+
+    friend bool operator==(const TreeChange &, const TreeChange &) = default;
+};
+
+namespace diff_internal {
+
+    template<class LEAF, class ANODE, class BNODE>
+    class TreeDiff {
+        enum class Kind {
+            Leaf, ANode, BNode
+        };
+
+        /**
+         * [begin, begin + length) of a node, begin being a position of the node itself
+         */
+        struct Piece {
+            const void *node;
+            Kind kind;
+            int8_t height;
+            size_t begin;
+            size_t length;
+        };
+
+        /**
+         * Pieces covering what is left of one version, in order. Only the pieces near the front get opened, so the ones
+         * further away are the siblings of the paths to them: O(MAX_COUNT * height) pieces as long as both versions
+         * line up
+         */
+        class Frontier {
+            std::deque<Piece> pieces_;
+
+            template<class NODE>
+            static Piece pieceOf(const NODE &node, size_t begin, size_t length) {
+                Kind kind = std::is_same_v<NODE, LEAF> ? Kind::Leaf : std::is_same_v<NODE, ANODE> ? Kind::ANode :
+                                                                      Kind::BNode;
+                return {&node, kind, node.height(), begin, length};
+            }
+
+            template<class Visitor>
+            static void visitPiece(const Piece &piece, Visitor &&visitor) {
+                switch (piece.kind) {
+                    case Kind::ANode:
+                        visitor(*static_cast<const ANODE *>(piece.node));
+                        break;
+                    case Kind::BNode:
+                        visitor(*static_cast<const BNODE *>(piece.node));
+                        break;
+                    default:
+                        break;
+                }
+            }
+
+        public:
+            explicit Frontier(const NodeVariant<LEAF, ANODE, BNODE> &root) {
+                if (root) {
+                    visitConstNode([&](const auto &node) {
+                        pieces_.push_back(pieceOf(node, 0, node.size()));
+                    }, root);
+                }
+            }
+
+            bool empty() const { return pieces_.empty(); }
+
+            size_t size() const { return pieces_.size(); }
+
+            const Piece &operator[](size_t pos) const { return pieces_[pos]; }
+
+            /**
+             * Replaces the internal node at pos with the slices of its children it covers
+             * @return the position following the children
+             */
+            size_t expand(size_t pos) {
+                Piece piece = pieces_[pos];
+                pieces_.erase(pieces_.begin() + pos);
+                visitPiece(piece, [&](const auto &node) {
+                    node.forEachChild([&](const auto &childPtr, size_t childOffset, size_t childLength) {
+                        pieces_.insert(pieces_.begin() + pos++, pieceOf(*childPtr, childOffset, childLength));
+                    }, piece.begin, piece.length, false);
+                });
+                return pos;
+            }
+
+            /**
+             * Calls visitor(pos) for the internal nodes starting less than limit positions away from the front, except
+             * for the ones the other version holds too: their descendants are shared just as well
+             */
+            template<class Visitor>
+            void forEachUnshared(size_t limit, const std::unordered_map<const void *, size_t> &shared,
+                                 Visitor &&visitor) const {
+                size_t offset = 0;
+                for (size_t pos = 0; pos < pieces_.size() && offset < limit; offset += pieces_[pos++].length) {
+                    if (pieces_[pos].height && !shared.contains(pieces_[pos].node)) {
+                        visitor(pos);
+                    }
+                }
+            }
+
+            /**
+             * @return the height of the tallest node forEachUnshared visits, 0 when there is none
+             */
+            int8_t tallestUnshared(size_t limit, const std::unordered_map<const void *, size_t> &shared) const {
+                int8_t result = 0;
+                forEachUnshared(limit, shared, [&](size_t pos) {
+                    result = std::max(result, pieces_[pos].height);
+                });
+                return result;
+            }
+
+            /**
+             * Opens the nodes of the given height forEachUnshared visits
+             */
+            void expandUnshared(size_t limit, const std::unordered_map<const void *, size_t> &shared, int8_t height) {
+                std::vector<size_t> positions;
+                forEachUnshared(limit, shared, [&](size_t pos) {
+                    if (pieces_[pos].height == height) {
+                        positions.push_back(pos);
+                    }
+                });
+                //from the back, so that the positions still ahead stay valid
+                for (auto it = positions.rbegin(); it != positions.rend(); ++it) {
+                    expand(*it);
+                }
+            }
+
+            /**
+             * The nodes of the pieces, each with the offset of its first piece
+             */
+            std::unordered_map<const void *, size_t> offsets() const {
+                std::unordered_map<const void *, size_t> result;
+                size_t offset = 0;
+                for (const auto &piece: pieces_) {
+                    result.try_emplace(piece.node, offset);
+                    offset += piece.length;
+                }
+                return result;
+            }
+
+            /**
+             * Drops the first length positions, which may end inside a piece
+             */
+            void consume(size_t length) {
+                while (length) {
+                    Piece &front = pieces_.front();
+                    size_t consumed = std::min(length, front.length);
+                    front.begin += consumed;
+                    front.length -= consumed;
+                    length -= consumed;
+                    if (!front.length) {
+                        pieces_.pop_front();
+                    }
+                }
+            }
+
+            bool hasInternalNodes() const {
+                return std::any_of(pieces_.begin(), pieces_.end(), [](const Piece &piece) { return piece.height; });
+            }
+
+            size_t remaining() const {
+                size_t result = 0;
+                for (const auto &piece: pieces_) {
+                    result += piece.length;
+                }
+                return result;
+            }
+        };
+
+        Frontier old_;
+        Frontier new_;
+        size_t oldPos_ = 0;
+        size_t newPos_ = 0;
+        std::vector<TreeChange> changes_;
+
+        void changed(size_t oldLength, size_t newLength) {
+            if (!oldLength && !newLength) {
+                //opening the fronts made them meet right away
+                return;
+            }
+            if (!changes_.empty() && changes_.back().oldOffset + changes_.back().oldLength == oldPos_ &&
+                changes_.back().newOffset + changes_.back().newLength == newPos_) {
+                changes_.back().oldLength += oldLength;
+                changes_.back().newLength += newLength;
+            } else {
+                changes_.push_back({oldPos_, oldLength, newPos_, newLength});
+            }
+            old_.consume(oldLength);
+            new_.consume(newLength);
+            oldPos_ += oldLength;
+            newPos_ += newLength;
+        }
+
+        void same(size_t length) {
+            old_.consume(length);
+            new_.consume(length);
+            oldPos_ += length;
+            newPos_ += length;
+        }
+
+        /**
+         * Cheapest way for the versions to meet again: a node present in both frontiers, reached by skipping the
+         * fewest positions overall
+         * @return the positions to skip in the old and the new version, none when no node is shared
+         */
+        std::optional<std::pair<size_t, size_t>> closestCommonNode(
+                const std::unordered_map<const void *, size_t> &oldOffsets) const {
+            std::optional<std::pair<size_t, size_t>> best;
+            size_t offset = 0;
+            for (size_t pos = 0; pos < new_.size(); offset += new_[pos++].length) {
+                if (best && offset >= best->first + best->second) {
+                    break;
+                }
+                auto it = oldOffsets.find(new_[pos].node);
+                if (it != oldOffsets.end() && (!best || it->second + offset < best->first + best->second)) {
+                    best = {it->second, offset};
+                }
+            }
+            return best;
+        }
+
+        /**
+         * The fronts differ: opens the nodes closer than the best meeting point found so far, as some of their
+         * descendants may meet earlier, then skips to the best one. Nodes held by both versions stay closed and the
+         * tallest ones get opened first, so that both sides go down level by level and only the paths to the seams
+         * get opened. While there is no meeting point at all, the nodes get opened within a reach doubling at each
+         * round, so the work stays proportional to the positions skipped plus the frontier rather than to the size of
+         * the versions.
+         */
+        void resync() {
+            size_t reach = 1;
+            while (true) {
+                auto oldOffsets = old_.offsets();
+                auto newOffsets = new_.offsets();
+                auto best = closestCommonNode(oldOffsets);
+                size_t limit = best ? best->first + best->second : reach;
+                int8_t height = std::max(old_.tallestUnshared(limit, newOffsets),
+                                         new_.tallestUnshared(limit, oldOffsets));
+                if (height) {
+                    old_.expandUnshared(limit, newOffsets, height);
+                    new_.expandUnshared(limit, oldOffsets, height);
+                } else if (best || (!old_.hasInternalNodes() && !new_.hasInternalNodes())) {
+                    if (best) {
+                        changed(best->first, best->second);
+                    } else {
+                        changed(old_.remaining(), new_.remaining());
+                    }
+                    return;
+                }
+                reach *= 2;
+            }
+        }
+
+        void step() {
+            const Piece &oldFront = old_[0];
+            const Piece &newFront = new_[0];
+            if (oldFront.node != newFront.node) {
+                resync();
+            } else if (oldFront.begin == newFront.begin) {
+                same(std::min(oldFront.length, newFront.length));
+            } else if (oldFront.begin < newFront.begin) {
+                //the same node read from different positions: only the common part lines up
+                changed(std::min(newFront.begin - oldFront.begin, oldFront.length), 0);
+            } else {
+                changed(0, std::min(oldFront.begin - newFront.begin, newFront.length));
+            }
+        }
+
+    public:
+        TreeDiff(const NodeVariant<LEAF, ANODE, BNODE> &oldRoot, const NodeVariant<LEAF, ANODE, BNODE> &newRoot) :
+                old_(oldRoot), new_(newRoot) {}
+
+        std::vector<TreeChange> run() {
+            while (!old_.empty() && !new_.empty()) {
+                step();
+            }
+            if (!old_.empty() || !new_.empty()) {
+                changed(old_.remaining(), new_.remaining());
+            }
+            return std::move(changes_);
+        }
+    };
+}
+
+/**
+ * The position ranges that differ between two versions of a tree, in increasing order. Both trees are walked in
+ * lockstep and nodes shared by the two versions are skipped whole by pointer equality, so the cost is
+ * O(changes * MAX_COUNT * log(n)) for versions derived from one another (inserts, updates, erases, moves) rather than
+ * O(n). Equality is by node identity only: equal values held by different nodes are reported as changed.
+ */
+template<class LEAF, class ANODE, class BNODE>
+std::vector<TreeChange> diff(const NodeVariant<LEAF, ANODE, BNODE> &oldRoot,
+                             const NodeVariant<LEAF, ANODE, BNODE> &newRoot) {
+    return diff_internal::TreeDiff<LEAF, ANODE, BNODE>(oldRoot, newRoot).run();
+}
+
+#endif //EXPERIMENTS_DIFF_H
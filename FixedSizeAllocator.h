@@ -8,11 +8,17 @@
 #define STACK_LIMIT 1024
 #define ALL_ONES_64 (~uint64_t(0))
 
+#include <algorithm>
 #include <cstddef>
 #include <array>
+#include <atomic>
 #include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <iostream>
 #include <unordered_set>
+#include <vector>
 #include <strings.h>
 
 inline bool allocInfoPrint = false;
@@ -49,6 +55,9 @@ public:
         return !mask;
     }
 
+    /**
+     * Not synchronized, only exact while no other thread allocates or frees
+     */
     size_t allocatedCount() {
         return __builtin_popcountll(~mask);
     }
@@ -63,11 +72,62 @@ public:
 template<class T, size_t Size>
 class StdFixedSizeArrayAllocator;
 
+/**
+ * Test and test-and-set lock: the sections it guards are a handful of bit operations, so waiters spin, yielding in case
+ * the holder got preempted
+ */
+class SpinLock {
+    std::atomic_flag flag_ = ATOMIC_FLAG_INIT;
+public:
+    void lock() {
+        while (flag_.test_and_set(std::memory_order_acquire)) {
+            while (flag_.test(std::memory_order_relaxed)) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void unlock() { flag_.clear(std::memory_order_release); }
+};
+
 template<size_t SIZE>
 class FixedSizeAllocator {
 
     using BlockType = Block<SIZE>;
 
+    /**
+     * Slots moved between a thread cache and the shared pool per lock taken
+     */
+    static constexpr size_t CACHE_BATCH = 64;
+
+    /**
+     * Free slots a thread allocates from and frees to without taking lock_. An empty cache gets refilled with a batch
+     * from the shared pool, one holding more than two batches hands its oldest one back, so a slot freed by another
+     * thread than the one that allocated it just joins the cache of the freeing thread and reaches the others through
+     * the pool. The cache registers with the allocator on first use and gives all of its slots back when its thread
+     * exits.
+     */
+    struct ThreadCache {
+        std::vector<void *> slots;
+        bool registered = false;
+
+        ~ThreadCache() {
+            cacheGone_ = true;
+            if (registered) {
+                oneAndOnly().releaseCache(*this);
+            }
+        }
+    };
+
+    //trivially destructible, so it stays readable after the cache got destroyed: frees from destructors running after
+    //the thread_local ones at thread exit go straight to the shared pool
+    static inline thread_local bool cacheGone_ = false;
+
+    static ThreadCache &threadCache() {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
     std::deque<std::unique_ptr<Block<SIZE>>> blocks_ = std::deque<std::unique_ptr<Block<SIZE>>>(64);
 
     std::deque<void *> leafQueue_;
@@ -76,6 +136,10 @@ class FixedSizeAllocator {
 #ifdef  DEBUG
     std::unordered_set<void*> allocatedPointers_;
 #endif
+    //the pools are process wide, trees get built from several threads at once (see Builder::parallelBulkLoad). The
+    //lock only guards the shared pool and caches_, every thread allocates and frees through its own ThreadCache
+    SpinLock lock_;
+    std::vector<ThreadCache *> caches_;
 
     FixedSizeAllocator() {
         for (auto &&deque : treeLevels_) {
@@ -104,23 +168,73 @@ public:
     }
 
     void *alloc() {
-        //assert(allocatedPointers_.size() == allocatedCount());
         if (allocInfoPrint && SIZE != 32) {
             std::cout << "Alloc<" << SIZE << ">" << std::endl;
         }
+        void *result;
+        if (cacheGone_) {
+            std::lock_guard<SpinLock> guard(lock_);
+            result = allocUnlocked();
+        } else {
+            auto &cache = threadCache();
+            if (cache.slots.empty()) {
+                refill(cache);
+            }
+            result = cache.slots.back();
+            cache.slots.pop_back();
+        }
+#ifdef DEBUG
+        std::lock_guard<SpinLock> guard(lock_);
+        if (allocatedPointers_.find(result) != allocatedPointers_.end()) {
+            std::cout << "Busted" << std::endl;
+        }
+        allocatedPointers_.insert(result);
+#endif
+        return result;
+    }
+
+private:
+    void registerCache(ThreadCache &cache) {
+        if (!cache.registered) {
+            caches_.push_back(&cache);
+            cache.registered = true;
+        }
+    }
+
+    void refill(ThreadCache &cache) {
+        std::lock_guard<SpinLock> guard(lock_);
+        registerCache(cache);
+        //the cache pops from the back, which gets the first slot so fresh blocks still get handed out in address order
+        cache.slots.resize(CACHE_BATCH);
+        for (size_t i = CACHE_BATCH; i-- > 0;) {
+            cache.slots[i] = allocUnlocked();
+        }
+    }
+
+    /**
+     * Hands the oldest count slots of cache back to the shared pool, lock_ held
+     */
+    void drainUnlocked(ThreadCache &cache, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            leafQueue_.push_back(cache.slots[i]);
+        }
+        cache.slots.erase(cache.slots.begin(), cache.slots.begin() + count);
+        while (leafQueue_.size() > STACK_LIMIT) {
+            freeInternal();
+        }
+    }
+
+    void releaseCache(ThreadCache &cache) {
+        std::lock_guard<SpinLock> guard(lock_);
+        drainUnlocked(cache, cache.slots.size());
+        caches_.erase(std::find(caches_.begin(), caches_.end(), &cache));
+        cache.registered = false;
+    }
+
+    void *allocUnlocked() {
         if (!leafQueue_.empty()) {
             auto result = leafQueue_.back();
             leafQueue_.pop_back();
-            //std::cout<<size_t(result) <<" "<<SIZE<<std::endl;
-#ifdef DEBUG
-            if (allocatedPointers_.find(result) != allocatedPointers_.end()) {
-                auto properCount = allocatedPointers_;
-                auto measuredCount = allocatedCount();
-                std::cout << "Busted" << std::endl;
-            }
-            allocatedPointers_.insert(result);
-#endif
-            //assert(allocatedPointers_.size() == allocatedCount());
             return result;
         }
         BlockType *targetBlock;
@@ -156,24 +270,11 @@ public:
             ensureSpace(0, currentRoots_[0]);
             treeLevels_[0][currentRoots_[0]] |= bitInParent;
         }
-        //std::cout<<size_t(result) <<" "<<SIZE<<" "<<blockPos<<std::endl;
-#ifdef DEBUG
-        if (allocatedPointers_.find(result) != allocatedPointers_.end()) {
-            auto properCount = allocatedPointers_.size();
-            auto measuredCount = allocatedCount();
-            std::cout << "Busted" << std::endl;
-        }
-        allocatedPointers_.insert(result);
-#endif
-     /*   if (allocatedPointers_.size() != allocatedCount()) {
-            auto properCount = allocatedPointers_.size();
-            auto measuredCount = allocatedCount();
-            std::cout << "Busted" << std::endl;
-        }*/
-        //assert(allocatedPointers_.size() == allocatedCount());
         return result;
     }
 
+public:
+
     uint64_t getBlockPos() {//go up the roots as long as they are full
         BlockType *targetBlock;
         uint8_t level = 0;
@@ -195,19 +296,32 @@ public:
     }
 
     void free(void *toRelease) {
-        //std::cout<<"Free:"<<size_t(toRelease) <<" "<<SIZE<<std::endl;
         if (toRelease == nullptr) {
             std::cout << "Busted" << std::endl;
         }
 #ifdef DEBUG
-        if (allocatedPointers_.find(toRelease) == allocatedPointers_.end()) {
-            std::cout << "Busted" << std::endl;
+        {
+            std::lock_guard<SpinLock> guard(lock_);
+            if (allocatedPointers_.find(toRelease) == allocatedPointers_.end()) {
+                std::cout << "Busted" << std::endl;
+            }
+            allocatedPointers_.erase(toRelease);
         }
-        allocatedPointers_.erase(toRelease);
 #endif
-        leafQueue_.push_back(toRelease);
-        while (leafQueue_.size() > STACK_LIMIT) {
-            freeInternal();
+        if (cacheGone_) {
+            std::lock_guard<SpinLock> guard(lock_);
+            leafQueue_.push_back(toRelease);
+            while (leafQueue_.size() > STACK_LIMIT) {
+                freeInternal();
+            }
+            return;
+        }
+        auto &cache = threadCache();
+        cache.slots.push_back(toRelease);
+        if (!cache.registered || cache.slots.size() > 2 * CACHE_BATCH) {
+            std::lock_guard<SpinLock> guard(lock_);
+            registerCache(cache);
+            drainUnlocked(cache, cache.slots.size() > 2 * CACHE_BATCH ? CACHE_BATCH : 0);
         }
     }
 
@@ -233,17 +347,56 @@ public:
         }
     }
 
+    /**
+     * Slots handed out and not freed yet, the ones sitting in thread caches count as free. Only exact while no other
+     * thread allocates or frees.
+     */
     size_t allocatedCount() {
+        std::lock_guard<SpinLock> guard(lock_);
         size_t result = 0;
         for (const auto &block : blocks_) {
             if (block != nullptr) {
                 result += block->allocatedCount();
             }
         }
+        for (const ThreadCache *cache: caches_) {
+            result -= cache->slots.size();
+        }
         return result - leafQueue_.size();
     }
 
     void reset() {
+        std::lock_guard<SpinLock> guard(lock_);
+        resetUnlocked();
+    }
+
+    void prefetch(size_t slotsCount,bool resetFirst = true) {
+        std::lock_guard<SpinLock> guard(lock_);
+        if (resetFirst) {
+            resetUnlocked();
+        }
+        if (slotsCount > blocks_.size() << 6) {
+            blocks_.resize((slotsCount >> 6) + 1);
+        }
+        for (auto &&block : blocks_) {
+            if (block == nullptr) {
+                block = std::make_unique<BlockType>();
+                block->prefetch();
+            }
+        }
+    }
+
+    uint64_t extractBitInParent(uint64_t id) const { return uint64_t(1) << (id & ((1u << 6u) - 1u)); }
+
+private:
+    /**
+     * Takes the slots of every thread cache back too, so like the rest of the reset it needs the other threads to
+     * stay off the allocator meanwhile
+     */
+    void resetUnlocked() {
+        for (ThreadCache *cache: caches_) {
+            drainUnlocked(*cache, cache->slots.size());
+        }
         while (!leafQueue_.empty()) {
             freeInternal();
         }
@@ -262,23 +415,6 @@ public:
         currentRoots_.fill(0);
 
     }
-
-    void prefetch(size_t slotsCount,bool resetFirst = true) {
-        if (resetFirst) {
-            reset();
-        }
-        if (slotsCount > blocks_.size() << 6) {
-            blocks_.resize((slotsCount >> 6) + 1);
-        }
-        for (auto &&block : blocks_) {
-            if (block == nullptr) {
-                block = std::make_unique<BlockType>();
-                block->prefetch();
-            }
-        }
-    }
-
-    uint64_t extractBitInParent(uint64_t id) const { return uint64_t(1) << (id & ((1u << 6u) - 1u)); }
 };
 
 inline constexpr size_t normalizedSize(size_t size) {
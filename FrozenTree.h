@@ -0,0 +1,184 @@
+#ifndef EXPERIMENTS_FROZENTREE_H
+#define EXPERIMENTS_FROZENTREE_H
+
+#include "NodeVariant.h"
+#include "Search.h"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * Read only copy of a const tree laid out for seeks, meant for trees that are read far more often than they change
+ * (e.g. the index of a published data frame). The leaves are shared with the source tree, the internal nodes are
+ * replaced by the start positions of the leaf pieces in a static B+ tree: blocks of BLOCK_KEYS separators (one cache
+ * line), stored level by level from the root down in a single array, the children of block k of a level being blocks
+ * k * (BLOCK_KEYS + 1) to k * (BLOCK_KEYS + 1) + BLOCK_KEYS of the level below. There is no child pointer to follow, a
+ * seek reads one cache line per level and ranks the position within it with vector compares, then reads the piece.
+ * The bottom level holds the starts of all the pieces in order, so scans walk the pieces sequentially.
+ *
+ * KEY is the separator type: 32 bit keys fit twice as many separators per line, which takes trees below 2^32
+ * positions.
+ */
+template<class LEAF, class KEY = uint32_t>
+class FrozenTree {
+public:
+    static constexpr size_t BLOCK_KEYS = 64 / sizeof(KEY);
+
+private:
+    static constexpr KEY NO_KEY = std::numeric_limits<KEY>::max();
+
+    struct alignas(64) Block {
+        KEY keys[BLOCK_KEYS];
+    };
+
+    /**
+     * [offset, offset + length of the piece) of a leaf, the length following from the start of the next piece
+     */
+    struct Piece {
+        ConstPtr<LEAF> leaf;
+        size_t offset;
+    };
+
+    std::vector<Piece> pieces_;
+    //levels from the root down to the starts of the pieces
+    std::vector<Block> blocks_;
+    //first block of each level, from the bottom level up
+    std::vector<size_t> levels_;
+    size_t size_ = 0;
+    //piece starts, only used while building
+    std::vector<size_t> starts_;
+
+    template<class NODE>
+    void addPieces(const NODE &node, size_t offset, size_t length) {
+        if constexpr (std::is_same_v<NODE, LEAF>) {
+            length = std::min(length, node.size() - offset);
+            if (length) {
+                pieces_.push_back({ConstPtr<LEAF>(&node), offset});
+                starts_.push_back(size_);
+                size_ += length;
+            }
+        } else {
+            node.forEachChildNode([&](const auto &child, size_t childOffset, size_t childLength) {
+                addPieces(child, childOffset, childLength);
+            }, offset, length);
+        }
+    }
+
+    void buildLevels() {
+        if (size_ > NO_KEY) {
+            throw std::logic_error("Tree too large for the separator type");
+        }
+        std::vector<size_t> levelBlocks{std::max<size_t>(1, (pieces_.size() + BLOCK_KEYS - 1) / BLOCK_KEYS)};
+        while (levelBlocks.back() > 1) {
+            levelBlocks.push_back((levelBlocks.back() + BLOCK_KEYS) / (BLOCK_KEYS + 1));
+        }
+        size_t blockCount = 0;
+        levels_.resize(levelBlocks.size());
+        for (size_t level = levelBlocks.size(); level-- > 0;) {
+            levels_[level] = blockCount;
+            blockCount += levelBlocks[level];
+        }
+        blocks_.resize(blockCount);
+
+        //bottom level blocks under a block of the level below the current one
+        size_t span = 1;
+        for (size_t level = 0; level < levelBlocks.size(); level++) {
+            if (level > 1) {
+                span *= BLOCK_KEYS + 1;
+            }
+            Block *levelBlock = blocks_.data() + levels_[level];
+            for (size_t key = 0; key < levelBlocks[level] * BLOCK_KEYS; key++) {
+                size_t firstPiece;
+                if (level == 0) {
+                    firstPiece = key;
+                } else {
+                    //key j of block k separates its children j and j + 1: the first piece under child j + 1
+                    size_t block = key / BLOCK_KEYS;
+                    size_t child = block * (BLOCK_KEYS + 1) + key % BLOCK_KEYS + 1;
+                    firstPiece = child * span * BLOCK_KEYS;
+                }
+                levelBlock[key / BLOCK_KEYS].keys[key % BLOCK_KEYS] =
+                        firstPiece < starts_.size() ? KEY(starts_[firstPiece]) : NO_KEY;
+            }
+        }
+        starts_.clear();
+        starts_.shrink_to_fit();
+    }
+
+    size_t pieceStart(size_t piece) const {
+        return blocks_[levels_[0] + piece / BLOCK_KEYS].keys[piece % BLOCK_KEYS];
+    }
+
+    size_t pieceEnd(size_t piece) const { return piece + 1 < pieces_.size() ? pieceStart(piece + 1) : size_; }
+
+    /**
+     * @return the piece holding pos, which must be below size()
+     */
+    size_t pieceAt(size_t pos) const {
+        KEY bound = KEY(pos + 1);
+        size_t block = 0;
+        for (size_t level = levels_.size() - 1; level > 0; level--) {
+            size_t rank = search_internal::countLessLanes<BLOCK_KEYS>(blocks_[levels_[level] + block].keys,
+                                                                        BLOCK_KEYS, bound);
+            block = block * (BLOCK_KEYS + 1) + rank;
+        }
+        return block * BLOCK_KEYS + search_internal::countLessLanes<BLOCK_KEYS>(blocks_[levels_[0] + block].keys,
+                                                                                BLOCK_KEYS, bound) - 1;
+    }
+
+public:
+    template<class ANODE, class BNODE>
+    explicit FrozenTree(const NodeVariant<LEAF, ANODE, BNODE> &root) {
+        if (root) {
+            visitConstNode([&](const auto &node) {
+                addPieces(node, 0, node.size());
+            }, root);
+        }
+        buildLevels();
+    }
+
+    size_t size() const { return size_; }
+
+    /**
+     * Number of leaf pieces, i.e. of leaves plus the extra slices annotations take of them
+     */
+    size_t pieceCount() const { return pieces_.size(); }
+
+    auto operator[](size_t pos) const {
+        size_t piece = pieceAt(pos);
+        return pieces_[piece].leaf->at(pieces_[piece].offset + pos - pieceStart(piece));
+    }
+
+    /**
+     * Visits (leaf, offset, length) for every leaf piece of [offset, offset + length), the same way as
+     * Builder::forEachLeaf: one seek, then the pieces in order
+     */
+    template<class Visitor>
+    void forEachLeaf(Visitor &&visitor, size_t offset, size_t length) const {
+        if (offset >= size_) {
+            return;
+        }
+        length = std::min(length, size_ - offset);
+        for (size_t piece = pieceAt(offset); length; piece++) {
+            size_t localOffset = offset - pieceStart(piece);
+            size_t localLength = std::min(length, pieceEnd(piece) - offset);
+            visitor(*pieces_[piece].leaf, pieces_[piece].offset + localOffset, localLength);
+            offset += localLength;
+            length -= localLength;
+        }
+    }
+};
+
+/**
+ * Frozen copy of a const tree (see FrozenTree), built in O(leaves). The source tree is not changed and can be
+ * released, the frozen one keeps the leaves alive.
+ * @throws std::logic_error when the tree has more positions than KEY can tell apart
+ */
+template<class KEY = uint32_t, class LEAF, class ANODE, class BNODE>
+FrozenTree<LEAF, KEY> freeze(const NodeVariant<LEAF, ANODE, BNODE> &root) {
+    return FrozenTree<LEAF, KEY>(root);
+}
+
+#endif //EXPERIMENTS_FROZENTREE_H
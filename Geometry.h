@@ -0,0 +1,47 @@
+#ifndef EXPERIMENTS_GEOMETRY_H
+#define EXPERIMENTS_GEOMETRY_H
+
+#include <cstddef>
+#include "BuilderFwd.h"
+
+/**
+ * Node geometry as a single policy type: MAX_COUNT children per internal node and SIZE values per leaf. An internal
+ * node costs about 16 bytes per child (the tagged child pointer and its cumulative size), so MAX_COUNT decides how many
+ * cache lines a descent reads per level, while SIZE decides how long the contiguous scans between two descents are.
+ */
+template<size_t MAX_COUNT_, size_t SIZE_>
+struct Geometry {
+    static constexpr size_t MAX_COUNT = MAX_COUNT_;
+    static constexpr size_t SIZE = SIZE_;
+
+    /**
+     * Same fan-out with another leaf size, for adapters where the leaf size is fixed elsewhere (e.g. IndexAdapter,
+     * whose leaves map whole space blocks)
+     */
+    template<size_t OTHER_SIZE>
+    using WithSize = Geometry<MAX_COUNT, OTHER_SIZE>;
+};
+
+namespace geometry {
+    /**
+     * 256 byte internal nodes (4 cache lines) and 512 byte leaves of 8 byte values: a lookup touches few lines per
+     * level and the whole path of a small tree stays in L1
+     */
+    using L1 = Geometry<16, 64>;
+
+    /**
+     * 1 KiB internal nodes and 2 KiB leaves of 8 byte values: shallower trees whose upper levels stay in L2
+     */
+    using L2 = Geometry<64, 256>;
+
+    /**
+     * Internal nodes and 8 byte value leaves of one 4 KiB page each, so every level of a descent costs a single TLB
+     * entry
+     */
+    using TLB = Geometry<256, 512>;
+}
+
+template<class T, class GEOMETRY, template<class, size_t> class ADAPTER = ArrayAdapter>
+using GeometryBuilder = Builder<T, GEOMETRY::MAX_COUNT, GEOMETRY::SIZE, ADAPTER>;
+
+#endif //EXPERIMENTS_GEOMETRY_H
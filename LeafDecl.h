@@ -7,10 +7,13 @@
 #include "FixedSizeAllocator.h"
 #include "FixedSizeArrayAllocator.h"
 #include "AllocatorHelpers.h"
+#include "ConstPtr.h"
 #include "ArrayAdapter.h"
+#include "Reduce.h"
+#include "ContentHash.h"
 
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
-class Leaf {
+class Leaf : public RefCounted {
 
     using Adapter = ADAPTER<T, SIZE>;
 
@@ -23,14 +26,15 @@ class Leaf {
 
     using LeafDeleter = DeleterForFixedAllocator<Leaf>;
     using LeafPtr = std::unique_ptr<Leaf, LeafDeleter>;
-    using LeafCPtr = std::shared_ptr<Leaf>;
+    using LeafCPtr = ConstPtr<Leaf>;
 
 
     VarType leaf_;
     size_t offset_;
     size_t length_;
     size_t capacity_;
-
+    [[no_unique_address]] CachedSummary<T, Adapter::CACHES_SUMMARY> summary_;
+    [[no_unique_address]] CachedHash<Adapter::HASHES_CONTENT> hash_;
 
 
 public:
@@ -55,7 +59,9 @@ public:
     Leaf(Leaf &&srcLeaf) : leaf_(std::move(srcLeaf.leaf_)),
                                  offset_(srcLeaf.offset_),
                                  length_(srcLeaf.length_),
-                                 capacity_(srcLeaf.capacity_) {}
+                                 capacity_(srcLeaf.capacity_),
+                                 summary_(std::move(srcLeaf.summary_)),
+                                 hash_(std::move(srcLeaf.hash_)) {}
 
     //explicit Leaf() : Leaf(ArrayPtr(alloc.allocate(1), Deleter()), 0, 0, SIZE) {}
 
@@ -67,7 +73,11 @@ public:
 
     const T operator[](size_t pos) const { return at(pos); }
 
-    void setAt(size_t pos, const T &value) { Adapter::setAt(leaf_, offset_ + pos, value); }
+    void setAt(size_t pos, const T &value) {
+        summary_.reset();
+        hash_.reset();
+        Adapter::setAt(leaf_, offset_ + pos, value);
+    }
 
     void
     add(const Leaf &src, size_t offset = 0, size_t len = std::numeric_limits<size_t>::max(), bool asPrefix = false);
@@ -82,6 +92,14 @@ public:
 
     void makeConst();
 
+    /**
+     * Drops the summary and hash cached by makeConst, the leaf being reopened in place (see ConstPtr::takeExclusive)
+     */
+    void thaw() {
+        summary_.reset();
+        hash_.reset();
+    }
+
     void makeSeamConst(bool onFront) {};//nothing since the leaf doesn't have seams;
 
     bool isMutable() const { return Adapter::isMutable(leaf_); }
@@ -98,6 +116,54 @@ public:
 
     size_t fillLeaf(T *destLeaf, size_t offset, size_t length) const;
 
+    /**
+     * True when the adapter keeps the values in an actual array, in which case data() exposes them without copies
+     */
+    static constexpr bool hasContiguousData = requires(const VarType &leaf) { Adapter::constArray(leaf); };
+
+    const T *data() const requires hasContiguousData { return Adapter::constArray(leaf_) + offset_; }
+
+    /**
+     * True when the adapter hashes a range of values without materializing them (see IndexAdapter::contentHash)
+     */
+    static constexpr bool hasHashedRanges = requires(const VarType &leaf) { Adapter::contentHash(leaf, 0, 0); };
+
+    /**
+     * Requests the header read on the way to the values (leaf_ and offset_), the node counterpart of prefetchSearch
+     */
+    void prefetchSearch() const { __builtin_prefetch(this); }
+
+    void prefetchWalk() const { prefetchSearch(); }
+
+    /**
+     * Requests the first cache line of the values ahead of a read, no-op for adapters without a plain array
+     */
+    void prefetchData() const {
+        if constexpr (hasContiguousData) {
+            __builtin_prefetch(data());
+        }
+    }
+
+    /**
+     * Visits the memory held by the values as (address, bytes, useCount, isControlBlock), see the adapters
+     */
+    template<class Visitor>
+    void forEachAllocation(Visitor &&visitor) const { Adapter::forEachAllocation(leaf_, visitor); }
+
+    Summary<T> summarize(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+    /**
+     * @return the summary computed by makeConst or null if caching is disabled or the leaf changed since
+     */
+    const Summary<T> *cachedSummary() const { return summary_.get(); }
+
+    ContentHash contentHash(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+    /**
+     * @return the hash computed by makeConst or null if hashing is disabled or the leaf changed since
+     */
+    const ContentHash *cachedHash() const { return hash_.get(); }
+
     size_t setValues(const T *srcLeaf, size_t offset, size_t length);
 
     static auto createLeafPtr(const Leaf &src) -> LeafPtr;
@@ -107,6 +173,8 @@ public:
     static auto createLeafCPtr(Leaf &&src) -> LeafCPtr;
 
     int8_t height() const { return 0; }
+
+    int8_t annotationDepth() const { return 0; }
 };
 
 #endif //EXPERIMENTS_LEAFDECL_H
@@ -6,6 +6,8 @@
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
 void Leaf<T, SIZE, ADAPTER>::add(const T *source, size_t length, bool asPrefix /*= false*/) {//TODO update mirror
     assert(length + length_ <= capacity_);
+    summary_.reset();
+    hash_.reset();
     if (asPrefix) {
         if (length > offset_) {
             Adapter::shiftData(leaf_, offset_, length, length_);
@@ -27,6 +29,8 @@ template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
 void Leaf<T, SIZE, ADAPTER>::add(const Leaf &src, size_t offset, size_t length, bool asPrefix /*= false*/) {
     offset = std::min(offset, src.length_);
     length = std::min(length, src.length_ - offset);
+    summary_.reset();
+    hash_.reset();
 
 //    static void copy(DeclaredType &dest, size_t destOffset, const DeclaredType &src, size_t srcOffset, size_t length) {
     if (asPrefix) {
@@ -54,12 +58,16 @@ void Leaf<T, SIZE, ADAPTER>::add(const Leaf &src, size_t offset, size_t length,
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
 void Leaf<T, SIZE, ADAPTER>::slice(size_t offset, size_t len) {
     assert(offset_ + offset + len <= offset_ + length_);
+    summary_.reset();
+    hash_.reset();
     offset_ += offset;
     length_ = len;
 }
 
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
 void Leaf<T, SIZE, ADAPTER>::mutate(void* context) {
+    summary_.reset();
+    hash_.reset();
     Adapter::mutate(leaf_,context);
 }
 
@@ -74,6 +82,12 @@ size_t Leaf<T, SIZE, ADAPTER>::available() const {
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
 void Leaf<T, SIZE, ADAPTER>::makeConst() {
     Adapter::makeConst(leaf_);
+    if constexpr (Adapter::CACHES_SUMMARY) {
+        summary_.set(summarize());
+    }
+    if constexpr (Adapter::HASHES_CONTENT) {
+        hash_.set(contentHash());
+    }
 }
 
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
@@ -88,12 +102,59 @@ size_t Leaf<T, SIZE, ADAPTER>::fillLeaf(T *destLeaf, size_t offset, size_t lengt
     return length;
 }
 
+template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
+Summary<T> Leaf<T, SIZE, ADAPTER>::summarize(size_t offset, size_t length) const {
+    if (offset >= length_) {
+        return Summary<T>();
+    }
+    length = std::min(length_ - offset, length);
+    if constexpr (hasContiguousData) {
+        return reduceSpan(data() + offset, length);
+    } else {
+        //Values are computed by the adapter, so they get materialized in chunks first
+        constexpr size_t chunkSize = std::min<size_t>(SIZE, 256);
+        std::array<T, chunkSize> chunk;
+        Summary<T> result;
+        for (size_t pos = 0; pos < length; pos += chunkSize) {
+            size_t chunkLen = std::min(chunkSize, length - pos);
+            Adapter::getValues(chunk.data(), leaf_, offset_ + offset + pos, chunkLen);
+            result += reduceSpan(chunk.data(), chunkLen);
+        }
+        return result;
+    }
+}
+
+template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
+ContentHash Leaf<T, SIZE, ADAPTER>::contentHash(size_t offset, size_t length) const {
+    if (offset >= length_) {
+        return ContentHash();
+    }
+    length = std::min(length_ - offset, length);
+    if constexpr (hasHashedRanges) {
+        return Adapter::contentHash(leaf_, offset_ + offset, length);
+    } else if constexpr (hasContiguousData) {
+        return hashSpan(data() + offset, length);
+    } else {
+        constexpr size_t chunkSize = std::min<size_t>(SIZE, 256);
+        std::array<T, chunkSize> chunk;
+        ContentHash result;
+        for (size_t pos = 0; pos < length; pos += chunkSize) {
+            size_t chunkLen = std::min(chunkSize, length - pos);
+            Adapter::getValues(chunk.data(), leaf_, offset_ + offset + pos, chunkLen);
+            result += hashSpan(chunk.data(), chunkLen);
+        }
+        return result;
+    }
+}
+
 template<class T, size_t SIZE, template<class, size_t> class ADAPTER>
 size_t Leaf<T, SIZE, ADAPTER>::setValues(const T *srcLeaf, size_t offset, size_t length) {
     if (offset > length_) {
         return 0;
     };
     length = std::min(length_ - offset, length);
+    summary_.reset();
+    hash_.reset();
     //(DeclaredType &dest, size_t offset, const T *srcLeaf, size_t length)
     Adapter::setValues(leaf_, offset + offset_, srcLeaf, length);
     return length;
@@ -120,7 +181,7 @@ auto Leaf<T, SIZE, ADAPTER>::createLeafCPtr(Leaf &&src) -> LeafCPtr {
     static auto &alloc = StdFixedAllocator<Leaf>::oneAndOnly();
     auto p = alloc.allocate(1);
     alloc.construct(p, std::move(src));
-    return LeafCPtr(p,LeafDeleter());
+    return LeafCPtr(LeafPtr(p));
 }
 
 #endif //EXPERIMENTS_LEAFIMPL_H
@@ -0,0 +1,205 @@
+#ifndef EXPERIMENTS_MEMORYREPORT_H
+#define EXPERIMENTS_MEMORYREPORT_H
+
+#include "NodeVariant.h"
+
+#include <unordered_map>
+#include <vector>
+
+struct MemoryUsage {
+    size_t count = 0;
+    size_t bytes = 0;
+
+    MemoryUsage &operator+=(const MemoryUsage &other) {
+        count += other.count;
+        bytes += other.bytes;
+        return *this;
+    }
+};
+
+/**
+ * Memory of one kind of allocation reachable from a tree. Exclusive allocations are the ones released together with
+ * the tree, shared ones are also referenced from outside of it (other trees, builders, frames).
+ */
+struct MemorySplit {
+    MemoryUsage exclusive;
+    MemoryUsage shared;
+
+    MemorySplit &operator+=(const MemorySplit &other) {
+        exclusive += other.exclusive;
+        shared += other.shared;
+        return *this;
+    }
+};
+
+/**
+ * What a tree pins, each allocation counted once however many times it is referenced from within the tree. Control
+ * blocks are the owner entries of index leaves (shared_ptr control block included), plain arrays have none.
+ */
+struct MemoryReport {
+    MemorySplit leaves;
+    MemorySplit leafArrays;
+    MemorySplit bNodes;
+    MemorySplit aNodes;
+    MemorySplit controlBlocks;
+
+    MemorySplit total() const {
+        MemorySplit result = leaves;
+        result += leafArrays;
+        result += bNodes;
+        result += aNodes;
+        result += controlBlocks;
+        return result;
+    }
+};
+
+namespace memory_internal {
+
+    template<class LEAF, class ANODE, class BNODE>
+    class MemoryWalker {
+        enum class Kind {
+            Leaf, LeafArray, BNode, ANode, ControlBlock
+        };
+
+        struct Entry {
+            Kind kind;
+            size_t bytes = 0;
+            size_t useCount = 0;
+            size_t exclusiveReferences = 0;
+            //one entry per reference held, duplicates included
+            std::vector<const void *> references;
+        };
+
+        std::unordered_map<const void *, Entry> entries_;
+        //children before their parents
+        std::vector<const void *> postOrder_;
+
+        const void *addAllocation(const void *address, size_t bytes, size_t useCount, bool isControlBlock) {
+            auto [it, inserted] = entries_.try_emplace(address);
+            if (inserted) {
+                it->second = {isControlBlock ? Kind::ControlBlock : Kind::LeafArray, bytes, useCount};
+                postOrder_.push_back(address);
+            }
+            return address;
+        }
+
+        template<class PTR>
+        const void *addNode(const PTR &nodePtr) {
+            using NodeT = std::remove_cvref_t<decltype(*nodePtr)>;
+            const void *address = nodePtr.get();
+            auto [it, inserted] = entries_.try_emplace(address);
+            if (!inserted) {
+                return address;
+            }
+            //unordered_map references survive the inserts of the children
+            Entry &entry = it->second;
+            entry.bytes = sizeof(NodeT);
+            if constexpr (is_const_ptr_v<PTR>) {
+                entry.useCount = nodePtr.use_count();
+            } else {
+                entry.useCount = 1;
+            }
+            if constexpr (std::is_same_v<NodeT, LEAF>) {
+                entry.kind = Kind::Leaf;
+                nodePtr->forEachAllocation([&](const void *allocation, size_t bytes, size_t useCount,
+                                               bool isControlBlock) {
+                    entry.references.push_back(addAllocation(allocation, bytes, useCount, isControlBlock));
+                });
+            } else {
+                entry.kind = std::is_same_v<NodeT, ANODE> ? Kind::ANode : Kind::BNode;
+                nodePtr->forEachReference([&](const auto &child) {
+                    entry.references.push_back(visitNode([&](const auto &childPtr) {
+                        return addNode(childPtr);
+                    }, child));
+                });
+            }
+            postOrder_.push_back(address);
+            return address;
+        }
+
+        MemorySplit &splitOf(MemoryReport &report, Kind kind) {
+            switch (kind) {
+                case Kind::Leaf:
+                    return report.leaves;
+                case Kind::LeafArray:
+                    return report.leafArrays;
+                case Kind::BNode:
+                    return report.bNodes;
+                case Kind::ANode:
+                    return report.aNodes;
+                default:
+                    return report.controlBlocks;
+            }
+        }
+
+    public:
+        using VarType = NodeVariant<LEAF, ANODE, BNODE>;
+
+        explicit MemoryWalker(const VarType &root) {
+            if (root) {
+                visitNode([&](const auto &rootPtr) { addNode(rootPtr); }, root);
+            }
+        }
+
+        bool contains(const void *address) const { return entries_.contains(address); }
+
+        /**
+         * Parents come before their children in reverse post order, so by the time an allocation is reached all the
+         * references from exclusive parents are counted: it is exclusive when they are all of its references. The
+         * root is referenced by the caller's handle.
+         */
+        MemoryReport report() {
+            MemoryReport result;
+            if (postOrder_.empty()) {
+                return result;
+            }
+            entries_[postOrder_.back()].exclusiveReferences++;
+            for (auto it = postOrder_.rbegin(); it != postOrder_.rend(); ++it) {
+                Entry &entry = entries_[*it];
+                bool exclusive = entry.exclusiveReferences >= entry.useCount;
+                (exclusive ? splitOf(result, entry.kind).exclusive : splitOf(result, entry.kind).shared) +=
+                        MemoryUsage{1, entry.bytes};
+                if (exclusive) {
+                    for (const void *reference: entry.references) {
+                        entries_[reference].exclusiveReferences++;
+                    }
+                }
+            }
+            return result;
+        }
+
+        /**
+         * Everything reachable from base counts as shared, whatever else holds it
+         */
+        MemoryReport report(const MemoryWalker &base) {
+            MemoryReport result;
+            for (const void *address: postOrder_) {
+                const Entry &entry = entries_[address];
+                (base.contains(address) ? splitOf(result, entry.kind).shared : splitOf(result, entry.kind).exclusive)
+                        += MemoryUsage{1, entry.bytes};
+            }
+            return result;
+        }
+    };
+}
+
+/**
+ * Walks the tree and reports the memory it pins. Nodes and arrays shared by several parents within the tree count once,
+ * the ones also referenced from outside of it count as shared: only the exclusive part is released when the tree is.
+ */
+template<class LEAF, class ANODE, class BNODE>
+MemoryReport memoryReport(const NodeVariant<LEAF, ANODE, BNODE> &root) {
+    return memory_internal::MemoryWalker<LEAF, ANODE, BNODE>(root).report();
+}
+
+/**
+ * Marginal cost of root while base is kept: the exclusive part is what root references and base doesn't. Meant for
+ * choosing which snapshot to drop under memory pressure, base being the snapshot that stays.
+ */
+template<class LEAF, class ANODE, class BNODE>
+MemoryReport memoryReport(const NodeVariant<LEAF, ANODE, BNODE> &root, const NodeVariant<LEAF, ANODE, BNODE> &base) {
+    memory_internal::MemoryWalker<LEAF, ANODE, BNODE> baseWalker(base);
+    return memory_internal::MemoryWalker<LEAF, ANODE, BNODE>(root).report(baseWalker);
+}
+
+#endif //EXPERIMENTS_MEMORYREPORT_H
@@ -0,0 +1,319 @@
+#ifndef EXPERIMENTS_NODEVARIANT_H
+#define EXPERIMENTS_NODEVARIANT_H
+
+#include "ConstPtr.h"
+#include "bTraits.h"
+#include <array>
+#include <cassert>
+#include <tuple>
+#include <variant>
+
+/**
+ * Owning node slot of a single word, standing in for
+ * std::variant<LeafPtr, ANodePtr, BNodePtr, LeafCPtr, ANodeCPtr, BNodeCPtr>: the node pointer carries the node kind
+ * (Leaf/ANode/BNode) and the const flag in its low bits, so index() matches the variant alternatives. Mutable nodes are
+ * owned as by their unique pointers, const nodes hold one reference of their intrusive count.
+ *
+ * A moved from slot keeps its index with a null pointer, like a variant holding a moved from pointer.
+ */
+template<class LEAF, class ANODE, class BNODE>
+class NodeVariant {
+public:
+    using LeafPtr = std::unique_ptr<LEAF, DeleterForFixedAllocator<LEAF>>;
+    using ANodePtr = std::unique_ptr<ANODE, DeleterForFixedAllocator<ANODE>>;
+    using BNodePtr = std::unique_ptr<BNODE, DeleterForFixedAllocator<BNODE>>;
+    using LeafCPtr = ConstPtr<LEAF>;
+    using ANodeCPtr = ConstPtr<ANODE>;
+    using BNodeCPtr = ConstPtr<BNODE>;
+
+    using Alternatives = std::tuple<LeafPtr, ANodePtr, BNodePtr, LeafCPtr, ANodeCPtr, BNodeCPtr>;
+
+    template<size_t I>
+    using Alternative = std::tuple_element_t<I, Alternatives>;
+
+    template<class PTR>
+    static constexpr size_t indexOf() {
+        using Ptr = std::remove_cvref_t<PTR>;
+        return std::is_same_v<Ptr, LeafPtr> ? 0 : std::is_same_v<Ptr, ANodePtr> ? 1 :
+                                                  std::is_same_v<Ptr, BNodePtr> ? 2 :
+                                                  std::is_same_v<Ptr, LeafCPtr> ? 3 :
+                                                  std::is_same_v<Ptr, ANodeCPtr> ? 4 :
+                                                  std::is_same_v<Ptr, BNodeCPtr> ? 5 : 6;
+    }
+
+    template<class PTR>
+    static constexpr bool isAlternative = indexOf<PTR>() < 6;
+
+private:
+    static constexpr uintptr_t TAG_MASK = 7;
+
+    uintptr_t word_ = 0;
+
+    uintptr_t pointerBits() const { return word_ & ~TAG_MASK; }
+
+    template<size_t I>
+    static auto rawPointer(uintptr_t word) {
+        using Ptr = Alternative<I>;
+        if constexpr (I < 3) {
+            return reinterpret_cast<typename Ptr::element_type *>(word & ~TAG_MASK);
+        } else {
+            return reinterpret_cast<const typename Ptr::element_type *>(word & ~TAG_MASK);
+        }
+    }
+
+    /*
+     * Builds the smart pointer owning the slot content without touching any count, the matching release() hands the
+     * ownership back
+     */
+    template<size_t I>
+    static Alternative<I> adopt(uintptr_t word) {
+        if constexpr (I < 3) {
+            return Alternative<I>(rawPointer<I>(word));
+        } else {
+            return Alternative<I>::adopt(rawPointer<I>(word));
+        }
+    }
+
+    template<size_t I>
+    static uintptr_t encode(const void *pointer) {
+        static_assert(alignof(typename Alternative<I>::element_type) > TAG_MASK);
+        assert((reinterpret_cast<uintptr_t>(pointer) & TAG_MASK) == 0);
+        return reinterpret_cast<uintptr_t>(pointer) | I;
+    }
+
+    static void destroy(uintptr_t word) {
+        if (!(word & ~TAG_MASK)) {
+            return;
+        }
+        switch (word & TAG_MASK) {
+            case 0:
+                adopt<0>(word);
+                break;
+            case 1:
+                adopt<1>(word);
+                break;
+            case 2:
+                adopt<2>(word);
+                break;
+            case 3:
+                adopt<3>(word);
+                break;
+            case 4:
+                adopt<4>(word);
+                break;
+            case 5:
+                adopt<5>(word);
+                break;
+        }
+    }
+
+public:
+    NodeVariant() = default;
+
+    template<class PTR> requires isAlternative<PTR> && (!is_unique_ptr_v<PTR> || !std::is_lvalue_reference_v<PTR>)
+    NodeVariant(PTR &&ptr) {
+        std::remove_cvref_t<PTR> owned(std::forward<PTR>(ptr));
+        word_ = encode<indexOf<PTR>()>(owned.release());
+    }
+
+    NodeVariant(const NodeVariant &) = delete;
+
+    NodeVariant(NodeVariant &&other) noexcept: word_(other.word_) { other.word_ &= TAG_MASK; }
+
+    NodeVariant &operator=(const NodeVariant &) = delete;
+
+    NodeVariant &operator=(NodeVariant &&other) noexcept {
+        uintptr_t oldWord = std::exchange(word_, other.word_);
+        if (&other != this) {
+            other.word_ &= TAG_MASK;
+            destroy(oldWord);
+        }
+        return *this;
+    }
+
+    template<class PTR> requires isAlternative<PTR>
+    NodeVariant &operator=(PTR &&ptr) { return *this = NodeVariant(std::forward<PTR>(ptr)); }
+
+    ~NodeVariant() { destroy(word_); }
+
+    size_t index() const { return word_ & TAG_MASK; }
+
+    /**
+     * The node, regardless of its kind
+     */
+    const void *get() const { return reinterpret_cast<const void *>(pointerBits()); }
+
+    explicit operator bool() const { return pointerBits() != 0; }
+
+    friend bool operator==(const NodeVariant &left, const NodeVariant &right) { return left.word_ == right.word_; }
+
+    template<class PTR>
+    auto getAs() const {
+        constexpr size_t I = indexOf<PTR>();
+        assert(index() == I);
+        return rawPointer<I>(word_);
+    }
+
+    /**
+     * Moves the node out as its smart pointer, leaving the slot empty
+     */
+    template<class PTR>
+    PTR take() {
+        constexpr size_t I = indexOf<PTR>();
+        assert(index() == I);
+        uintptr_t word = word_;
+        word_ &= TAG_MASK;
+        return adopt<I>(word);
+    }
+
+    /**
+     * Calls visitor with a const reference to the content as its smart pointer, without any count traffic
+     */
+    template<class PTR, class Visitor>
+    decltype(auto) visitAs(Visitor &&visitor) const & {
+        constexpr size_t I = indexOf<PTR>();
+        assert(index() == I);
+        struct Lender {
+            Alternative<I> ptr;
+
+            ~Lender() { ptr.release(); }
+        } lender{adopt<I>(word_)};
+        return visitor(std::as_const(lender.ptr));
+    }
+
+    /**
+     * Calls visitor with the content moved out as its smart pointer (as lvalue or rvalue). Whatever the visitor
+     * leaves behind goes back into the slot unless the slot was assigned in the meantime, which mirrors a visitor
+     * working on a reference into a std::variant.
+     */
+    template<class PTR, bool AS_RVALUE, class Visitor>
+    decltype(auto) visitAsMutable(Visitor &&visitor) {
+        constexpr size_t I = indexOf<PTR>();
+        struct Lender {
+            NodeVariant &slot;
+            Alternative<I> ptr;
+
+            ~Lender() {
+                //when the slot was reassigned by the visitor whatever is left in ptr gets dropped with it
+                if (!slot.pointerBits() && ptr) {
+                    slot.word_ = encode<I>(ptr.release());
+                }
+            }
+        } lender{*this, take<Alternative<I>>()};
+        if constexpr (AS_RVALUE) {
+            return visitor(std::move(lender.ptr));
+        } else {
+            return visitor(lender.ptr);
+        }
+    }
+};
+
+template<class T>
+constexpr bool is_node_variant_v = is_template_instance<NodeVariant, std::remove_cvref_t<T>>::value;
+
+/**
+ * std::visit counterpart working on NodeVariant (and forwarding to std::visit for real variants): the visitor gets the
+ * content as its smart pointer with the value category of node
+ */
+template<class Visitor, class VAR>
+decltype(auto) visitNode(Visitor &&visitor, VAR &&node) {
+    if constexpr (!is_node_variant_v<VAR>) {
+        return std::visit(std::forward<Visitor>(visitor), std::forward<VAR>(node));
+    } else {
+        using Var = std::remove_cvref_t<VAR>;
+        auto dispatch = [&]<size_t I>() -> decltype(auto) {
+            using Ptr = typename Var::template Alternative<I>;
+            if constexpr (std::is_const_v<std::remove_reference_t<VAR>>) {
+                return node.template visitAs<Ptr>(visitor);
+            } else {
+                return node.template visitAsMutable<Ptr, std::is_rvalue_reference_v<VAR &&>>(visitor);
+            }
+        };
+        switch (node.index()) {
+            case 0:
+                return dispatch.template operator()<0>();
+            case 1:
+                return dispatch.template operator()<1>();
+            case 2:
+                return dispatch.template operator()<2>();
+            case 3:
+                return dispatch.template operator()<3>();
+            case 4:
+                return dispatch.template operator()<4>();
+            default:
+                return dispatch.template operator()<5>();
+        }
+    }
+}
+
+/**
+ * Read only dispatch on the node kind: the visitor gets a const reference to the node itself, so a mutable node and a
+ * const node of the same kind share one visitor instantiation (three instead of six) and no smart pointer is involved.
+ * The slot must not be empty.
+ */
+template<class Visitor, class LEAF, class ANODE, class BNODE>
+decltype(auto) visitConstNode(Visitor &&visitor, const NodeVariant<LEAF, ANODE, BNODE> &node) {
+    assert(node);
+    switch (node.index()) {
+        case 0:
+        case 3:
+            return visitor(*static_cast<const LEAF *>(node.get()));
+        case 1:
+        case 4:
+            return visitor(*static_cast<const ANODE *>(node.get()));
+        default:
+            return visitor(*static_cast<const BNODE *>(node.get()));
+    }
+}
+
+/**
+ * visitConstNode counterpart for variants of smart pointers (such as an ANode origin)
+ */
+template<class Visitor, class... PTRS>
+decltype(auto) visitConstNode(Visitor &&visitor, const std::variant<PTRS...> &node) {
+    return std::visit([&](const auto &nodePtr) -> decltype(auto) {
+        assert(nodePtr);
+        return visitor(std::as_const(*nodePtr));
+    }, node);
+}
+
+/**
+ * std::get<PTR>(node).get() counterpart: the raw node pointer
+ */
+template<class PTR, class LEAF, class ANODE, class BNODE>
+auto getNode(const NodeVariant<LEAF, ANODE, BNODE> &node) {
+    return node.template getAs<PTR>();
+}
+
+/**
+ * std::get<PTR>(std::move(node)) counterpart
+ */
+template<class PTR, class LEAF, class ANODE, class BNODE>
+PTR takeNode(NodeVariant<LEAF, ANODE, BNODE> &node) {
+    return node.template take<PTR>();
+}
+
+/**
+ * Prefetches what a forward walk over children[first, last] reads after visiting children[pos]: the lines the walk of
+ * the child DISTANCE ahead starts on (prefetchWalk, its header and the first lines of its arrays), and the values of the
+ * next child when it is a leaf, whose header had a step to arrive. A distance of 1 leaves the values out, 0 turns
+ * prefetching off. The nodes pass their CHILD_PREFETCH_DISTANCE.
+ */
+template<size_t DISTANCE, class LEAF, class ANODE, class BNODE, size_t COUNT>
+inline void prefetchChildren(const std::array<NodeVariant<LEAF, ANODE, BNODE>, COUNT> &children, size_t pos,
+                             size_t last) {
+    if constexpr (DISTANCE > 0) {
+        //empty slots of an ANode stand for its origin
+        if (pos + DISTANCE <= last && children[pos + DISTANCE]) {
+            visitConstNode([](const auto &child) { child.prefetchWalk(); }, children[pos + DISTANCE]);
+        }
+    }
+    if constexpr (DISTANCE > 1) {
+        const auto &next = children[pos + 1];
+        if (pos < last && next && (next.index() == 0 || next.index() == 3)) {
+            static_cast<const LEAF *>(next.get())->prefetchData();
+        }
+    }
+}
+
+#endif //EXPERIMENTS_NODEVARIANT_H
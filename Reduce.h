@@ -0,0 +1,213 @@
+#ifndef EXPERIMENTS_REDUCE_H
+#define EXPERIMENTS_REDUCE_H
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * Sum/min/max/count of a range of values. Summaries form a monoid: the default constructed value is the identity and
+ * operator+= combines two adjacent ranges.
+ */
+template<class T>
+struct Summary {
+    T sum = T{};
+    T min = std::numeric_limits<T>::max();
+    T max = std::numeric_limits<T>::lowest();
+    size_t count = 0;
+
+    void add(const T &value) {
+        sum += value;
+        min = value < min ? value : min;
+        max = max < value ? value : max;
+        count++;
+    }
+
+    Summary &operator+=(const Summary &other) {
+        sum += other.sum;
+        min = other.min < min ? other.min : min;
+        max = max < other.max ? other.max : max;
+        count += other.count;
+        return *this;
+    }
+
+    friend Summary operator+(Summary left, const Summary &right) { return left += right; }
+
+    bool operator==(const Summary &other) const = default;
+};
+
+/**
+ * Summary cached by a node when it is made const. Copies start out empty because a copy is how a const node gets
+ * opened for mutation; the owner resets it whenever its content changes. Disabled caches take no space.
+ */
+template<class T, bool ENABLED>
+class CachedSummary {
+    Summary<T> summary_;
+    bool valid_ = false;
+public:
+    CachedSummary() = default;
+
+    CachedSummary(const CachedSummary &) {}
+
+    CachedSummary(CachedSummary &&) = default;
+
+    CachedSummary &operator=(const CachedSummary &) {
+        valid_ = false;
+        return *this;
+    }
+
+    CachedSummary &operator=(CachedSummary &&) = default;
+
+    void set(const Summary<T> &summary) {
+        summary_ = summary;
+        valid_ = true;
+    }
+
+    void reset() { valid_ = false; }
+
+    const Summary<T> *get() const { return valid_ ? &summary_ : nullptr; }
+};
+
+template<class T>
+class CachedSummary<T, false> {
+public:
+    void set(const Summary<T> &summary) {}
+
+    void reset() {}
+
+    const Summary<T> *get() const { return nullptr; }
+};
+
+/**
+ * Instruction sets the reduction kernels are compiled for. Generic is the baseline of the target (SSE2 on x86-64) and
+ * Avx2 is only available when built with gcc/clang for x86.
+ */
+enum class ReduceIsa {
+    Scalar, Generic, Avx2
+};
+
+namespace reduce_internal {
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EXPERIMENTS_REDUCE_X86_DISPATCH
+#endif
+
+    /*
+     * LANES independent accumulators so the inner loop has no loop carried dependency across lanes and can be mapped
+     * onto vector registers by the compiler (no reassociation is needed, so this also holds for floating point).
+     * Force inlined so each dispatch target below gets its own copy compiled for its instruction set.
+     */
+    template<class T, size_t LANES>
+    __attribute__((always_inline)) inline Summary<T> reduceLanes(const T *data, size_t length) {
+        std::array<T, LANES> sum;
+        std::array<T, LANES> min;
+        std::array<T, LANES> max;
+        sum.fill(T{});
+        min.fill(std::numeric_limits<T>::max());
+        max.fill(std::numeric_limits<T>::lowest());
+        size_t pos = 0;
+        for (; pos + LANES <= length; pos += LANES) {
+            for (size_t lane = 0; lane < LANES; lane++) {
+                const T value = data[pos + lane];
+                sum[lane] += value;
+                min[lane] = value < min[lane] ? value : min[lane];
+                max[lane] = max[lane] < value ? value : max[lane];
+            }
+        }
+        Summary<T> result;
+        for (size_t lane = 0; lane < LANES; lane++) {
+            result.sum += sum[lane];
+            result.min = min[lane] < result.min ? min[lane] : result.min;
+            result.max = result.max < max[lane] ? max[lane] : result.max;
+        }
+        for (; pos < length; pos++) {
+            result.add(data[pos]);
+        }
+        result.count = length;
+        return result;
+    }
+
+    template<class T>
+    Summary<T> reduceScalar(const T *data, size_t length) {
+        Summary<T> result;
+        for (size_t i = 0; i < length; i++) {
+            result.add(data[i]);
+        }
+        return result;
+    }
+
+    template<class T>
+    Summary<T> reduceGeneric(const T *data, size_t length) {
+        return reduceLanes<T, 32 / sizeof(T)>(data, length);
+    }
+
+#ifdef EXPERIMENTS_REDUCE_X86_DISPATCH
+
+    template<class T>
+    __attribute__((target("avx2"))) Summary<T> reduceAvx2(const T *data, size_t length) {
+        return reduceLanes<T, 64 / sizeof(T)>(data, length);
+    }
+
+#endif
+}
+
+template<class T>
+using ReduceKernel = Summary<T> (*)(const T *, size_t);
+
+inline bool isReduceIsaSupported(ReduceIsa isa) {
+    switch (isa) {
+        case ReduceIsa::Scalar:
+        case ReduceIsa::Generic:
+            return true;
+        case ReduceIsa::Avx2:
+#ifdef EXPERIMENTS_REDUCE_X86_DISPATCH
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+/**
+ * @return the widest instruction set supported by the running cpu, detected once
+ */
+inline ReduceIsa bestReduceIsa() {
+    static const ReduceIsa isa = isReduceIsaSupported(ReduceIsa::Avx2) ? ReduceIsa::Avx2 : ReduceIsa::Generic;
+    return isa;
+}
+
+/**
+ * @return the kernel for the given instruction set, falling back to the scalar loop for non arithmetic types
+ */
+template<class T>
+ReduceKernel<T> reduceKernel(ReduceIsa isa) {
+    if constexpr (std::is_arithmetic_v<T>) {
+        switch (isa) {
+            case ReduceIsa::Scalar:
+                return &reduce_internal::reduceScalar<T>;
+            case ReduceIsa::Generic:
+                return &reduce_internal::reduceGeneric<T>;
+            case ReduceIsa::Avx2:
+#ifdef EXPERIMENTS_REDUCE_X86_DISPATCH
+                return &reduce_internal::reduceAvx2<T>;
+#else
+                throw std::logic_error("Avx2 kernels are not available on this platform");
+#endif
+        }
+    }
+    return &reduce_internal::reduceScalar<T>;
+}
+
+/**
+ * Reduces a contiguous span using the best kernel for the running cpu
+ */
+template<class T>
+Summary<T> reduceSpan(const T *data, size_t length) {
+    static const ReduceKernel<T> kernel = reduceKernel<T>(bestReduceIsa());
+    return kernel(data, length);
+}
+
+#endif //EXPERIMENTS_REDUCE_H
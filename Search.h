@@ -0,0 +1,84 @@
+#ifndef EXPERIMENTS_SEARCH_H
+#define EXPERIMENTS_SEARCH_H
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+
+namespace search_internal {
+
+    //Children counts up to this are searched with a single linear pass, above it the range is halved first
+    constexpr size_t LINEAR_SEARCH_LIMIT = 16;
+
+    /*
+     * Counts the entries of data[0, count) less than value. There is no data dependent branch: each lane adds its
+     * compare results, so the compiler turns the loop into vector compares and adds. The lanes count in KEY, so that
+     * narrow keys get as many lanes per vector as the compares.
+     */
+    template<size_t LANES, class KEY>
+    __attribute__((always_inline)) inline size_t countLessLanes(const KEY *data, size_t count,
+                                                                std::type_identity_t<KEY> value) {
+        std::array<KEY, LANES> counts{};
+        size_t pos = 0;
+        for (; pos + LANES <= count; pos += LANES) {
+            for (size_t lane = 0; lane < LANES; lane++) {
+                counts[lane] += data[pos + lane] < value;
+            }
+        }
+        size_t result = 0;
+        for (; pos < count; pos++) {
+            result += data[pos] < value;
+        }
+        for (size_t lane = 0; lane < LANES; lane++) {
+            result += counts[lane];
+        }
+        return result;
+    }
+}
+
+/**
+ * std::lower_bound over the ascending cumulative sizes cumSize[0, count), as a position. Wide nodes are first narrowed
+ * down with a branchless halving (conditional moves only), the remaining window is counted with vector compares.
+ */
+inline size_t cumLowerBound(const size_t *cumSize, size_t count, size_t value) {
+    const size_t *base = cumSize;
+    while (count > search_internal::LINEAR_SEARCH_LIMIT) {
+        size_t half = count / 2;
+        //every entry of [base, base + half) is below value, or else the answer is within the first count - half
+        base = base[half - 1] < value ? base + half : base;
+        count -= half;
+    }
+    return (base - cumSize) + search_internal::countLessLanes<4>(base, count, value);
+}
+
+/**
+ * std::upper_bound over the ascending cumulative sizes cumSize[0, count), as a position. Nothing is above the largest
+ * value, which value + 1 would wrap around to 0.
+ */
+inline size_t cumUpperBound(const size_t *cumSize, size_t count, size_t value) {
+    return value == std::numeric_limits<size_t>::max() ? count : cumLowerBound(cumSize, count, value + 1);
+}
+
+/**
+ * Requests the cache lines cumLowerBound reads on a full node of CAPACITY entries: every line when the array spans a
+ * few of them, otherwise the probes of the first halving steps (the steps after them depend on the value)
+ */
+template<size_t CAPACITY>
+inline void prefetchCumSizes(const size_t *cumSize) {
+    constexpr size_t LINE_VALUES = 64 / sizeof(size_t);
+    constexpr size_t PROBES = 8;
+    if constexpr (CAPACITY <= PROBES * LINE_VALUES) {
+        for (size_t pos = 0; pos < CAPACITY; pos += LINE_VALUES) {
+            __builtin_prefetch(cumSize + pos);
+        }
+        //the array need not start on a line
+        __builtin_prefetch(cumSize + CAPACITY - 1);
+    } else {
+        for (size_t probe = 1; probe < PROBES; probe++) {
+            __builtin_prefetch(cumSize + probe * CAPACITY / PROBES - 1);
+        }
+    }
+}
+
+#endif //EXPERIMENTS_SEARCH_H
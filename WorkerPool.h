@@ -0,0 +1,96 @@
+#ifndef EXPERIMENTS_WORKERPOOL_H
+#define EXPERIMENTS_WORKERPOOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * Process wide set of worker threads for fork-join batches (see Builder::parallelBulkLoad), so a parallel call doesn't
+ * pay for creating and joining threads. Workers are started on demand, up to the widest batch seen, and then wait for
+ * the next batch. The pool is never destroyed: its workers may outlive static destruction, idle.
+ */
+class WorkerPool {
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    size_t workerCount_ = 0;
+    //one batch at a time, callers queue on it
+    std::mutex batchMutex_;
+
+    const std::function<void(size_t)> *task_ = nullptr;
+    size_t taskCount_ = 0;
+    size_t nextTask_ = 0;
+    size_t pending_ = 0;
+    uint64_t generation_ = 0;
+
+    WorkerPool() = default;
+
+    /**
+     * Runs tasks of the current batch until none is left, mutex_ held on entry and on exit
+     */
+    void drain(std::unique_lock<std::mutex> &lock) {
+        while (nextTask_ < taskCount_) {
+            size_t task = nextTask_++;
+            lock.unlock();
+            (*task_)(task);
+            lock.lock();
+            if (--pending_ == 0) {
+                done_.notify_all();
+            }
+        }
+    }
+
+    void work(uint64_t seen) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait(lock, [&]() { return generation_ != seen; });
+            seen = generation_;
+            drain(lock);
+        }
+    }
+
+public:
+    WorkerPool(const WorkerPool &) = delete;
+
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    static WorkerPool &oneAndOnly() {
+        static auto *result = new WorkerPool();
+        return *result;
+    }
+
+    /**
+     * Calls task(i) for every i in [0, count), spread over the calling thread and count - 1 workers at most, and
+     * returns once all calls did. The task must not throw nor run a batch of its own.
+     */
+    void run(size_t count, const std::function<void(size_t)> &task) {
+        if (count <= 1) {
+            if (count) {
+                task(0);
+            }
+            return;
+        }
+        std::lock_guard<std::mutex> batchGuard(batchMutex_);
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (; workerCount_ < count - 1; workerCount_++) {
+            //started before the batch gets published, so it joins this one already
+            std::thread([this, seen = generation_]() { work(seen); }).detach();
+        }
+        task_ = &task;
+        taskCount_ = count;
+        nextTask_ = 0;
+        pending_ = count;
+        generation_++;
+        wake_.notify_all();
+        drain(lock);
+        done_.wait(lock, [&]() { return pending_ == 0; });
+        task_ = nullptr;
+        taskCount_ = 0;
+    }
+};
+
+#endif //EXPERIMENTS_WORKERPOOL_H
@@ -12,8 +12,11 @@ struct is_template_instance<T, T<ARGS...>> : std::true_type {
 template<class T>
 constexpr bool is_unique_ptr_v = is_template_instance<std::unique_ptr, std::remove_cvref_t<T>>::value;
 
+template<class NODE>
+class ConstPtr;
+
 template<class T>
-constexpr bool is_shared_ptr_v = is_template_instance<std::shared_ptr, std::remove_cvref_t<T>>::value;
+constexpr bool is_const_ptr_v = is_template_instance<ConstPtr, std::remove_cvref_t<T>>::value;
 
 
 #endif //EXPERIMENTS_BTRAITS_H
@@ -2,7 +2,16 @@
 #include "utilities.h"
 #include "../ANode.h"
 #include "../BNode.h"
+#include "../Builder.h"
+#include "../Cursor.h"
+#include "../Diff.h"
 #include "../FixedSizeAllocator.h"
+#include "../FrozenTree.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <random>
 
 #define TOTAL_BYTE_SIZE (uint64_t(1)<<30)
 
@@ -21,23 +30,23 @@ static void BM_BNode_Create(benchmark::State &state) {
     auto &allocator = Allocator::oneAndOnly();
     allocator.prefetch(TOTAL_BYTE_SIZE / 2 / sizeof(BNode));
 
-    FixedSizeAllocator<4 * Size> &buffAllocator = FixedSizeAllocator<4 * Size>::oneAndOnly();
+    auto &buffAllocator = StdFixedAllocator<CountedArray<int, Size>>::internalAllocator::oneAndOnly();
     buffAllocator.prefetch(16);
 
     FixedSizeAllocator<sizeof(Leaf<int, Size>)>::oneAndOnly().prefetch(16);
 
     BNode bNode(1);
     using Leaf = Leaf<int, Size>;
-    auto buffer = Leaf::createBuffer(nullptr);
+    auto buffer = Leaf::createLeaf(nullptr);
     std::array<int, Size> sampleData;
     for (int i = 0; i < Size; i++) {
         sampleData[i] = 3 * i;
     }
     buffer.add(sampleData.data(), Size);
-    bNode.addNode(Leaf::createBufferPtr(buffer));
+    bNode.addNode(Leaf::createLeafPtr(buffer));
     bNode.makeConst(true);
 
-    auto constNode = BNode::makeConstFromPtr(Leaf::createBufferPtr(buffer));
+    auto constNode = makeConstFromPtr(Leaf::createLeafPtr(buffer));
 
     std::vector<BNodePtr> bnodes;
 
@@ -80,7 +89,7 @@ static void BM_BNode_CopyMutable(benchmark::State &state) {
     bool touchData = state.range(0);
     //Initializer<Size,Alloc>::run();
     auto &bufferObjectAllocator = FixedSizeAllocator<sizeof(Leaf<int, Size>)>::oneAndOnly();
-    FixedSizeAllocator<4 * Size> &buffAllocator = FixedSizeAllocator<4 * Size>::oneAndOnly();
+    auto &buffAllocator = StdFixedAllocator<CountedArray<int, Size>>::internalAllocator::oneAndOnly();
 
     // std::cout << "Initial Leaf Count " << buffAllocator.allocatedCount() << std::endl;
     // std::cout << "Initial Leaf Object Count " << bufferObjectAllocator.allocatedCount() << std::endl;
@@ -95,16 +104,16 @@ static void BM_BNode_CopyMutable(benchmark::State &state) {
 
     BNode bNode(1);
     using Leaf = Leaf<int, Size>;
-    auto buffer = Leaf::createBuffer(nullptr);
+    auto buffer = Leaf::createLeaf(nullptr);
     std::array<int, Size> sampleData;
     for (int i = 0; i < Size; i++) {
         sampleData[i] = 3 * i;
     }
     buffer.add(sampleData.data(), Size);
-    bNode.addNode(Leaf::createBufferPtr(buffer));
+    bNode.addNode(Leaf::createLeafPtr(buffer));
     //bNode.makeConst(true);
 
-    auto constNode = BNode::makeConstFromPtr(Leaf::createBufferPtr(buffer));
+    auto constNode = makeConstFromPtr(Leaf::createLeafPtr(buffer));
 
     std::vector<BNodePtr> bnodes;
 
@@ -147,12 +156,12 @@ static void BM_BNode_MoveMutable(benchmark::State &state) {
     bool touchData = state.range(0);
     //Initializer<Size,Alloc>::run();
     auto &bufferObjectAllocator = FixedSizeAllocator<sizeof(Leaf<int, Size>)>::oneAndOnly();
-    FixedSizeAllocator<4 * Size> &buffAllocator = FixedSizeAllocator<4 * Size>::oneAndOnly();
+    auto &buffAllocator = StdFixedAllocator<CountedArray<int, Size>>::internalAllocator::oneAndOnly();
 
     //std::cout << "Initial Leaf Count " << buffAllocator.allocatedCount() << std::endl;
     //std::cout << "Initial Leaf Object Count " << bufferObjectAllocator.allocatedCount() << std::endl;
 
-    size_t sizeCap = std::min(state.max_iterations,
+    size_t sizeCap = std::min<uint64_t>(state.max_iterations,
                               std::min(TOTAL_BYTE_SIZE / sizeof(BNode), TOTAL_BYTE_SIZE / 4 / Size / MaxCount));
     auto &allocator = Allocator::oneAndOnly();
     allocator.prefetch(sizeCap * 2);
@@ -163,7 +172,7 @@ static void BM_BNode_MoveMutable(benchmark::State &state) {
     {
         BNode bNode(1);
         using Leaf = Leaf<int, Size>;
-        auto buffer = Leaf::createBuffer(nullptr);
+        auto buffer = Leaf::createLeaf(nullptr);
         std::array<int, Size> sampleData;
         for (int i = 0; i < Size; i++) {
             sampleData[i] = 3 * i;
@@ -171,7 +180,7 @@ static void BM_BNode_MoveMutable(benchmark::State &state) {
         buffer.add(sampleData.data(), Size);
         if (touchData) {
             for (int i = 0; i < MaxCount; i++) {
-                bNode.addNode(Leaf::createBufferPtr(buffer));
+                bNode.addNode(Leaf::createLeafPtr(buffer));
             }
         }
 
@@ -244,14 +253,14 @@ static void BM_BNode_MakeConst(benchmark::State &state) {
     using Allocator = typename BNode::Allocator;
     //Initializer<Size,Alloc>::run();{
     auto &bufferObjectAllocator = FixedSizeAllocator<sizeof(Leaf<int, Size>)>::oneAndOnly();
-    FixedSizeAllocator<4 * Size> &buffAllocator = FixedSizeAllocator<4 * Size>::oneAndOnly();
+    auto &buffAllocator = StdFixedAllocator<CountedArray<int, Size>>::internalAllocator::oneAndOnly();
     auto &allocator = Allocator::oneAndOnly();
     auto &sharedPtrAllocator = FixedSizeAllocator<32>::oneAndOnly();
     {
 
         /*   std::cout << "Initial Leaf Count " << buffAllocator.allocatedCount() << std::endl;
            std::cout << "Initial Leaf Object Count " << bufferObjectAllocator.allocatedCount() << std::endl;*/
-        size_t sizeCap = std::min(state.max_iterations,
+        size_t sizeCap = std::min<uint64_t>(state.max_iterations,
                                   std::min(TOTAL_BYTE_SIZE / sizeof(BNode), TOTAL_BYTE_SIZE / 4 / Size / MaxCount));
         allocator.prefetch(sizeCap * 2);
 
@@ -263,7 +272,7 @@ static void BM_BNode_MakeConst(benchmark::State &state) {
 
         BNode bNode(1);
         using Leaf = Leaf<int, Size>;
-        auto buffer = Leaf::createBuffer(nullptr);
+        auto buffer = Leaf::createLeaf(nullptr);
         std::array<int, Size> sampleData;
         for (int i = 0; i < Size; i++) {
             sampleData[i] = 3 * i;
@@ -271,7 +280,7 @@ static void BM_BNode_MakeConst(benchmark::State &state) {
         buffer.add(sampleData.data(), Size);
 
         for (int i = 0; i < MaxCount; i++) {
-            bNode.addNode(Leaf::createBufferPtr(buffer));
+            bNode.addNode(Leaf::createLeafPtr(buffer));
         }
 
         std::vector<BNodePtr> bSrc;
@@ -352,10 +361,10 @@ BNode<T, MAX_CHILDREN_COUNT, BufferSize> buildTree(int level, int childrenCount,
     BNode result(level);
     if (level == 1) {
         const static std::array<T, BufferSize> mockBuffer{};
-        auto buffer = Leaf::createBuffer(nullptr);
+        auto buffer = Leaf::createLeaf(nullptr);
         buffer.add(mockBuffer.data(), bufferSize);
         for (size_t i = 0; i < childrenCount; i++) {
-            result.addNode(Leaf::createBufferPtr(buffer));
+            result.addNode(Leaf::createLeafPtr(buffer));
         }
     } else {
         for (size_t i = 0; i < childrenCount; i++) {
@@ -397,7 +406,7 @@ static void BM_BNode_FillData(benchmark::State &state) {
     using Allocator = typename BNode::Allocator;
     //Initializer<Size,Alloc>::run();{
     auto &bufferObjectAllocator = FixedSizeAllocator<sizeof(Leaf<int, Size>)>::oneAndOnly();
-    FixedSizeAllocator<4 * Size> &buffAllocator = FixedSizeAllocator<4 * Size>::oneAndOnly();
+    auto &buffAllocator = StdFixedAllocator<CountedArray<int, Size>>::internalAllocator::oneAndOnly();
     auto &allocator = Allocator::oneAndOnly();
     size_t bufferSize = state.range(0);
     size_t totalSize = state.range(1);
@@ -409,7 +418,7 @@ static void BM_BNode_FillData(benchmark::State &state) {
         /*   std::cout << "Initial Leaf Count " << buffAllocator.allocatedCount() << std::endl;
            std::cout << "Initial Leaf Object Count " << bufferObjectAllocator.allocatedCount() << std::endl;*/
 
-        size_t sizeCap = std::min(state.max_iterations, TOTAL_BYTE_SIZE / 8 / totalSize);
+        size_t sizeCap = std::min<uint64_t>(state.max_iterations, TOTAL_BYTE_SIZE / 8 / totalSize);
         if (!sizeCap) {
             sizeCap++;
         }
@@ -439,7 +448,7 @@ static void BM_BNode_FillData(benchmark::State &state) {
             size_t offset = 0;
             int startValue = 11;
             do {
-                size_t readCount = bSrc[pos]->fillBuffer(readBuffer, offset, bufferSize);
+                size_t readCount = bSrc[pos]->fillLeaf(readBuffer, offset, bufferSize);
 #ifdef DEBUG
                 for (int i = 0; i < readCount;i++) {
                     assert(readBuffer[i] == startValue);
@@ -475,7 +484,7 @@ static void BM_BNode_SetData(benchmark::State &state) {
     using Allocator = typename BNode::Allocator;
     //Initializer<Size,Alloc>::run();{
     auto &bufferObjectAllocator = FixedSizeAllocator<sizeof(Leaf<int, Size>)>::oneAndOnly();
-    FixedSizeAllocator<4 * Size> &buffAllocator = FixedSizeAllocator<4 * Size>::oneAndOnly();
+    auto &buffAllocator = StdFixedAllocator<CountedArray<int, Size>>::internalAllocator::oneAndOnly();
     auto &allocator = Allocator::oneAndOnly();
     size_t bufferSize = state.range(0);
     size_t totalSize = state.range(1);
@@ -487,7 +496,7 @@ static void BM_BNode_SetData(benchmark::State &state) {
         /*   std::cout << "Initial Leaf Count " << buffAllocator.allocatedCount() << std::endl;
            std::cout << "Initial Leaf Object Count " << bufferObjectAllocator.allocatedCount() << std::endl;*/
 
-        size_t sizeCap = std::min(state.max_iterations, TOTAL_BYTE_SIZE / 8 / totalSize);
+        size_t sizeCap = std::min<uint64_t>(state.max_iterations, TOTAL_BYTE_SIZE / 8 / totalSize);
         size_t bufferCount = (totalSize / Size + 100) * (sizeCap + 1);
         buffAllocator.prefetch(bufferCount);
         bufferObjectAllocator.prefetch(bufferCount);
@@ -552,4 +561,635 @@ APPLY_SIZE_AND_COUNT_TO_BM_VAR_STEP(BM_BNode_FillData);
 APPLY_SIZE_AND_COUNT_TO_BM_VAR_STEP(BM_BNode_SetData);
 
 //TODO - create a bunch of mutable objects and then make them const - expand to multi levels
-//TODO - run a setValues and a fill for the same big objects
\ No newline at end of file
+//TODO - run a setValues and a fill for the same big objects
+
+/*
+ * Child slot layout: every BNode child is a single tagged word (node kind and const flag in the low pointer bits, the
+ * const nodes counting their references intrusively), the counters report the resulting node footprint. Seek reads
+ * random positions through the whole tree, so each level costs a cumSize_ search plus one child dispatch; Scan walks
+ * all the leaves in order.
+ */
+
+template<size_t MaxCount, size_t Size>
+static auto &constTreeForSize(size_t totalSize) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    //never released, the node pools may be gone by the time static destructors run
+    static auto &trees = *new std::map<size_t, typename BuilderT::VarType>();
+    auto it = trees.find(totalSize);
+    if (it != trees.end()) {
+        return it->second;
+    }
+    BuilderT builder;
+    std::array<int, Size> leafData;
+    for (size_t pos = 0; pos < totalSize; pos += Size) {
+        for (size_t i = 0; i < Size; i++) {
+            leafData[i] = int(pos + i);
+        }
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), std::min(Size, totalSize - pos));
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    return trees.emplace(totalSize, builder.close()).first->second;
+}
+
+template<size_t MaxCount, size_t Size>
+static void setLayoutCounters(benchmark::State &state) {
+    using BNode = BNode<int, MaxCount, Size>;
+    state.counters["nodeBytes"] = sizeof(BNode);
+    state.counters["slotBytes"] = sizeof(typename BNode::VarType);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_Seek(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    BuilderT builder;
+    builder.addNode(constTreeForSize<MaxCount, Size>(totalSize));
+    std::vector<size_t> positions(1 << 12);
+    std::mt19937_64 gen(MaxCount);
+    std::uniform_int_distribution<size_t> dist(0, totalSize - 1);
+    for (auto &position: positions) {
+        position = dist(gen);
+    }
+    size_t pos = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(builder[positions[pos++ & (positions.size() - 1)]]);
+    }
+    setLayoutCounters<MaxCount, Size>(state);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_Scan(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = constTreeForSize<MaxCount, Size>(totalSize);
+    for (auto _: state) {
+        int64_t result = 0;
+        BuilderT::forEachLeaf([&](const auto &leaf, size_t offset, size_t len) {
+            result += leaf.at(offset);
+        }, root, 0, totalSize);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * (totalSize / Size));
+    setLayoutCounters<MaxCount, Size>(state);
+}
+
+#define APPLY_COUNT_TO_LAYOUT_BM(BM) \
+BENCHMARK_TEMPLATE(BM, 16, 64)->Range(1 << 16, 1 << 24);\
+BENCHMARK_TEMPLATE(BM, 32, 64)->Range(1 << 16, 1 << 24);\
+BENCHMARK_TEMPLATE(BM, 64, 64)->Range(1 << 16, 1 << 24);\
+BENCHMARK_TEMPLATE(BM, 128, 64)->Range(1 << 16, 1 << 24);\
+BENCHMARK_TEMPLATE(BM, 256, 64)->Range(1 << 16, 1 << 24)
+
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_Seek);
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_Scan);
+
+/*
+ * The same seeks and scans on a frozen copy of the tree (see FrozenTree): one cache line of 32 bit separators per
+ * level of a static B+ tree instead of a cumSize_ search and a child dispatch per BNode
+ */
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_FrozenSeek(benchmark::State &state) {
+    size_t totalSize = state.range(0);
+    auto frozen = freeze(constTreeForSize<MaxCount, Size>(totalSize));
+    std::vector<size_t> positions(1 << 12);
+    std::mt19937_64 gen(MaxCount);
+    std::uniform_int_distribution<size_t> dist(0, totalSize - 1);
+    for (auto &position: positions) {
+        position = dist(gen);
+    }
+    size_t pos = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(frozen[positions[pos++ & (positions.size() - 1)]]);
+    }
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_FrozenScan(benchmark::State &state) {
+    size_t totalSize = state.range(0);
+    auto frozen = freeze(constTreeForSize<MaxCount, Size>(totalSize));
+    for (auto _: state) {
+        int64_t result = 0;
+        frozen.forEachLeaf([&](const auto &leaf, size_t offset, size_t len) {
+            result += leaf.at(offset);
+        }, 0, totalSize);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * (totalSize / Size));
+}
+
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_FrozenSeek);
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_FrozenScan);
+
+/*
+ * Dispatch before/after: the ByPtr variants walk the tree the way forEachLeaf used to, handing every child to the
+ * visitor as its smart pointer through visitNode (one instantiation per pointer kind, mutable ones included). The
+ * plain Scan and the Walk variants go through the const only path (visitConstNode / forEachChildNode).
+ */
+
+template<class BuilderT>
+static void forEachLeafByPtr(auto &&visitor, const auto &nodePtr, size_t offset, size_t len) {
+    using PtrType = std::remove_cvref_t<decltype(nodePtr)>;
+    if constexpr (std::is_same_v<PtrType, typename BuilderT::VarType>) {
+        visitNode([&](const auto &ptr) {
+            forEachLeafByPtr<BuilderT>(visitor, ptr, offset, len);
+        }, nodePtr);
+    } else if constexpr (std::is_same_v<PtrType, typename BuilderT::LeafPtr> or
+                         std::is_same_v<PtrType, typename BuilderT::LeafCPtr>) {
+        visitor(*nodePtr, offset, std::min(len, nodePtr->size() - offset));
+    } else {
+        nodePtr->forEachChild([&](const auto &child, size_t childOffset, size_t childLength) {
+            forEachLeafByPtr<BuilderT>(visitor, child, childOffset, childLength);
+        }, offset, len, false);
+    }
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_ScanByPtr(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = constTreeForSize<MaxCount, Size>(totalSize);
+    for (auto _: state) {
+        int64_t result = 0;
+        forEachLeafByPtr<BuilderT>([&](const auto &leaf, size_t offset, size_t len) {
+            result += leaf.at(offset);
+        }, root, 0, totalSize);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * (totalSize / Size));
+    setLayoutCounters<MaxCount, Size>(state);
+}
+
+template<size_t MaxCount, size_t Size, bool ByPtr>
+static void seekByWalk(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = constTreeForSize<MaxCount, Size>(totalSize);
+    std::vector<size_t> positions(1 << 12);
+    std::mt19937_64 gen(MaxCount);
+    std::uniform_int_distribution<size_t> dist(0, totalSize - 1);
+    for (auto &position: positions) {
+        position = dist(gen);
+    }
+    size_t pos = 0;
+    for (auto _: state) {
+        int result = 0;
+        auto visitor = [&](const auto &leaf, size_t offset, size_t) {
+            result = leaf.at(offset);
+        };
+        if constexpr (ByPtr) {
+            forEachLeafByPtr<BuilderT>(visitor, root, positions[pos++ & (positions.size() - 1)], 1);
+        } else {
+            BuilderT::forEachLeaf(visitor, root, positions[pos++ & (positions.size() - 1)], 1);
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    setLayoutCounters<MaxCount, Size>(state);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_SeekWalk(benchmark::State &state) {
+    seekByWalk<MaxCount, Size, false>(state);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_SeekWalkByPtr(benchmark::State &state) {
+    seekByWalk<MaxCount, Size, true>(state);
+}
+
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_ScanByPtr);
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_SeekWalk);
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_SeekWalkByPtr);
+
+/*
+ * Position by position reads: Index descends from the root for every element, Cursor keeps the path and only climbs
+ * when it leaves the current leaf, CursorJump moves by small random steps around the previous position.
+ */
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_IndexScan(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    BuilderT builder;
+    builder.addNode(constTreeForSize<MaxCount, Size>(totalSize));
+    for (auto _: state) {
+        int64_t result = 0;
+        for (size_t i = 0; i < totalSize; i++) {
+            result += builder[i];
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * totalSize);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_CursorScan(benchmark::State &state) {
+    size_t totalSize = state.range(0);
+    auto &root = constTreeForSize<MaxCount, Size>(totalSize);
+    for (auto _: state) {
+        int64_t result = 0;
+        for (Cursor<int, MaxCount, Size, ArrayAdapter> cursor(root); !cursor.atEnd(); ++cursor) {
+            result += *cursor;
+        }
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * totalSize);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_CursorJump(benchmark::State &state) {
+    size_t totalSize = state.range(0);
+    Cursor<int, MaxCount, Size, ArrayAdapter> cursor(constTreeForSize<MaxCount, Size>(totalSize), totalSize / 2);
+    std::vector<ptrdiff_t> steps(1 << 12);
+    std::mt19937_64 gen(MaxCount);
+    std::uniform_int_distribution<ptrdiff_t> dist(-1024, 1024);
+    for (auto &step: steps) {
+        step = dist(gen);
+    }
+    size_t pos = 0;
+    for (auto _: state) {
+        ptrdiff_t step = steps[pos++ & (steps.size() - 1)];
+        cursor += cursor.position() + step < totalSize ? step : -step;
+        benchmark::DoNotOptimize(*cursor);
+    }
+}
+
+#define APPLY_COUNT_TO_CURSOR_BM(BM) \
+BENCHMARK_TEMPLATE(BM, 16, 64)->Range(1 << 16, 1 << 20);\
+BENCHMARK_TEMPLATE(BM, 64, 64)->Range(1 << 16, 1 << 20)
+
+APPLY_COUNT_TO_CURSOR_BM(BM_BNode_IndexScan);
+APPLY_COUNT_TO_CURSOR_BM(BM_BNode_CursorScan);
+APPLY_COUNT_TO_CURSOR_BM(BM_BNode_CursorJump);
+
+/*
+ * Batched random reads (positions unsorted) against the same lookups one operator[] at a time, on trees well past
+ * the last level cache
+ */
+template<size_t MaxCount, size_t Size, bool Batched>
+static void randomReads(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = constTreeForSize<MaxCount, Size>(totalSize);
+    BuilderT builder;
+    builder.addNode(root);
+    std::vector<size_t> positions(1 << 14);
+    std::mt19937_64 gen(MaxCount);
+    std::uniform_int_distribution<size_t> dist(0, totalSize - 1);
+    for (auto &position: positions) {
+        position = dist(gen);
+    }
+    std::vector<int> out(positions.size());
+    for (auto _: state) {
+        if constexpr (Batched) {
+            BuilderT::multiGet(root, positions.data(), positions.size(), out.data());
+        } else {
+            for (size_t i = 0; i < positions.size(); i++) {
+                out[i] = builder[positions[i]];
+            }
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * positions.size());
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_MultiGet(benchmark::State &state) {
+    randomReads<MaxCount, Size, true>(state);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_SingleGets(benchmark::State &state) {
+    randomReads<MaxCount, Size, false>(state);
+}
+
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_MultiGet);
+APPLY_COUNT_TO_LAYOUT_BM(BM_BNode_SingleGets);
+
+/*
+ * Full scans of a tree whose leaves were allocated in shuffled order, so walking it in position order jumps around
+ * memory the way long lived, often edited trees do and the hardware stride prefetcher can't follow. Compare with the
+ * DISTANCE of ChildPrefetch specialized to 0 (no software prefetch) for the benchmarked shapes.
+ */
+template<size_t MaxCount, size_t Size>
+static auto &scatteredTreeForSize(size_t totalSize) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    //never released, the node pools may be gone by the time static destructors run
+    static auto &trees = *new std::map<size_t, typename BuilderT::VarType>();
+    auto it = trees.find(totalSize);
+    if (it != trees.end()) {
+        return it->second;
+    }
+    std::vector<typename BuilderT::LeafPtr> leaves(totalSize / Size);
+    std::vector<size_t> allocationOrder(leaves.size());
+    std::iota(allocationOrder.begin(), allocationOrder.end(), 0);
+    std::shuffle(allocationOrder.begin(), allocationOrder.end(), std::mt19937_64(Size));
+    std::array<int, Size> leafData;
+    for (auto leafPos: allocationOrder) {
+        for (size_t i = 0; i < Size; i++) {
+            leafData[i] = int(leafPos * Size + i);
+        }
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), Size);
+        leaves[leafPos] = LeafT::createLeafPtr(std::move(leaf));
+    }
+    BuilderT builder;
+    for (auto &leaf: leaves) {
+        builder.addNode(std::move(leaf));
+    }
+    return trees.emplace(totalSize, builder.close()).first->second;
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_ScatteredScan(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = scatteredTreeForSize<MaxCount, Size>(totalSize);
+    for (auto _: state) {
+        int64_t result = 0;
+        BuilderT::forEachLeaf([&](const auto &leaf, size_t offset, size_t len) {
+            result += reduceSpan(leaf.data() + offset, len).sum;
+        }, root, 0, totalSize);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * totalSize);
+    state.counters["prefetchDistance"] = BuilderT::BNodeT::CHILD_PREFETCH_DISTANCE;
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_ScatteredScan, 16, 64)->Range(1 << 16, 1 << 22);
+BENCHMARK_TEMPLATE(BM_BNode_ScatteredScan, 64, 64)->Range(1 << 16, 1 << 22);
+BENCHMARK_TEMPLATE(BM_BNode_ScatteredScan, 16, 256)->Range(1 << 16, 1 << 22);
+
+/*
+ * Building a tree from a contiguous array: one addNode per leaf (each descending the right spine and rebalancing)
+ * against the bottom-up bulk loader. Bytes processed are the values copied, compare with a plain memcpy rate.
+ */
+template<size_t MaxCount, size_t Size, bool Bulk>
+static void buildFromArray(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    size_t totalSize = state.range(0);
+    std::vector<int> values(totalSize);
+    std::iota(values.begin(), values.end(), 0);
+    for (auto _: state) {
+        typename BuilderT::VarType root;
+        if constexpr (Bulk) {
+            root = BuilderT::bulkLoad(values.data(), totalSize);
+        } else {
+            BuilderT builder;
+            for (size_t pos = 0; pos < totalSize; pos += Size) {
+                auto leaf = LeafT::createLeaf(nullptr);
+                leaf.add(values.data() + pos, std::min(Size, totalSize - pos));
+                builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+            }
+            root = builder.close();
+        }
+        benchmark::DoNotOptimize(root.get());
+        state.PauseTiming();
+        root = typename BuilderT::VarType();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * totalSize * sizeof(int));
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_BuildByAppend(benchmark::State &state) {
+    buildFromArray<MaxCount, Size, false>(state);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_BuildByBulkLoad(benchmark::State &state) {
+    buildFromArray<MaxCount, Size, true>(state);
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_BuildByAppend, 16, 1024)->Range(1 << 16, 1 << 26);
+BENCHMARK_TEMPLATE(BM_BNode_BuildByBulkLoad, 16, 1024)->Range(1 << 16, 1 << 26);
+BENCHMARK_TEMPLATE(BM_BNode_BuildByAppend, 64, 64)->Range(1 << 16, 1 << 24);
+BENCHMARK_TEMPLATE(BM_BNode_BuildByBulkLoad, 64, 64)->Range(1 << 16, 1 << 24);
+
+/*
+ * Streaming ingest: state.range(0) appends of a single leaf each. The leaf is one shared const leaf, so what gets
+ * measured is the builder's own work per append (the right spine upkeep), not copying values. Items are appends.
+ */
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_SingleLeafAppends(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    size_t appendCount = state.range(0);
+    std::array<int, Size> leafData{};
+    auto leaf = LeafT::createLeaf(nullptr);
+    leaf.add(leafData.data(), Size);
+    typename BuilderT::LeafCPtr sharedLeaf = makeConstFromPtr(LeafT::createLeafPtr(std::move(leaf)));
+    for (auto _: state) {
+        BuilderT builder;
+        for (size_t i = 0; i < appendCount; i++) {
+            builder.addNode(sharedLeaf);
+        }
+        auto root = builder.close();
+        benchmark::DoNotOptimize(root.get());
+        state.PauseTiming();
+        root = typename BuilderT::VarType();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * appendCount);
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_SingleLeafAppends, 16, 64)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BNode_SingleLeafAppends, 64, 64)->Arg(10'000'000)->Unit(benchmark::kMillisecond);
+
+/*
+ * Keeping every other run of RUN_LENGTH values out of a tree (a scattered filter/update): one addNode per range, each
+ * descending from the source root, against a single addRanges walk. Items are the ranges kept.
+ */
+template<size_t MaxCount, size_t Size, bool Batched>
+static void keepScatteredRanges(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    constexpr size_t RUN_LENGTH = 5;
+    size_t totalSize = state.range(0);
+    std::vector<int> values(totalSize);
+    std::iota(values.begin(), values.end(), 0);
+    auto source = BuilderT::bulkLoad(values.data(), totalSize);
+    std::vector<std::pair<size_t, size_t>> ranges;
+    for (size_t pos = 0; pos + RUN_LENGTH <= totalSize; pos += 2 * RUN_LENGTH) {
+        ranges.emplace_back(pos, RUN_LENGTH);
+    }
+    for (auto _: state) {
+        BuilderT builder;
+        if constexpr (Batched) {
+            builder.addRanges(source, ranges);
+        } else {
+            for (const auto &[offset, length]: ranges) {
+                builder.addNode(source, offset, length);
+            }
+        }
+        auto root = builder.close();
+        benchmark::DoNotOptimize(root.get());
+        state.PauseTiming();
+        root = typename BuilderT::VarType();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * ranges.size());
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_ScatteredRangesByAddNode(benchmark::State &state) {
+    keepScatteredRanges<MaxCount, Size, false>(state);
+}
+
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_ScatteredRangesByAddRanges(benchmark::State &state) {
+    keepScatteredRanges<MaxCount, Size, true>(state);
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_ScatteredRangesByAddNode, 16, 64)->Range(1 << 12, 1 << 18);
+BENCHMARK_TEMPLATE(BM_BNode_ScatteredRangesByAddRanges, 16, 64)->Range(1 << 12, 1 << 18);
+
+/*
+ * Erasing and moving random ranges of up to 1/8 of a bulk loaded tree: split and concat touch only the seams, so the
+ * cost should grow with the height of the tree rather than with its size. Each iteration does one of each.
+ */
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_EraseAndMove(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    std::vector<int> values(totalSize);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), totalSize);
+    std::mt19937_64 gen(23);
+    std::uniform_int_distribution<size_t> position(0, totalSize - totalSize / 8);
+    for (auto _: state) {
+        auto erased = BuilderT::erase(root, position(gen), totalSize / 8);
+        auto moved = BuilderT::moveRange(root, position(gen), totalSize / 8, position(gen));
+        benchmark::DoNotOptimize(erased.get());
+        benchmark::DoNotOptimize(moved.get());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_EraseAndMove, 16, 64)->Range(1 << 16, 1 << 26);
+BENCHMARK_TEMPLATE(BM_BNode_EraseAndMove, 64, 64)->Range(1 << 16, 1 << 26);
+
+/*
+ * Edit loop: every iteration reopens the tree in a new builder, appends one leaf and closes it again. With
+ * state.range(1) == 1 a snapshot of the previous version is kept, so the spine has to be copied each time; without it
+ * the nodes are only reachable from the builder and get reopened in place.
+ */
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_RepeatedEdits(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    size_t totalSize = state.range(0);
+    bool keepSnapshot = state.range(1);
+    std::vector<int> values(totalSize);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), totalSize);
+    std::array<int, Size> leafData{};
+    typename BuilderT::VarType snapshot;
+    for (auto _: state) {
+        if (keepSnapshot) {
+            snapshot = BuilderT::BNodeT::copyNode(root);
+        }
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), Size);
+        BuilderT builder;
+        builder.addNode(std::move(root));
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+        root = builder.close();
+    }
+    benchmark::DoNotOptimize(root.get());
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_RepeatedEdits, 16, 64)->ArgsProduct({{1 << 16, 1 << 24}, {0, 1}});
+BENCHMARK_TEMPLATE(BM_BNode_RepeatedEdits, 64, 64)->ArgsProduct({{1 << 16, 1 << 24}, {0, 1}});
+
+/*
+ * Diff of a tree against a version with a small range erased and another one updated through a new leaf: only the
+ * nodes along the seams get opened, so the cost should follow the height of the tree rather than its size
+ */
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_Diff(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    size_t totalSize = state.range(0);
+    std::vector<int> values(totalSize);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), totalSize);
+    auto erased = BuilderT::erase(root, totalSize / 3, 10);
+    auto [left, right] = BuilderT::split(root, 2 * totalSize / 3);
+    auto leaf = LeafT::createLeaf(nullptr);
+    leaf.add(values.data(), Size);
+    BuilderT builder;
+    builder.addNode(left);
+    builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    builder.addNode(BuilderT::erase(right, 0, Size));
+    auto updated = builder.close();
+    for (auto _: state) {
+        auto erasedChanges = diff(root, erased);
+        auto updatedChanges = diff(root, updated);
+        benchmark::DoNotOptimize(erasedChanges.data());
+        benchmark::DoNotOptimize(updatedChanges.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_Diff, 16, 64)->Range(1 << 16, 1 << 26);
+BENCHMARK_TEMPLATE(BM_BNode_Diff, 64, 64)->Range(1 << 16, 1 << 26);
+
+/*
+ * Thread scaling of the parallel bulk loader, 1 to 32 threads over the same input. Wall time is what counts here, the
+ * main thread only loads its own partition and stitches the seams. Only meaningful on a machine with that many cores,
+ * above the core count the partitions just take turns.
+ */
+template<size_t MaxCount, size_t Size>
+static void BM_BNode_ParallelBulkLoad(benchmark::State &state) {
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    size_t threadCount = state.range(1);
+    std::vector<int> values(totalSize);
+    std::iota(values.begin(), values.end(), 0);
+    for (auto _: state) {
+        auto root = BuilderT::parallelBulkLoad(values.data(), totalSize, threadCount);
+        benchmark::DoNotOptimize(root.get());
+        state.PauseTiming();
+        root = typename BuilderT::VarType();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * totalSize * sizeof(int));
+}
+
+/*
+ * Same for index trees, every partition filling the copy lists of its own allocation session
+ */
+template<size_t MaxCount>
+static void BM_Index_ParallelBulkLoad(benchmark::State &state) {
+    constexpr size_t BLOCK_SIZE = 64;
+    using BuilderT = Builder<size_t, MaxCount, BLOCK_SIZE, IndexAdapter>;
+    size_t totalSize = state.range(0);
+    size_t threadCount = state.range(1);
+    std::vector<size_t> rows(totalSize);
+    std::iota(rows.begin(), rows.end(), 0);
+    SpaceProvider<BLOCK_SIZE> spaceProvider;
+    for (auto _: state) {
+        std::vector<std::unique_ptr<typename SpaceProvider<BLOCK_SIZE>::AllocationSession>> sessions;
+        auto root = BuilderT::parallelBulkLoad(rows.data(), totalSize, threadCount, [&](size_t) {
+            sessions.push_back(spaceProvider.newAllocationSession());
+            return static_cast<void *>(sessions.back().get());
+        });
+        benchmark::DoNotOptimize(root.get());
+        state.PauseTiming();
+        for (auto &session: sessions) {
+            session->close();
+        }
+        root = typename BuilderT::VarType();
+        state.ResumeTiming();
+    }
+    state.SetBytesProcessed(state.iterations() * totalSize * sizeof(size_t));
+}
+
+BENCHMARK_TEMPLATE(BM_BNode_ParallelBulkLoad, 16, 1024)->ArgsProduct({{1 << 26}, {1, 2, 4, 8, 16, 32}})->UseRealTime();
+BENCHMARK_TEMPLATE(BM_BNode_ParallelBulkLoad, 64, 64)->ArgsProduct({{1 << 24}, {1, 2, 4, 8, 16, 32}})->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Index_ParallelBulkLoad, 16)->ArgsProduct({{1 << 24}, {1, 2, 4, 8, 16, 32}})->UseRealTime();
@@ -0,0 +1,235 @@
+#include <benchmark/benchmark.h>
+#include "../Builder.h"
+
+#include <numeric>
+#include <random>
+#include <unordered_set>
+
+/*
+ * Builder under a seeded random splice workload, the way frames use it: a pool of const trees, each op reading one or
+ * two of them (random slices, a split and concat, slices added as prefix, fresh leaves and whole subtrees mixed with
+ * slices) and replacing a pool tree with the result. Sizes are capped at state.range(0), so the pool keeps a steady
+ * shape and any run length replays the same ops. The per op counters come from an untimed replay of the same seed:
+ *  - leavesCopied, valuesCopied: leaves of the result that are not shared with the inputs, and the values they hold
+ *  - nodesAllocated: ANodes and BNodes of the result that are not shared with the inputs
+ *  - height, leafFill, nodeFill: average over the results of the height, the values per leaf over SIZE and the
+ *  children per BNode over MAX_COUNT
+ * A change in addToExisting or balance that keeps the time but copies more, or packs worse, shows there.
+ */
+
+template<size_t MaxCount, size_t Size>
+class SpliceWorkload {
+public:
+    using BuilderT = Builder<int, MaxCount, Size, ArrayAdapter>;
+    using VarType = typename BuilderT::VarType;
+    using LeafT = typename BuilderT::LeafT;
+    using BNodeT = typename BuilderT::BNodeT;
+
+    enum Op {
+        SLICES, SPLICE, PREFIX, LEAVES, SUBTREE, OP_COUNT
+    };
+
+private:
+    std::mt19937_64 gen_;
+    size_t maxSize_;
+    std::vector<VarType> pool_;
+    //the trees read by the last op, and the fresh leaves it added
+    std::vector<const VarType *> inputs_;
+    std::vector<const void *> freshLeaves_;
+    int nextValue_ = 0;
+
+    size_t random(size_t from, size_t to) { return std::uniform_int_distribution<size_t>(from, to)(gen_); }
+
+    const VarType &pick() {
+        inputs_.push_back(&pool_[random(0, pool_.size() - 1)]);
+        return *inputs_.back();
+    }
+
+    /**
+     * Adds a random slice of tree of at most maxLength values
+     */
+    void addSlice(BuilderT &builder, const VarType &tree, size_t maxLength, bool asPrefix = false) {
+        size_t treeSize = sizeOf(tree);
+        size_t length = random(1, std::min(treeSize, maxLength));
+        builder.addNode(tree, random(0, treeSize - length), length, asPrefix);
+    }
+
+    void addFreshLeaf(BuilderT &builder, bool asPrefix) {
+        std::array<int, Size> values;
+        size_t length = random(1, Size);
+        std::iota(values.begin(), values.begin() + length, nextValue_);
+        nextValue_ += int(length);
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(values.data(), length);
+        auto leafPtr = LeafT::createLeafPtr(std::move(leaf));
+        freshLeaves_.push_back(leafPtr.get());
+        builder.addNode(std::move(leafPtr), asPrefix);
+    }
+
+    VarType run(Op op) {
+        BuilderT builder;
+        switch (op) {
+            case SLICES: {
+                size_t count = random(1, 4);
+                for (size_t i = 0; i < count; i++) {
+                    addSlice(builder, pick(), maxSize_ / count);
+                }
+                return builder.close();
+            }
+            case SPLICE: {
+                //a prefix of one tree followed by a suffix of another
+                const VarType &left = pick();
+                const VarType &right = pick();
+                size_t leftLength = random(1, std::min(sizeOf(left), maxSize_ - 1));
+                size_t rightLength = random(1, std::min(sizeOf(right), maxSize_ - leftLength));
+                VarType prefix;
+                VarType suffix;
+                if (leftLength < sizeOf(left)) {
+                    prefix = BuilderT::split(left, leftLength).first;
+                }
+                if (rightLength < sizeOf(right)) {
+                    suffix = BuilderT::split(right, sizeOf(right) - rightLength).second;
+                }
+                return BuilderT::concat(prefix ? prefix : left, suffix ? suffix : right);
+            }
+            case PREFIX: {
+                addSlice(builder, pick(), maxSize_ / 2);
+                addSlice(builder, pick(), maxSize_ / 2, true);
+                return builder.close();
+            }
+            case LEAVES: {
+                addSlice(builder, pick(), maxSize_ - 3 * Size);
+                for (size_t count = random(1, 3); count; count--) {
+                    addFreshLeaf(builder, random(0, 1));
+                }
+                return builder.close();
+            }
+            default: {
+                //a whole child of a root, and a slice of another tree on either side of it
+                const VarType &tree = pick();
+                const VarType *subtree = &tree;
+                if (tree.index() == 5) {
+                    const auto *root = getNode<typename BuilderT::BNodeCPtr>(tree);
+                    subtree = &root->childAt(random(0, root->childrenCount() - 1));
+                }
+                builder.addNode(*subtree);
+                if (sizeOf(*subtree) < maxSize_) {
+                    addSlice(builder, pick(), maxSize_ - sizeOf(*subtree), random(0, 1));
+                }
+                return builder.close();
+            }
+        }
+    }
+
+public:
+    /**
+     * Totals over the ops of a replay, see the counters above
+     */
+    struct Stats {
+        size_t leavesCopied = 0;
+        size_t valuesCopied = 0;
+        size_t nodesAllocated = 0;
+        size_t height = 0;
+        size_t leaves = 0;
+        size_t values = 0;
+        size_t bnodes = 0;
+        size_t children = 0;
+    };
+
+private:
+    template<class Visitor>
+    static void forEachNode(Visitor &&visitor, const VarType &root) {
+        auto walk = [&](auto &self, const auto &node) -> void {
+            visitor(node);
+            if constexpr (!std::is_same_v<std::remove_cvref_t<decltype(node)>, LeafT>) {
+                node.forEachChildNode([&](const auto &child, size_t, size_t) {
+                    self(self, child);
+                }, 0, node.size());
+            }
+        };
+        if (root) {
+            visitConstNode([&](const auto &node) { walk(walk, node); }, root);
+        }
+    }
+
+    /**
+     * Must run while the inputs are alive, before the allocator gets a chance to hand their nodes out again
+     */
+    void addStats(const VarType &result, Stats &stats) const {
+        std::unordered_set<const void *> shared(freshLeaves_.begin(), freshLeaves_.end());
+        for (const auto *input: inputs_) {
+            forEachNode([&](const auto &node) { shared.insert(&node); }, *input);
+        }
+        stats.height += heightOf(result);
+        forEachNode([&](const auto &node) {
+            using NodeT = std::remove_cvref_t<decltype(node)>;
+            bool isNew = !shared.contains(&node);
+            if constexpr (std::is_same_v<NodeT, LeafT>) {
+                stats.leaves++;
+                stats.values += node.size();
+                stats.leavesCopied += isNew;
+                stats.valuesCopied += isNew ? node.size() : 0;
+            } else {
+                stats.nodesAllocated += isNew;
+                if constexpr (std::is_same_v<NodeT, BNodeT>) {
+                    stats.bnodes++;
+                    stats.children += node.childrenCount();
+                }
+            }
+        }, result);
+    }
+
+public:
+    SpliceWorkload(size_t maxSize, size_t treeCount, uint64_t seed) : gen_(seed), maxSize_(std::max(maxSize, 4 * Size)) {
+        std::vector<int> values(maxSize_);
+        for (size_t i = 0; i < treeCount; i++) {
+            std::iota(values.begin(), values.end(), nextValue_);
+            nextValue_ += int(maxSize_);
+            pool_.push_back(BuilderT::bulkLoad(values.data(), random(maxSize_ / 2, maxSize_)));
+        }
+    }
+
+    /**
+     * Runs one random op and replaces a pool tree with its result, which it returns. The shape of the result gets
+     * added to stats when given, which takes a walk of the inputs and is only meant for untimed replays.
+     */
+    const VarType &next(Stats *stats = nullptr) {
+        inputs_.clear();
+        freshLeaves_.clear();
+        auto result = run(Op(random(0, OP_COUNT - 1)));
+        if (stats) {
+            addStats(result, *stats);
+        }
+        return pool_[random(0, pool_.size() - 1)] = std::move(result);
+    }
+};
+
+template<size_t MaxCount, size_t Size>
+static void BM_Builder_Splice(benchmark::State &state) {
+    using Workload = SpliceWorkload<MaxCount, Size>;
+    constexpr size_t TREE_COUNT = 16;
+    constexpr size_t SEED = 42;
+    constexpr size_t STATS_OPS = 1000;
+    size_t maxSize = state.range(0);
+    Workload workload(maxSize, TREE_COUNT, SEED);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(&workload.next());
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    typename Workload::Stats stats;
+    Workload replay(maxSize, TREE_COUNT, SEED);
+    for (size_t i = 0; i < STATS_OPS; i++) {
+        replay.next(&stats);
+    }
+    state.counters["leavesCopied"] = double(stats.leavesCopied) / STATS_OPS;
+    state.counters["valuesCopied"] = double(stats.valuesCopied) / STATS_OPS;
+    state.counters["nodesAllocated"] = double(stats.nodesAllocated) / STATS_OPS;
+    state.counters["height"] = double(stats.height) / STATS_OPS;
+    state.counters["leafFill"] = double(stats.values) / (stats.leaves * Size);
+    state.counters["nodeFill"] = stats.bnodes ? double(stats.children) / (stats.bnodes * MaxCount) : 0;
+}
+
+BENCHMARK_TEMPLATE(BM_Builder_Splice, 4, 8)->Range(1 << 10, 1 << 16);
+BENCHMARK_TEMPLATE(BM_Builder_Splice, 16, 64)->Range(1 << 12, 1 << 20);
+BENCHMARK_TEMPLATE(BM_Builder_Splice, 64, 256)->Range(1 << 14, 1 << 22);
@@ -0,0 +1,115 @@
+#include <benchmark/benchmark.h>
+#include "../Builder.h"
+#include "../Geometry.h"
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <random>
+#include <string>
+
+/*
+ * Mixed splice/scan/seek workload across the node geometry profiles. Each iteration splices a random range of the tree
+ * to another position, scans SCAN_LENGTH values from a random offset and looks up SEEK_COUNT random positions. The
+ * rate of every profile is kept per tree size, and the fastest profile for each size is printed once all benchmarks
+ * are done (run with --benchmark_filter=Geometry to compare the profiles on the host machine).
+ */
+
+constexpr size_t SCAN_LENGTH = 4096;
+constexpr size_t SEEK_COUNT = 64;
+
+namespace {
+    class GeometryScoreboard {
+        //tree size -> profile -> iterations per second of the last run
+        std::map<size_t, std::map<std::string, double>> rates_;
+
+    public:
+        static GeometryScoreboard &oneAndOnly() {
+            static GeometryScoreboard scoreboard;
+            return scoreboard;
+        }
+
+        void record(size_t treeSize, const std::string &profile, double rate) { rates_[treeSize][profile] = rate; }
+
+        ~GeometryScoreboard() {
+            for (const auto &[treeSize, rates]: rates_) {
+                auto best = std::max_element(rates.begin(), rates.end(), [](const auto &l, const auto &r) {
+                    return l.second < r.second;
+                });
+                printf("Best geometry for %zu values: %s (%.0f mixes/s)\n", treeSize, best->first.c_str(), best->second);
+            }
+        }
+    };
+}
+
+template<class GEOMETRY>
+static std::string geometryName() {
+    return "Geometry<" + std::to_string(GEOMETRY::MAX_COUNT) + ", " + std::to_string(GEOMETRY::SIZE) + ">";
+}
+
+template<class GEOMETRY>
+static auto &geometryTreeForSize(size_t totalSize) {
+    using BuilderT = GeometryBuilder<size_t, GEOMETRY>;
+    using LeafT = typename BuilderT::LeafT;
+    //never released, the node pools may be gone by the time static destructors run
+    static auto &trees = *new std::map<size_t, typename BuilderT::VarType>();
+    auto it = trees.find(totalSize);
+    if (it != trees.end()) {
+        return it->second;
+    }
+    BuilderT builder;
+    std::array<size_t, GEOMETRY::SIZE> leafData;
+    for (size_t pos = 0; pos < totalSize; pos += GEOMETRY::SIZE) {
+        for (size_t i = 0; i < GEOMETRY::SIZE; i++) {
+            leafData[i] = pos + i;
+        }
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), std::min(GEOMETRY::SIZE, totalSize - pos));
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    return trees.emplace(totalSize, builder.close()).first->second;
+}
+
+template<class GEOMETRY>
+static void BM_Geometry_Mixed(benchmark::State &state) {
+    using BuilderT = GeometryBuilder<size_t, GEOMETRY>;
+    size_t totalSize = state.range(0);
+    auto &root = geometryTreeForSize<GEOMETRY>(totalSize);
+    std::mt19937_64 gen(17);
+    std::uniform_int_distribution<size_t> position(0, totalSize - 1);
+
+    auto start = std::chrono::steady_clock::now();
+    for (auto _: state) {
+        //splice: move [from, from + length) in front of to, all four pieces are non empty
+        size_t from = 2 + position(gen) % (totalSize - SCAN_LENGTH - 2);
+        size_t length = 1 + position(gen) % SCAN_LENGTH;
+        size_t to = 1 + position(gen) % (from - 1);
+        BuilderT builder;
+        builder.addNode(root, 0, to);
+        builder.addNode(root, from, length);
+        builder.addNode(root, to, from - to);
+        builder.addNode(root, from + length, totalSize - from - length);
+        auto spliced = builder.close();
+
+        size_t sum = 0;
+        BuilderT::forEachLeaf([&](const auto &leaf, size_t offset, size_t len) {
+            const size_t *data = leaf.data() + offset;
+            for (size_t i = 0; i < len; i++) {
+                sum += data[i];
+            }
+        }, spliced, position(gen) % (totalSize - SCAN_LENGTH), SCAN_LENGTH);
+
+        for (size_t i = 0; i < SEEK_COUNT; i++) {
+            sum += valueAt(position(gen), spliced);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    GeometryScoreboard::oneAndOnly().record(totalSize, geometryName<GEOMETRY>(), state.iterations() / elapsed.count());
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_TEMPLATE(BM_Geometry_Mixed, geometry::L1)->Range(1 << 16, 1 << 24);
+BENCHMARK_TEMPLATE(BM_Geometry_Mixed, geometry::L2)->Range(1 << 16, 1 << 24);
+BENCHMARK_TEMPLATE(BM_Geometry_Mixed, geometry::TLB)->Range(1 << 16, 1 << 24);
+BENCHMARK_TEMPLATE(BM_Geometry_Mixed, Geometry<16, 1024>)->Range(1 << 16, 1 << 24);
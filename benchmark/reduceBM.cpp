@@ -0,0 +1,95 @@
+#include <benchmark/benchmark.h>
+#include "../Builder.h"
+
+#include <map>
+
+/*
+ * Sum/min/max/count over a whole tree: the scalar Leaf::at loop driven by Builder::forEachLeaf against the span
+ * kernels for each instruction set available on the running cpu. Builder::summarize answers const subtrees from
+ * their cached summaries, so it only scans the two edge leaves of the range.
+ */
+
+template<class T, size_t MaxCount, size_t Size>
+static auto &treeForSize(size_t totalSize) {
+    using BuilderT = Builder<T, MaxCount, Size, ArrayAdapter>;
+    using LeafT = typename BuilderT::LeafT;
+    //never released, the node pools may be gone by the time static destructors run
+    static auto &trees = *new std::map<size_t, typename BuilderT::VarType>();
+    auto it = trees.find(totalSize);
+    if (it != trees.end()) {
+        return it->second;
+    }
+    BuilderT builder;
+    std::array<T, Size> leafData;
+    for (size_t pos = 0; pos < totalSize; pos += Size) {
+        for (size_t i = 0; i < Size; i++) {
+            leafData[i] = T((pos + i) % 1013);
+        }
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), std::min(Size, totalSize - pos));
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    return trees.emplace(totalSize, builder.close()).first->second;
+}
+
+template<class T, size_t MaxCount, size_t Size>
+static void BM_Reduce_LeafAtLoop(benchmark::State &state) {
+    using BuilderT = Builder<T, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = treeForSize<T, MaxCount, Size>(totalSize);
+    for (auto _: state) {
+        Summary<T> result;
+        BuilderT::forEachLeaf([&](const auto &leaf, size_t offset, size_t len) {
+            for (size_t i = offset; i < offset + len; i++) {
+                result.add(leaf.at(i));
+            }
+        }, root, 0, totalSize);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetBytesProcessed(state.iterations() * totalSize * sizeof(T));
+}
+
+template<class T, size_t MaxCount, size_t Size>
+static void BM_Reduce_Kernel(benchmark::State &state) {
+    using BuilderT = Builder<T, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto isa = ReduceIsa(state.range(1));
+    if (!isReduceIsaSupported(isa)) {
+        state.SkipWithError("Instruction set not supported");
+        return;
+    }
+    auto kernel = reduceKernel<T>(isa);
+    auto &root = treeForSize<T, MaxCount, Size>(totalSize);
+    for (auto _: state) {
+        Summary<T> result;
+        BuilderT::forEachLeaf([&](const auto &leaf, size_t offset, size_t len) {
+            result += kernel(leaf.data() + offset, len);
+        }, root, 0, totalSize);
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetBytesProcessed(state.iterations() * totalSize * sizeof(T));
+}
+
+template<class T, size_t MaxCount, size_t Size>
+static void BM_Reduce_Summarize(benchmark::State &state) {
+    using BuilderT = Builder<T, MaxCount, Size, ArrayAdapter>;
+    size_t totalSize = state.range(0);
+    auto &root = treeForSize<T, MaxCount, Size>(totalSize);
+    //unaligned edges exercise the partial leaves at both ends of the range
+    size_t offset = Size / 3;
+    size_t len = totalSize - offset - Size / 5;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(BuilderT::summarize(root, offset, len));
+    }
+    state.SetBytesProcessed(state.iterations() * len * sizeof(T));
+}
+
+#define APPLY_TYPE_TO_REDUCE_BM(T, COUNT, SIZE) \
+BENCHMARK_TEMPLATE(BM_Reduce_LeafAtLoop, T, COUNT, SIZE)->Range(1 << 12, 1 << 24);\
+BENCHMARK_TEMPLATE(BM_Reduce_Kernel, T, COUNT, SIZE)->ArgsProduct({benchmark::CreateRange(1 << 12, 1 << 24, 8), \
+    {int(ReduceIsa::Scalar), int(ReduceIsa::Generic), int(ReduceIsa::Avx2)}})->ArgNames({"size", "isa"});\
+BENCHMARK_TEMPLATE(BM_Reduce_Summarize, T, COUNT, SIZE)->Range(1 << 12, 1 << 24)
+
+APPLY_TYPE_TO_REDUCE_BM(int, 16, 1024);
+APPLY_TYPE_TO_REDUCE_BM(int64_t, 16, 1024);
+APPLY_TYPE_TO_REDUCE_BM(double, 16, 1024);
@@ -0,0 +1,56 @@
+#include <benchmark/benchmark.h>
+#include "../Search.h"
+
+#include <algorithm>
+#include <random>
+
+/*
+ * Child search over a full node's cumulative sizes, as done by lowerBoundPos at every level of a positional access:
+ * std::lower_bound against the branchless cumLowerBound, for random targets.
+ */
+
+template<size_t MaxCount>
+static auto cumSizesAndTargets() {
+    std::array<size_t, MaxCount> cumSize;
+    std::mt19937_64 gen(MaxCount);
+    std::uniform_int_distribution<size_t> childSize(1, 1 << 16);
+    size_t total = 0;
+    for (auto &value: cumSize) {
+        value = total += childSize(gen);
+    }
+    std::vector<size_t> targets(1 << 12);
+    std::uniform_int_distribution<size_t> target(1, total);
+    for (auto &value: targets) {
+        value = target(gen);
+    }
+    return std::make_pair(cumSize, targets);
+}
+
+template<size_t MaxCount>
+static void BM_Search_StdLowerBound(benchmark::State &state) {
+    auto [cumSize, targets] = cumSizesAndTargets<MaxCount>();
+    size_t pos = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(
+                std::lower_bound(cumSize.begin(), cumSize.end(), targets[pos++ & (targets.size() - 1)]));
+    }
+}
+
+template<size_t MaxCount>
+static void BM_Search_CumLowerBound(benchmark::State &state) {
+    auto [cumSize, targets] = cumSizesAndTargets<MaxCount>();
+    size_t pos = 0;
+    for (auto _: state) {
+        benchmark::DoNotOptimize(cumLowerBound(cumSize.data(), MaxCount, targets[pos++ & (targets.size() - 1)]));
+    }
+}
+
+#define APPLY_COUNT_TO_SEARCH_BM(BM) \
+BENCHMARK_TEMPLATE(BM, 16);\
+BENCHMARK_TEMPLATE(BM, 32);\
+BENCHMARK_TEMPLATE(BM, 64);\
+BENCHMARK_TEMPLATE(BM, 128);\
+BENCHMARK_TEMPLATE(BM, 256)
+
+APPLY_COUNT_TO_SEARCH_BM(BM_Search_StdLowerBound);
+APPLY_COUNT_TO_SEARCH_BM(BM_Search_CumLowerBound);
@@ -4,7 +4,13 @@
 #include <arrow/table.h>
 #include <map>
 #include <unordered_map>
+#include <variant>
+#include "../BlockDirectory.h"
 #include "../BuilderDecl.h"
+#include "../Diff.h"
+#include "../FrozenTree.h"
+#include "../Geometry.h"
+#include "../MemoryReport.h"
 #include "FrameSpaceFwd.h"
 #include "Compact.h"
 
@@ -126,65 +132,86 @@ namespace framespaces {
     };
 
 
+    /**
+     * A DataProvider is an abstract interface for any external source of arrow tables.
+     * The DataProvider guarantees the data values remained the same across all subsequent visit function calls
+     *
+     * One or more DataProvider objects are mapped by DataFrameSpace into the Virtual Space.
+     *
+     * Effectively all read requests mapping to a DataProvider are delegated to that provider
+     */
+    class DataProvider {
+    public:
+        /**
+         * Provides access to data for a given range
+         * @param visitor - Visitor function used to read the provided data - the function may be invoked one or
+         *                  multiple times, delivering requested data in consecutive chunks.
+         * @param providerOffset The beginning of the data range, in the DataProvider space (i.e. this offset is
+         *                          fully agnostic of corresponding SpacePointer
+         * @param rowsCount The numbers of rows to process
+         * @param columns The subset of columns to be passed to the visitor function
+         */
+        virtual void visit(std::function<void(const arrow::Table &, size_t, uint32_t)> visitor,
+                           size_t providerOffset, RangeLength rowsCount,
+                           const std::vector<int> &columns) const = 0;
+
+        virtual size_t numRows() const = 0;
+
+    };
+
     /**
      *  A DataFrameSpace is an ordered set of parallel Column Spaces (see Column Space story above):
      *  By parallel we imply that a Column Space address is either valid for each Column Source Space or by none of them.
      *
      *  The DataFrameSpace is split in between "Allocated Space" composed of in-memory available arrow arrays/tables and
      *  "Virtual Space" where requests are delegated to external DataProvider objects.
+     *
+     *  GEOMETRY is the node geometry of the indices over the space (see DefaultIndexGeometry), the space itself does not
+     *  depend on it.
      */
-    class DataFrameSpace {
+    template<class GEOMETRY>
+    class BasicDataFrameSpace {
     public:
+        using Index = BasicIndex<GEOMETRY>;
         using Provider = SpaceProvider<SPACE_BLOCK_SIZE>;
         using Session = typename Provider::AllocationSession;
-
-        class DataProvider;
+        using DataProvider = framespaces::DataProvider;
 
 
     private:
+        /**
+         * What an address range maps to: an in-memory table, or a provider when table is null
+         */
+        struct SpaceBlock {
+            std::shared_ptr<arrow::Table> table;
+            std::shared_ptr<DataProvider> provider;
+        };
+
+        //registered by any number of threads at once and read without locking (see BlockDirectory)
+        BlockDirectory<SpaceBlock, SPACE_BLOCK_SIZE> blocks_;
+        //declared after blocks_: destroyed first, it detaches releaseData before blocks_ goes, indices outliving the
+        //space then only recycle their addresses
         Provider spaceProviderImpl_;
-        std::map<size_t, std::shared_ptr<arrow::Table>> blocksMap_;
-        std::map<size_t, std::shared_ptr<DataProvider>> providersMap_;
 
-        friend class IndexMutationSession;
+        friend class BasicIndexMutationSession<GEOMETRY>;
 
         std::unique_ptr<Session> createMutationContext() {
             return spaceProviderImpl_.newAllocationSession();
         }
 
-        //The schema associated with this DataFrameSpace
-        std::shared_ptr<arrow::Schema> schema_;
-    public:
         /**
-         * A DataProvider is an abstract interface for any external source of arrow tables.
-         * The DataProvider guarantees the data values remained the same across all subsequent visit function calls
-         *
-         * One or more DataProvider objects are mapped by DataFrameSpace into the Virtual Space.
-         *
-         * Effectively all read requests mapping to a DataProvider are delegated to that provider
+         * Drops whatever got registered at address, called by the space provider once no Index references the
+         * address any longer
          */
-        class DataProvider {
-        public:
-            /**
-             * Provides access to data for a given range
-             * @param visitor - Visitor function used to read the provided data - the function may be invoked one or
-             *                  multiple times, delivering requested data in consecutive chunks.
-             * @param providerOffset The beginning of the data range, in the DataProvider space (i.e. this offset is
-             *                          fully agnostic of corresponding SpacePointer
-             * @param rowsCount The numbers of rows to process
-             * @param columns The subset of columns to be passed to the visitor function
-             */
-            virtual void visit(std::function<void(const arrow::Table &, size_t, uint32_t)> visitor,
-                               size_t providerOffset, RangeLength rowsCount,
-                               const std::vector<int> &columns) const = 0;
-
-            virtual size_t numRows() const = 0;
-
-        };
+        void releaseData(SpacePointer address);
 
+        //The schema associated with this DataFrameSpace
+        std::shared_ptr<arrow::Schema> schema_;
     public:
 
-        DataFrameSpace(std::shared_ptr<arrow::Schema> schema) : schema_(schema) {};
+        BasicDataFrameSpace(std::shared_ptr<arrow::Schema> schema) : schema_(schema) {
+            spaceProviderImpl_.setReleaseListener([this](SpacePointer address, size_t) { releaseData(address); });
+        };
 
         std::shared_ptr<arrow::Schema> &schema() {
             return schema_;
@@ -329,27 +356,32 @@ namespace framespaces {
      *      stitches and slices in the constructing operation. A BNode is both immutable and agnostic of its absolute
      *      offset in the tree (it only maintains the relative offsets of its children), allowing for subtree reusal at
      *      potentially different positional offsets.
+     *
+     * GEOMETRY gives the fan-out of the index nodes, e.g. geometry::TLB for page sized nodes over indices of many
+     * ranges, the leaves always map one space block.
      */
-    class Index {
+    template<class GEOMETRY>
+    class BasicIndex {
     public:
-        using BuilderT = Builder<size_t, 16, SPACE_BLOCK_SIZE, IndexAdapter>;
+        using IndexGeometry = typename GEOMETRY::template WithSize<SPACE_BLOCK_SIZE>;
+        using BuilderT = GeometryBuilder<size_t, IndexGeometry, IndexAdapter>;
     private:
         using IndexImpl = typename BuilderT::VarType;
-        using LeafT = BuilderT::LeafT;
+        using LeafT = typename BuilderT::LeafT;
         using BlockPointer = typename SpaceProvider<SPACE_BLOCK_SIZE>::RefId;
 
         IndexImpl impl_;
 
-        friend class DataFrameSpace;
+        friend class BasicDataFrameSpace<GEOMETRY>;
 
-        friend class IndexMutationSession;
+        friend class BasicIndexMutationSession<GEOMETRY>;
 
-        Index(BlockPointer &&refId, size_t len) : impl_(LeafT::createLeafCPtr({std::move(refId), 0, len, len})) {};
+        BasicIndex(BlockPointer &&refId, size_t len) : impl_(LeafT::createLeafCPtr({std::move(refId), 0, len, len})) {};
 
-        Index(IndexImpl &&impl) : impl_(std::move(impl)) {};
+        BasicIndex(IndexImpl &&impl) : impl_(std::move(impl)) {};
     public:
 
-        Index(std::vector<std::pair<SpacePointer, RangeLength>> initializerList) {
+        BasicIndex(std::vector<std::pair<SpacePointer, RangeLength>> initializerList) {
             //Enforcing the MAX_FRAGMENTATION
             double elementCount = 0;
             double rangeCount = 0;
@@ -371,6 +403,66 @@ namespace framespaces {
          */
         void forEach(std::function<void(SpacePointer, RangeLength)> visitor, size_t offset, size_t length) const;
 
+        /**
+         * Space pointers of the rows at positions, given in any order, looked up as one batch (see Builder::multiGet)
+         * @param out Resized to positions.size(), out[i] receives the pointer of positions[i]
+         */
+        void multiGet(const std::vector<size_t> &positions, std::vector<SpacePointer> &out) const;
+
+        /**
+         * Memory pinned by the index, split in exclusive and shared with other indices (see ::memoryReport)
+         */
+        MemoryReport memoryReport() const;
+
+        /**
+         * Memory the index pins on top of base, i.e. what dropping it would release as long as base stays
+         */
+        MemoryReport memoryReport(const BasicIndex &base) const;
+
+        /**
+         * Row ranges that differ between this index and newer, typically the next version of the same data frame:
+         * the nodes both share are skipped whole (see ::diff), so caches and replicas can refresh in
+         * O(changes * log(rangeCount)) instead of rescanning the frame
+         */
+        std::vector<TreeChange> diff(const BasicIndex &newer) const;
+
+        /**
+         * Hash of the row addresses in [offset, offset + length), cached per node at makeConst: O(1) for the whole
+         * index and O(log(rangeCount)) for a range. Indices mapping the same rows hash the same however they were
+         * built, which makes it a cache key for results derived from a range of rows (see ContentHash for collisions).
+         * Addresses get recycled once no index references them, each block hashing with the epoch it was handed out at
+         * (see IndexAdapter::contentHash), so a key kept past the index doesn't match whatever gets registered there next.
+         */
+        ContentHash contentHash(size_t offset = 0, size_t length = std::numeric_limits<size_t>::max()) const;
+
+        /**
+         * Read only copy of an index laid out for seeks (see ::freeze), sharing its leaves. Worth its O(rangeCount)
+         * construction for indices that stay published and get read at random positions, e.g. the one of an
+         * ImmutableDataFrame. Separators are 32 bit unless the index maps 2^32 rows or more.
+         */
+        class Frozen {
+            std::variant<FrozenTree<LeafT>, FrozenTree<LeafT, uint64_t>> tree_;
+
+            friend class BasicIndex;
+
+            explicit Frozen(const IndexImpl &impl);
+
+        public:
+            /**
+             * Same as Index::forEach
+             */
+            void forEach(std::function<void(SpacePointer, RangeLength)> visitor, size_t offset, size_t length) const;
+
+            /**
+             * @return the space pointer of the row at pos, which must be below size()
+             */
+            SpacePointer operator[](size_t pos) const;
+
+            size_t size() const;
+        };
+
+        Frozen freeze() const;
+
         /**
          * @return Returns the mapped row count
          */
@@ -380,8 +472,12 @@ namespace framespaces {
     };
 
     //A data frame interface - A DataFrame can be thought of as an <Index,DataFrameSpace> pair.
-    class DataFrame {
+    template<class GEOMETRY>
+    class BasicDataFrame {
     public:
+        using Index = BasicIndex<GEOMETRY>;
+        using DataFrameSpace = BasicDataFrameSpace<GEOMETRY>;
+
         /**
          * Provides access to data for a given range
          * @param visitor Visitor function used to read the provided data - the function may be invoked one or
@@ -402,20 +498,27 @@ namespace framespaces {
 
         virtual size_t size() const = 0;
 
-        virtual std::shared_ptr<const DataFrame> snapshot() const = 0;
+        virtual std::shared_ptr<const BasicDataFrame> snapshot() const = 0;
     };
 
     /**
      * A read only data frame - it effectively composes an index and a DataFrameSpace object.
      */
-    class ImmutableDataFrame : public DataFrame, public std::enable_shared_from_this<ImmutableDataFrame> {
+    template<class GEOMETRY>
+    class BasicImmutableDataFrame : public BasicDataFrame<GEOMETRY>,
+                                    public std::enable_shared_from_this<BasicImmutableDataFrame<GEOMETRY>> {
+    public:
+        using DataFrame = BasicDataFrame<GEOMETRY>;
+        using Index = BasicIndex<GEOMETRY>;
+        using DataFrameSpace = BasicDataFrameSpace<GEOMETRY>;
+    private:
+        //The space containing the data, declared first so that it outlives the index releasing its addresses
+        const std::shared_ptr<DataFrameSpace> frameSpace_;
         //The index identifying the position of each row
         const Index index_;
-        //The space containing the data
-        const std::shared_ptr<DataFrameSpace> frameSpace_;
     public:
-        ImmutableDataFrame(Index &&index, const std::shared_ptr<DataFrameSpace> &frameSpace) :
-                index_(std::move(index)), frameSpace_(frameSpace) {}
+        BasicImmutableDataFrame(Index &&index, const std::shared_ptr<DataFrameSpace> &frameSpace) :
+                frameSpace_(frameSpace), index_(std::move(index)) {}
 
 
         void visit(std::function<void(const arrow::Table &, size_t, uint32_t)> visitor,
@@ -439,7 +542,7 @@ namespace framespaces {
         }
 
         std::shared_ptr<const DataFrame> snapshot() const override {
-            return std::static_pointer_cast<const DataFrame>(shared_from_this());
+            return std::static_pointer_cast<const DataFrame>(this->shared_from_this());
         }
 
     };
@@ -460,7 +563,14 @@ namespace framespaces {
      * is modifying the version it "thinks" it is modifying or else the operation fails (a write is required to check on
      * the current version and data snapshot prior making a change)
      */
-    class MutableDataFrame : public DataFrame {
+    template<class GEOMETRY>
+    class BasicMutableDataFrame : public BasicDataFrame<GEOMETRY> {
+    public:
+        using DataFrame = BasicDataFrame<GEOMETRY>;
+        using Index = BasicIndex<GEOMETRY>;
+        using DataFrameSpace = BasicDataFrameSpace<GEOMETRY>;
+        using ImmutableDataFrame = BasicImmutableDataFrame<GEOMETRY>;
+    private:
         size_t version_ = 0;
         std::shared_ptr<ImmutableDataFrame> currentFrame_;
 
@@ -468,7 +578,7 @@ namespace framespaces {
 
     public:
 
-        explicit MutableDataFrame(const std::shared_ptr<ImmutableDataFrame> &initialValue) : currentFrame_(
+        explicit BasicMutableDataFrame(const std::shared_ptr<ImmutableDataFrame> &initialValue) : currentFrame_(
                 initialValue) {
         }
 
@@ -539,14 +649,23 @@ namespace framespaces {
      * mutation would only create a TranslationLog (a log of the row copying that needs to happen) and produce a Index that points the
      * new ranges.
      */
-    class IndexMutationSession {
+    template<class GEOMETRY>
+    class BasicIndexMutationSession {
+    public:
+        using Index = BasicIndex<GEOMETRY>;
+        using DataFrameSpace = BasicDataFrameSpace<GEOMETRY>;
+    private:
         using BuilderT = typename Index::BuilderT;
         std::unique_ptr<typename DataFrameSpace::Session> sessionImpl_;
         BuilderT builder_;
+        //one cursor per source index (keyed by its root), resumed as long as its ranges come in increasing order
+        std::unordered_map<const void *, typename BuilderT::SourceCursor> cursors_;
+
+        typename BuilderT::SourceCursor &cursorFor(const Index &index, size_t offset);
 
         inline static constexpr auto NULL_ENTRY = DataFrameSpace::Provider::NULL_ENTRY;
     public:
-        IndexMutationSession(DataFrameSpace &frameSpace) : sessionImpl_(frameSpace.createMutationContext()) {
+        BasicIndexMutationSession(DataFrameSpace &frameSpace) : sessionImpl_(frameSpace.createMutationContext()) {
             builder_.setContext(sessionImpl_.get());
         };
 
@@ -554,14 +673,36 @@ namespace framespaces {
          * Adds a subRange of an index to the current index accumulation.
          *
          * Because indices a formed of immutable BTree nodes, the time and memory complexity are both O(<tree height>) = O(log(chunks count))
-         * Subsequent optimizations can make complexity be amortized min(O(len),O(log(chunks count))), effectively making small range
-         * insertions constant in memory and time cost.
+         * Consecutive calls against the same index with increasing offsets resume from where the previous range ended
+         * (see Builder::SourceCursor), so the interleaved ranges of insertAt/updateAt only pay for the nodes they add
+         * rather than a descent from the root each.
          * @param index
          * @param offset
          * @param len
          */
         void addSubIndex(const Index &index, size_t offset, size_t len);
 
+        /**
+         * Adds the <offset,length> ranges of index in order. Sorted and not overlapping ranges get added in a single walk
+         * of the index, the work being proportional to the nodes added rather than to the number of ranges; a range
+         * starting before the previous one ended restarts the walk from the root.
+         */
+        void addSubIndexRanges(const Index &index, const std::vector<std::pair<size_t, size_t>> &sortedRanges);
+
+        /**
+         * Adds index without the rows [offset, offset + len) (see Builder::erase): the subtrees on either side of the
+         * erased range are reused whole and only the nodes along the two seams get copied: O(fan-out * log(chunks
+         * count)), the seam leaves going through defragmentation.
+         */
+        void addErased(const Index &index, size_t offset, size_t len);
+
+        /**
+         * Adds index with the rows [srcOffset, srcOffset + len) moved to dstOffset, dstOffset being their position in
+         * the result (see Builder::moveRange): three splits and three concats, each O(fan-out * log(chunks count)), only
+         * the seams go through defragmentation.
+         */
+        void addMoved(const Index &index, size_t srcOffset, size_t len, size_t dstOffset);
+
         /**
          * Builds the final version of the index ensuring that it follows the fragmentation constraint specified in
          * Index class definition:
@@ -1,8 +1,39 @@
 #ifndef EXPERIMENTS_FRAMESPACEFWD_H
 #define EXPERIMENTS_FRAMESPACEFWD_H
 
+#include "../Geometry.h"
+
 namespace framespaces {
-    class Index;
+    /**
+     * Geometry profile of the index trees when none is given (see Geometry.h). Only the fan-out is taken from it, index
+     * leaves always map a whole space block.
+     */
+    using DefaultIndexGeometry = geometry::L1;
+
+    template<class GEOMETRY>
+    class BasicIndex;
+
+    template<class GEOMETRY>
+    class BasicDataFrameSpace;
+
+    template<class GEOMETRY>
+    class BasicDataFrame;
+
+    template<class GEOMETRY>
+    class BasicImmutableDataFrame;
+
+    template<class GEOMETRY>
+    class BasicMutableDataFrame;
+
+    template<class GEOMETRY>
+    class BasicIndexMutationSession;
+
+    using Index = BasicIndex<DefaultIndexGeometry>;
+    using DataFrameSpace = BasicDataFrameSpace<DefaultIndexGeometry>;
+    using DataFrame = BasicDataFrame<DefaultIndexGeometry>;
+    using ImmutableDataFrame = BasicImmutableDataFrame<DefaultIndexGeometry>;
+    using MutableDataFrame = BasicMutableDataFrame<DefaultIndexGeometry>;
+    using IndexMutationSession = BasicIndexMutationSession<DefaultIndexGeometry>;
 }
 
 #endif //EXPERIMENTS_FRAMESPACEFWD_H
@@ -3,6 +3,7 @@
 
 #include <arrow/pretty_print.h>
 #include "FrameSpaceDecl.h"
+#include "../Builder.h"
 #include "arrow/io/api.h"
 #include "parquet/arrow/reader.h"
 #include "parquet/arrow/writer.h"
@@ -10,7 +11,13 @@
 
 
 namespace framespaces {
-    struct DataFrameOperationExamples {
+    template<class GEOMETRY>
+    struct BasicDataFrameOperationExamples {
+        using Index = BasicIndex<GEOMETRY>;
+        using DataFrameSpace = BasicDataFrameSpace<GEOMETRY>;
+        using ImmutableDataFrame = BasicImmutableDataFrame<GEOMETRY>;
+        using MutableDataFrame = BasicMutableDataFrame<GEOMETRY>;
+        using IndexMutationSession = BasicIndexMutationSession<GEOMETRY>;
 
         /*
          * Each table mutation follow these steps (some may be skipped depenting on the operating nam):
@@ -47,14 +54,14 @@ namespace framespaces {
         struct MockParquetProvider {
             MockParquetProvider(std::string filePath);
 
-            std::shared_ptr<DataFrameSpace::DataProvider> getDataProvider();
+            std::shared_ptr<DataProvider> getDataProvider();
 
             size_t getRowCount();
 
             std::shared_ptr<arrow::Schema> schema();
         };
 
-        class ParquetProvider : public DataFrameSpace::DataProvider {
+        class ParquetProvider : public DataProvider {
             std::unique_ptr<parquet::arrow::FileReader> reader_;
             std::vector<size_t> rowGroupOffsets_;
         public:
@@ -237,6 +244,57 @@ namespace framespaces {
             dataFrame.mutate(dataFrameSnapShot.first + 1, std::move(immutableDataFrame));
         }
 
+        /**
+         * Deletes the rows [offset, offset + rowCount) of a mutable data frame. Unlike filter, the retained rows are not
+         * re-added range by range: the index gets split around the deleted rows and the two halves concatenated, so
+         * the cost is O(log(chunks count)) plus the defragmentation of the seam, however large the frame.
+         * @param dataFrame DataFrame to be modified
+         * @param offset Position of the first deleted row
+         * @param rowCount Number of rows to delete (clipped to the end of the frame)
+         */
+        static void eraseAt(MutableDataFrame &dataFrame, size_t offset, size_t rowCount) {
+            auto dataFrameSnapShot = dataFrame.versionAndSnapshot();
+            auto dataFrameSpace = dataFrameSnapShot.second->getSpace();
+            //* Step 1. N/A since there is no new external data
+            //* Step 2. N/A since there is no new index
+            //* Step 3. Create a result index by splitting the current one around the deleted rows
+            IndexMutationSession indexMutationSession(*dataFrameSpace);
+            indexMutationSession.addErased(dataFrameSnapShot.second->getIndex(), offset, rowCount);
+            std::pair<Index, TranslationLog> indexAndDefragmentation = indexMutationSession.close();
+            //* Step 4. Apply any defragmentation by copying data onto the new buffers
+            dataFrameSpace->applyDefragmentation(indexAndDefragmentation.second);
+            //* Step 5. Create a new DataFrame by combining the new index with the expanded Data Frame Space
+            auto immutableDataFrame = std::make_shared<ImmutableDataFrame>(std::move(indexAndDefragmentation.first),
+                                                                           dataFrameSpace);
+            dataFrame.mutate(dataFrameSnapShot.first + 1, std::move(immutableDataFrame));
+        }
+
+        /**
+         * Moves the rows [srcOffset, srcOffset + rowCount) of a mutable data frame so they start at dstOffset, the
+         * position being expressed in the frame without the moved rows. Same costs as eraseAt: the index gets cut in
+         * four pieces which are concatenated in their new order.
+         * @param dataFrame DataFrame to be modified
+         * @param srcOffset Position of the first moved row
+         * @param rowCount Number of rows to move
+         * @param dstOffset Position of the first moved row in the result
+         */
+        static void moveRange(MutableDataFrame &dataFrame, size_t srcOffset, size_t rowCount, size_t dstOffset) {
+            auto dataFrameSnapShot = dataFrame.versionAndSnapshot();
+            auto dataFrameSpace = dataFrameSnapShot.second->getSpace();
+            //* Step 1. N/A since there is no new external data
+            //* Step 2. N/A since there is no new index
+            //* Step 3. Create a result index by reordering the pieces of the current one
+            IndexMutationSession indexMutationSession(*dataFrameSpace);
+            indexMutationSession.addMoved(dataFrameSnapShot.second->getIndex(), srcOffset, rowCount, dstOffset);
+            std::pair<Index, TranslationLog> indexAndDefragmentation = indexMutationSession.close();
+            //* Step 4. Apply any defragmentation by copying data onto the new buffers
+            dataFrameSpace->applyDefragmentation(indexAndDefragmentation.second);
+            //* Step 5. Create a new DataFrame by combining the new index with the expanded Data Frame Space
+            auto immutableDataFrame = std::make_shared<ImmutableDataFrame>(std::move(indexAndDefragmentation.first),
+                                                                           dataFrameSpace);
+            dataFrame.mutate(dataFrameSnapShot.first + 1, std::move(immutableDataFrame));
+        }
+
         /**
          * Creates a new data frame containing a subset of the input data frame (for example the rows matching a filter condition)
          * @param src data frame we are filtering
@@ -255,10 +313,7 @@ namespace framespaces {
             //We create an index session and combine the subIndices we need to keep
             auto &currentIndex = dataFrameSnapShot.second->getIndex();
             IndexMutationSession indexMutationSession(*dataFrameSpace);
-            for (const auto &rangeToKeep :  rangesToKeep) {
-                size_t offsetInOriginalFrame = rangeToKeep.first;
-                indexMutationSession.addSubIndex(currentIndex, rangeToKeep.first, rangeToKeep.second);
-            }
+            indexMutationSession.addSubIndexRanges(currentIndex, rangesToKeep);
             std::pair<Index, TranslationLog> indexAndDefragmentation = indexMutationSession.close();
             //* Step 4. Apply any defragmentation by copying data onto the new buffers
             dataFrameSpace->applyDefragmentation(indexAndDefragmentation.second);
@@ -333,48 +388,50 @@ namespace framespaces {
         }
     };
 
-    Index DataFrameSpace::registerExternalData(std::shared_ptr<arrow::Table> newRows) {
+    using DataFrameOperationExamples = BasicDataFrameOperationExamples<DefaultIndexGeometry>;
+
+    template<class GEOMETRY>
+    auto BasicDataFrameSpace<GEOMETRY>::registerExternalData(std::shared_ptr<arrow::Table> newRows) -> Index {
         auto refId = spaceProviderImpl_.mapBlock(newRows->num_rows());
-        blocksMap_[refId.id()] = newRows;
-        return Index(std::move(refId), newRows->num_rows());
+        size_t rowsCount = newRows->num_rows();
+        blocks_.insert(refId.id(), rowsCount, {std::move(newRows), nullptr});
+        return Index(std::move(refId), rowsCount);
     }
 
-    Index DataFrameSpace::registerDataProvider(const std::shared_ptr<DataProvider> &provider, size_t rowsCount) {
+    template<class GEOMETRY>
+    auto BasicDataFrameSpace<GEOMETRY>::registerDataProvider(const std::shared_ptr<DataProvider> &provider,
+                                                             size_t rowsCount) -> Index {
         auto refId = spaceProviderImpl_.mapBlock(rowsCount);
-        providersMap_[refId.id()] = provider;
+        blocks_.insert(refId.id(), rowsCount, {nullptr, provider});
         return Index(std::move(refId), rowsCount);
     }
 
-    void DataFrameSpace::registerData(SpacePointer targetPointer, std::shared_ptr<arrow::Table> &&newBlock) {
-        assert(!blocksMap_.contains(targetPointer));
-        blocksMap_.emplace(targetPointer, std::move(newBlock));
+    template<class GEOMETRY>
+    void BasicDataFrameSpace<GEOMETRY>::registerData(SpacePointer targetPointer,
+                                                     std::shared_ptr<arrow::Table> &&newBlock) {
+        assert(newBlock->num_rows() <= SPACE_BLOCK_SIZE);
+        size_t rowsCount = newBlock->num_rows();
+        blocks_.insert(targetPointer, rowsCount, {std::move(newBlock), nullptr});
     }
 
-    void
-    DataFrameSpace::visit(std::function<void(const arrow::Table &, size_t, uint32_t)> visitor, SpacePointer spaceOffset,
-                          RangeLength rowsCount, const std::vector<int> &columns) const {
-        std::map<size_t, std::shared_ptr<arrow::Table>>::const_iterator blocksIt =
-                blocksMap_.upper_bound(spaceOffset);
-        blocksIt--;
-        std::map<size_t, std::shared_ptr<DataProvider>>::const_iterator providerIt = providersMap_.end();
+    template<class GEOMETRY>
+    void BasicDataFrameSpace<GEOMETRY>::releaseData(SpacePointer address) {
+        blocks_.erase(address);
+    }
+
+    template<class GEOMETRY>
+    void BasicDataFrameSpace<GEOMETRY>::visit(std::function<void(const arrow::Table &, size_t, uint32_t)> visitor,
+                                              SpacePointer spaceOffset, RangeLength rowsCount,
+                                              const std::vector<int> &columns) const {
         do {
-            RangeLength currentLen;
-            if (blocksIt->first + blocksIt->second->num_rows() <= spaceOffset) {
-                if (providerIt == providersMap_.end()) {
-                    providerIt = providersMap_.upper_bound(spaceOffset);
-                    providerIt--;
-                } else {
-                    assert(providerIt->first == spaceOffset);
-                }
-                size_t localOffset = spaceOffset - providerIt->first;
-                currentLen = std::min(static_cast<RangeLength>(providerIt->second->numRows() - localOffset),
-                                      rowsCount);
-                providerIt->second->visit(visitor, localOffset, currentLen, columns);
-                providerIt++;
+            const auto *mapping = blocks_.find(spaceOffset);
+            assert(mapping != nullptr);
+            size_t localOffset = spaceOffset - mapping->address;
+            RangeLength currentLen = std::min(static_cast<RangeLength>(mapping->size - localOffset), rowsCount);
+            if (!mapping->value.table) {
+                mapping->value.provider->visit(visitor, localOffset, currentLen, columns);
             } else {
-                arrow::Table &table = *blocksIt->second;
-                size_t localOffset = spaceOffset - blocksIt->first;
-                currentLen = std::min(static_cast<RangeLength>(table.num_rows() - localOffset), rowsCount);
+                arrow::Table &table = *mapping->value.table;
                 if (columns.empty()) {
                     visitor(table, localOffset, currentLen);
                 } else {
@@ -388,23 +445,68 @@ namespace framespaces {
                     auto subTable = arrow::Table::Make(std::make_shared<arrow::Schema>(subFields), std::move(subColumns));
                     visitor(*subTable, localOffset, currentLen);
                 }
-                blocksIt++;
             }
             rowsCount -= currentLen;
             spaceOffset += currentLen;
         } while (rowsCount);
     }
 
-    void IndexMutationSession::addSubIndex(const Index &index, size_t offset, size_t len) {
-        builder_.addNode(index.impl_, offset, len);
+    template<class GEOMETRY>
+    auto BasicIndexMutationSession<GEOMETRY>::cursorFor(const Index &index, size_t offset)
+    -> typename BuilderT::SourceCursor & {
+        //the cursor holds a reference to the root, so its address cannot be reused by another index meanwhile
+        auto it = cursors_.find(index.impl_.get());
+        if (it == cursors_.end()) {
+            return cursors_.emplace(index.impl_.get(), index.impl_).first->second;
+        }
+        if (offset < it->second.position()) {
+            it->second = typename BuilderT::SourceCursor(index.impl_);
+        }
+        return it->second;
+    }
+
+    template<class GEOMETRY>
+    void BasicIndexMutationSession<GEOMETRY>::addSubIndex(const Index &index, size_t offset, size_t len) {
+        cursorFor(index, offset).append(builder_, offset, len);
+    }
+
+    template<class GEOMETRY>
+    void BasicIndexMutationSession<GEOMETRY>::addSubIndexRanges(const Index &index,
+                                                                const std::vector<std::pair<size_t, size_t>> &sortedRanges) {
+        for (const auto &[offset, len]: sortedRanges) {
+            addSubIndex(index, offset, len);
+        }
+    }
+
+    template<class GEOMETRY>
+    void BasicIndexMutationSession<GEOMETRY>::addErased(const Index &index, size_t offset, size_t len) {
+        auto erased = BuilderT::erase(index.impl_, offset, len, sessionImpl_.get());
+        if (erased) {
+            builder_.addNode(erased);
+        }
     }
 
-    std::pair<Index, TranslationLog> IndexMutationSession::close() {
+    template<class GEOMETRY>
+    void BasicIndexMutationSession<GEOMETRY>::addMoved(const Index &index, size_t srcOffset, size_t len,
+                                                       size_t dstOffset) {
+        auto moved = BuilderT::moveRange(index.impl_, srcOffset, len, dstOffset, sessionImpl_.get());
+        if (moved) {
+            builder_.addNode(moved);
+        }
+    }
+
+    template<class GEOMETRY>
+    auto BasicIndexMutationSession<GEOMETRY>::close() -> std::pair<Index, TranslationLog> {
         auto indexImpl = builder_.close();
         auto translations = sessionImpl_->close();
         TranslationLog result;
         result.blockTranslation.reserve(translations.size());
         for (const auto &translation : translations) {
+            if (translation.targetPointer_.use_count() == 1) {
+                //the block got replaced before the session closed, nothing to copy and its address goes back to the
+                //provider along with translations
+                continue;
+            }
             TranslationUnit currentUnit(*translation.targetPointer_);
             std::pair<SpacePointer, RangeLength> currentRange = {0, 0};
             for (size_t i = 0; i < SPACE_BLOCK_SIZE; i++) {
@@ -432,14 +534,73 @@ namespace framespaces {
         return {Index(std::move(indexImpl)), std::move(result)};
     }
 
-    void Index::forEach(std::function<void(SpacePointer, RangeLength)> visitor, size_t offset, size_t length) const {
+    template<class GEOMETRY>
+    void BasicIndex<GEOMETRY>::forEach(std::function<void(SpacePointer, RangeLength)> visitor, size_t offset,
+                                       size_t length) const {
         BuilderT::forEachLeaf([&](const LeafT &leaf, size_t localOffset, size_t currentLen) {
             visitor(leaf[localOffset], currentLen);
         }, impl_, offset, length);
     }
 
-    arrow::Status PrettyPrint(const DataFrame &dataFrameSrc, const arrow::PrettyPrintOptions &options,
-                       std::ostream *sink) {
+    template<class GEOMETRY>
+    void BasicIndex<GEOMETRY>::multiGet(const std::vector<size_t> &positions, std::vector<SpacePointer> &out) const {
+        out.resize(positions.size());
+        BuilderT::multiGet(impl_, positions.data(), positions.size(), out.data());
+    }
+
+    template<class GEOMETRY>
+    MemoryReport BasicIndex<GEOMETRY>::memoryReport() const {
+        return ::memoryReport(impl_);
+    }
+
+    template<class GEOMETRY>
+    MemoryReport BasicIndex<GEOMETRY>::memoryReport(const BasicIndex &base) const {
+        return ::memoryReport(impl_, base.impl_);
+    }
+
+    template<class GEOMETRY>
+    std::vector<TreeChange> BasicIndex<GEOMETRY>::diff(const BasicIndex &newer) const {
+        return ::diff(impl_, newer.impl_);
+    }
+
+    template<class GEOMETRY>
+    ContentHash BasicIndex<GEOMETRY>::contentHash(size_t offset, size_t length) const {
+        return BuilderT::contentHash(impl_, offset, length);
+    }
+
+    template<class GEOMETRY>
+    BasicIndex<GEOMETRY>::Frozen::Frozen(const IndexImpl &impl) :
+            tree_(sizeOf(impl) <= std::numeric_limits<uint32_t>::max() ? decltype(tree_)(::freeze(impl)) :
+                  decltype(tree_)(::freeze<uint64_t>(impl))) {}
+
+    template<class GEOMETRY>
+    void BasicIndex<GEOMETRY>::Frozen::forEach(std::function<void(SpacePointer, RangeLength)> visitor, size_t offset,
+                                               size_t length) const {
+        std::visit([&](const auto &tree) {
+            tree.forEachLeaf([&](const LeafT &leaf, size_t localOffset, size_t currentLen) {
+                visitor(leaf[localOffset], currentLen);
+            }, offset, length);
+        }, tree_);
+    }
+
+    template<class GEOMETRY>
+    SpacePointer BasicIndex<GEOMETRY>::Frozen::operator[](size_t pos) const {
+        return std::visit([&](const auto &tree) -> SpacePointer { return tree[pos]; }, tree_);
+    }
+
+    template<class GEOMETRY>
+    size_t BasicIndex<GEOMETRY>::Frozen::size() const {
+        return std::visit([](const auto &tree) { return tree.size(); }, tree_);
+    }
+
+    template<class GEOMETRY>
+    auto BasicIndex<GEOMETRY>::freeze() const -> Frozen {
+        return Frozen(impl_);
+    }
+
+    template<class GEOMETRY>
+    arrow::Status PrettyPrint(const BasicDataFrame<GEOMETRY> &dataFrameSrc, const arrow::PrettyPrintOptions &options,
+                              std::ostream *sink) {
         auto dataFrame = dataFrameSrc.snapshot();
         std::shared_ptr<arrow::Schema> &schema = dataFrame->getSpace()->schema();
         RETURN_NOT_OK(PrettyPrint(*schema, options, sink));
@@ -25,7 +25,7 @@ TEST(ANodeTest, wrappingBNode) {
     }
     newBufPtr->setValues(sampleData, 0, 8);
     newBufPtr->makeConst();
-    bNode.addNode(std::shared_ptr<const Leaf>(std::move(newBufPtr)));
+    bNode.addNode(ConstPtr<Leaf>(std::move(newBufPtr)));
     int startValue = 16;
     for (int i = 0; i < 6; i++) {
         bNode.addNode(Leaf::createLeafPtr(buffer));
@@ -36,7 +36,7 @@ TEST(ANodeTest, wrappingBNode) {
     }
     bNode.makeConst();
     auto pbNode = BNodeT::createNodePtr(std::move(bNode));
-    std::shared_ptr<const BNodeT> bnodePtr = std::shared_ptr<const BNodeT>(std::move(pbNode));
+    ConstPtr<BNodeT> bnodePtr = ConstPtr<BNodeT>(std::move(pbNode));
     ANodeT aNode(bnodePtr);
     ASSERT_EQ(aNode.childrenCount(), 0);
     ASSERT_EQ(aNode.size(), 0);
@@ -72,23 +72,23 @@ TEST(ANodeTest, wrappingBNode) {
 
     auto node = buildTree<int, 16, 16>(1, 10, 10);
 
-    std::shared_ptr<const BNodeT> nodeP = std::make_shared<const BNodeT>(node);
+    ConstPtr<BNodeT> nodeP = makeCPtr<BNodeT>(node);
     ASSERT_FALSE(aNode2.canAcceptNode(nodeP));
     ASSERT_TRUE(aNode2.canAcceptNode(nodeP, false, 1000));
     ASSERT_TRUE(aNode2.canAcceptNode(nodeP, false, 0, 0));
     node.makeConst(false);
-    std::shared_ptr<const BNodeT> nodeP1 = std::make_shared<const BNodeT>(node);
+    ConstPtr<BNodeT> nodeP1 = makeCPtr<BNodeT>(node);
     ASSERT_FALSE(aNode2.canAcceptNode(nodeP));
 
     auto node2 = buildLeaf<int, 16>(10);
     for (int i = 0; i < 10; i++) {
         node2.setAt(i, 10 * (i + 1));
     }
-    std::shared_ptr<const LeafT> nodeP2 = std::make_shared<const LeafT>(node2);
+    ConstPtr<LeafT> nodeP2 = makeCPtr<LeafT>(node2);
     ASSERT_TRUE(aNode2.canAcceptNode(nodeP2));
-    ASSERT_THROW(aNode2.addNode(std::make_shared<const LeafT>(node2)), std::logic_error);
+    ASSERT_THROW(aNode2.addNode(makeCPtr<LeafT>(node2)), std::logic_error);
     node2.makeConst();
-    std::shared_ptr<const LeafT> nodeP3 = std::make_shared<const LeafT>(node2);
+    ConstPtr<LeafT> nodeP3 = makeCPtr<LeafT>(node2);
     ASSERT_TRUE(aNode2.canAcceptNode(nodeP2));
     aNode2.addNode(nodeP3);
     ASSERT_FALSE(aNode2.isBalanced());
@@ -263,7 +263,7 @@ TEST(ANodeTest, wrappingLeaf) {
         bufferNode.add(sampleData, 8);
     }
     bufferNode.makeConst();
-    std::shared_ptr<const Leaf8> bnodePtr = std::make_shared<const Leaf8>(std::move(bufferNode));
+    ConstPtr<Leaf8> bnodePtr = makeCPtr<Leaf8>(std::move(bufferNode));
     ANode8 aNode(bnodePtr);
     ASSERT_EQ(aNode.childrenCount(), 0);
     ASSERT_EQ(aNode.size(), 0);
@@ -299,20 +299,20 @@ TEST(ANodeTest, wrappingLeaf) {
 
     auto node = buildLeaf<int, 128>(100);
 
-    std::shared_ptr<const Leaf8> nodeP = std::make_shared<const Leaf8>(node);
+    ConstPtr<Leaf8> nodeP = makeCPtr<Leaf8>(node);
     ASSERT_FALSE(aNode2.canAcceptNode(nodeP));
     node.makeConst();
-    std::shared_ptr<const Leaf8> nodeP1 = std::make_shared<const Leaf8>(node);
+    ConstPtr<Leaf8> nodeP1 = makeCPtr<Leaf8>(node);
     ASSERT_FALSE(aNode2.canAcceptNode(nodeP));
 
     auto node2 = buildLeaf<int, 128>(10);
     for (int i = 0; i < 10; i++) {
         node2.setAt(i, 10 * (i + 1));
     }
-    std::shared_ptr<const Leaf8> nodeP2 = std::make_shared<const Leaf8>(node2);
+    ConstPtr<Leaf8> nodeP2 = makeCPtr<Leaf8>(node2);
     ASSERT_TRUE(aNode2.canAcceptNode(nodeP2));
     node2.makeConst();
-    std::shared_ptr<const Leaf8> nodeP3 = std::make_shared<const Leaf8>(node2);
+    ConstPtr<Leaf8> nodeP3 = makeCPtr<Leaf8>(node2);
     ASSERT_TRUE(aNode2.canAcceptNode(nodeP2));
     aNode2.addNode(nodeP3);
     ASSERT_FALSE(aNode2.isBalanced());
@@ -17,7 +17,7 @@ TEST(BNodeTest, constructors) {
     bNode.addNode(Leaf::createLeafPtr(buffer));
     auto newBufPtr = Leaf::createLeafPtr(buffer);
     newBufPtr->makeConst();
-    bNode.addNode(std::shared_ptr<const Leaf>(std::move(newBufPtr)));
+    bNode.addNode(ConstPtr<Leaf>(std::move(newBufPtr)));
     //Node is created mutable
     ASSERT_FALSE(bNode.isConst());
     //Node is not balanced since it has only one child
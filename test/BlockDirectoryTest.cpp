@@ -0,0 +1,83 @@
+#include "gtest/gtest.h"
+#include "../ArrayAdapter.h"
+#include "../BlockDirectory.h"
+
+#include <thread>
+#include <vector>
+
+using Directory = BlockDirectory<size_t, 16, 64, 64>;
+
+TEST(BlockDirectoryTest, ranges) {
+    Directory directory;
+    ASSERT_EQ(directory.find(16), nullptr);
+    directory.insert(16, 40, 1);
+    directory.insert(64, 16, 2);
+    //empty ranges still take a block
+    directory.insert(80, 0, 3);
+    for (size_t address = 16; address < 64; address++) {
+        ASSERT_EQ(directory.find(address)->value, 1) << address;
+        ASSERT_EQ(directory.find(address)->address, 16);
+    }
+    ASSERT_EQ(directory.find(64)->value, 2);
+    ASSERT_EQ(directory.find(80)->value, 3);
+    ASSERT_EQ(directory.find(96), nullptr);
+    ASSERT_EQ(directory.find(16 * 64 * 64), nullptr);
+
+    //overlapping ranges are refused whole
+    ASSERT_THROW(directory.insert(48, 16, 4), std::logic_error);
+    ASSERT_THROW(directory.insert(16 * 64 * 64 - 16, 20, 4), std::logic_error);
+    directory.insert(96, 16, 4);
+    ASSERT_THROW(directory.insert(0, 100, 5), std::logic_error);
+    ASSERT_EQ(directory.find(0), nullptr);
+
+    //only the start of a mapping erases it
+    directory.erase(32);
+    ASSERT_EQ(directory.find(32)->value, 1);
+    directory.erase(16);
+    ASSERT_EQ(directory.find(16), nullptr);
+    ASSERT_EQ(directory.find(48), nullptr);
+    ASSERT_EQ(directory.find(64)->value, 2);
+    directory.insert(0, 64, 6);
+    ASSERT_EQ(directory.find(63)->value, 6);
+}
+
+TEST(BlockDirectoryTest, concurrentRegistration) {
+    //ingest threads mapping ranges of a shared provider, registering them and reading back everyone's
+    constexpr size_t THREAD_COUNT = 8;
+    constexpr size_t RANGES_PER_THREAD = 500;
+    SpaceProvider<16> spaceProvider;
+    BlockDirectory<size_t, 16> directory;
+    std::vector<std::vector<SpaceProvider<16>::RefId>> refIds(THREAD_COUNT);
+    std::atomic<size_t> registered = 0;
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < THREAD_COUNT; thread++) {
+        threads.emplace_back([&, thread]() {
+            for (size_t i = 0; i < RANGES_PER_THREAD; i++) {
+                size_t size = 1 + (i * 7 + thread) % 40;
+                auto refId = spaceProvider.mapBlock(size);
+                directory.insert(refId.id(), size, thread * RANGES_PER_THREAD + i);
+                refIds[thread].push_back(refId);
+                registered++;
+                //whatever got published is found whole
+                const auto *mapping = directory.find(refIds[thread][i / 2].id());
+                ASSERT_NE(mapping, nullptr);
+                ASSERT_EQ(mapping->value, thread * RANGES_PER_THREAD + i / 2);
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    ASSERT_EQ(registered, THREAD_COUNT * RANGES_PER_THREAD);
+    for (size_t thread = 0; thread < THREAD_COUNT; thread++) {
+        for (size_t i = 0; i < RANGES_PER_THREAD; i++) {
+            const auto &refId = refIds[thread][i];
+            for (size_t pos = 0; pos < refId.size; pos++) {
+                const auto *mapping = directory.find(refId.id() + pos);
+                ASSERT_NE(mapping, nullptr);
+                ASSERT_EQ(mapping->value, thread * RANGES_PER_THREAD + i);
+                ASSERT_EQ(mapping->address, refId.id());
+            }
+        }
+    }
+}
@@ -1,8 +1,22 @@
 #include "gtest/gtest.h"
 #include "../Builder.h"
+#include "../MemoryReport.h"
 #include "utilities.h"
 #include "TestDataTool.h"
 
+#include <functional>
+#include <map>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <set>
+
+//walks of this shape prefetch further ahead than a node is wide, see childPrefetchDistance
+template<>
+struct ChildPrefetch<int, 8, 4, ArrayAdapter> {
+    static constexpr size_t DISTANCE = 9;
+};
+
 using BuilderT = Builder<int, 16, 16,ArrayAdapter>;
 using LeafT = BuilderT::LeafT;
 using BNodeT = BuilderT::BNodeT;
@@ -51,6 +65,550 @@ TEST(BuilderTest, creation) {
 
 }
 
+TEST(BuilderTest, multiGet) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    using SmallLeaf = SmallBuilder::LeafT;
+    std::vector<int> values;
+    SmallBuilder builder;
+    for (int leafPos = 0; leafPos < 300; leafPos++) {
+        std::array<int, 4> leafData{};
+        size_t leafSize = 1 + leafPos % 4;
+        for (size_t i = 0; i < leafSize; i++) {
+            leafData[i] = int(values.size()) * 7;
+            values.push_back(leafData[i]);
+        }
+        auto leaf = SmallLeaf::createLeaf(nullptr);
+        leaf.add(leafData.data(), leafSize);
+        builder.addNode(SmallLeaf::createLeafPtr(std::move(leaf)));
+    }
+    auto root = builder.close();
+    SmallBuilder annotationBuilder;
+    annotationBuilder.addNode(root, 11, 500);
+    auto annotated = annotationBuilder.close();
+
+    std::vector<size_t> positions;
+    for (size_t i = 0; i < 1000; i++) {
+        positions.push_back(i * 7919 % 500);
+    }
+    std::vector<int> out(positions.size());
+    SmallBuilder::multiGet(root, positions.data(), positions.size(), out.data());
+    for (size_t i = 0; i < positions.size(); i++) {
+        ASSERT_EQ(out[i], values[positions[i]]);
+    }
+    SmallBuilder::multiGet(annotated, positions.data(), positions.size(), out.data());
+    for (size_t i = 0; i < positions.size(); i++) {
+        ASSERT_EQ(out[i], values[positions[i] + 11]);
+    }
+    std::sort(positions.begin(), positions.end());
+    SmallBuilder::multiGet(root, positions.data(), positions.size(), out.data());
+    for (size_t i = 0; i < positions.size(); i++) {
+        ASSERT_EQ(out[i], values[positions[i]]);
+    }
+}
+
+template<class BUILDER>
+static void checkBalanced(const typename BUILDER::VarType &root) {
+    std::function<void(const typename BUILDER::VarType &, bool)> check = [&](const auto &var, bool isRoot) {
+        visitConstNode([&](const auto &node) {
+            using NodeType = std::remove_cvref_t<decltype(node)>;
+            ASSERT_TRUE(isRoot || node.isBalanced());
+            if constexpr (std::is_same_v<NodeType, typename BUILDER::BNodeT>) {
+                for (size_t i = 0; i < node.childrenCount(); i++) {
+                    ASSERT_EQ(BUILDER::BNodeT::heightOf(node.childAt(i)), node.height() - 1);
+                    check(node.childAt(i), false);
+                }
+            }
+        }, var);
+    };
+    if (root) {
+        check(root, true);
+    }
+}
+
+TEST(BuilderTest, splitAndConcat) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    using SmallLeaf = SmallBuilder::LeafT;
+    std::vector<int> values;
+    SmallBuilder builder;
+    for (int leafPos = 0; leafPos < 100; leafPos++) {
+        std::array<int, 4> leafData{};
+        size_t leafSize = 2 + leafPos % 3;
+        for (size_t i = 0; i < leafSize; i++) {
+            leafData[i] = int(values.size());
+            values.push_back(leafData[i]);
+        }
+        auto leaf = SmallLeaf::createLeaf(nullptr);
+        leaf.add(leafData.data(), leafSize);
+        builder.addNode(SmallLeaf::createLeafPtr(std::move(leaf)));
+    }
+    auto root = builder.close();
+    SmallBuilder annotationBuilder;
+    annotationBuilder.addNode(root, 7, 250);
+    auto annotated = annotationBuilder.close();
+    std::vector<int> annotatedValues(values.begin() + 7, values.begin() + 257);
+
+    for (auto [tree, treeValues]: {std::pair{&root, &values}, std::pair{&annotated, &annotatedValues}}) {
+        size_t size = treeValues->size();
+        for (size_t pos = 0; pos <= size; pos++) {
+            auto [left, right] = SmallBuilder::split(*tree, pos);
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(left), pos);
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(right), size - pos);
+            checkBalanced<SmallBuilder>(left);
+            checkBalanced<SmallBuilder>(right);
+            if (tree == &root && pos == size / 2) {
+                //only the seam is new, everything else is shared with the tree split
+                size_t seamBound = 4 * SmallBuilder::BNodeT::heightOf(root);
+                ASSERT_LT(memoryReport(left, root).total().exclusive.count, seamBound);
+                ASSERT_LT(memoryReport(right, root).total().exclusive.count, seamBound);
+            }
+            for (size_t i = 0; i < size; i++) {
+                ASSERT_EQ(i < pos ? valueAt(i, left) : valueAt(i - pos, right), (*treeValues)[i]);
+            }
+            auto joined = SmallBuilder::concat(right, left);
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(joined), size);
+            checkBalanced<SmallBuilder>(joined);
+            for (size_t i = 0; i < size; i++) {
+                ASSERT_EQ(valueAt(i, joined), (*treeValues)[(i + pos) % size]);
+            }
+        }
+    }
+}
+
+TEST(BuilderTest, eraseAndMove) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    std::vector<int> values(600);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = SmallBuilder::bulkLoad(values.data(), values.size());
+    std::mt19937 gen(11);
+    auto randomBelow = [&](size_t bound) { return std::uniform_int_distribution<size_t>(0, bound)(gen); };
+    for (int step = 0; step < 200; step++) {
+        SmallBuilder::VarType result;
+        if (step % 3 == 0 && values.size() > 100) {
+            size_t offset = randomBelow(values.size());
+            size_t length = randomBelow(30);
+            result = SmallBuilder::erase(root, offset, length);
+            values.erase(values.begin() + offset, values.begin() + std::min(offset + length, values.size()));
+        } else {
+            size_t length = randomBelow(values.size() / 4);
+            size_t srcOffset = randomBelow(values.size() - length);
+            size_t dstOffset = randomBelow(values.size() - length);
+            result = SmallBuilder::moveRange(root, srcOffset, length, dstOffset);
+            std::vector<int> moved(values.begin() + srcOffset, values.begin() + srcOffset + length);
+            values.erase(values.begin() + srcOffset, values.begin() + srcOffset + length);
+            values.insert(values.begin() + dstOffset, moved.begin(), moved.end());
+        }
+        ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(result), values.size());
+        checkBalanced<SmallBuilder>(result);
+        //the pieces between the seams are shared with the source tree
+        size_t seamBound = 4 * 4 * SmallBuilder::BNodeT::heightOf(root);
+        ASSERT_LT(memoryReport(result, root).total().exclusive.count, seamBound);
+        for (size_t i = 0; i < values.size(); i++) {
+            ASSERT_EQ(valueAt(i, result), values[i]) << step;
+        }
+        root = std::move(result);
+    }
+    ASSERT_THROW(SmallBuilder::moveRange(root, 10, 20, values.size() - 19), std::logic_error);
+}
+
+TEST(BuilderTest, concatOfUnevenHeights) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    std::vector<int> values(5000);
+    std::iota(values.begin(), values.end(), 0);
+    auto tall = SmallBuilder::bulkLoad(values.data(), values.size());
+    int8_t height = SmallBuilder::BNodeT::heightOf(tall);
+    for (size_t shortSize = 1; shortSize < 80; shortSize += 3) {
+        auto shortTree = SmallBuilder::bulkLoad(values.data(), shortSize);
+        for (bool tallFirst: {true, false}) {
+            auto joined = tallFirst ? SmallBuilder::concat(tall, shortTree) : SmallBuilder::concat(shortTree, tall);
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(joined), values.size() + shortSize);
+            checkBalanced<SmallBuilder>(joined);
+            //the short tree lands on the spine of the tall one, whose copies (two nodes per level at most, and the
+            //arrays of two merged leaves) are all that is new beside the short tree itself
+            auto shortTreeMemory = memoryReport(shortTree).total();
+            ASSERT_LE(memoryReport(joined, tall).total().exclusive.count,
+                      2 * size_t(height + 2) + shortTreeMemory.exclusive.count + shortTreeMemory.shared.count);
+            size_t tallBegin = tallFirst ? 0 : shortSize;
+            for (size_t i = 0; i < values.size() + shortSize; i++) {
+                bool inTall = i >= tallBegin && i < tallBegin + values.size();
+                size_t shortBegin = tallFirst ? values.size() : 0;
+                ASSERT_EQ(valueAt(i, joined), inTall ? values[i - tallBegin] : values[i - shortBegin]) << shortSize;
+            }
+        }
+    }
+}
+
+TEST(BuilderTest, transientReopening) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    using SmallLeaf = SmallBuilder::LeafT;
+    std::vector<int> values(40);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = SmallBuilder::bulkLoad(values.data(), values.size());
+    auto appendLeaf = [&](SmallBuilder::VarType &&tree) {
+        std::array<int, 4> leafData{};
+        for (int &value: leafData) {
+            value = int(values.size());
+            values.push_back(value);
+        }
+        auto leaf = SmallLeaf::createLeaf(nullptr);
+        leaf.add(leafData.data(), leafData.size());
+        SmallBuilder builder;
+        builder.addNode(std::move(tree));
+        builder.addNode(SmallLeaf::createLeafPtr(std::move(leaf)));
+        return builder.close();
+    };
+
+    //a snapshot still refers to the root, so the edit has to copy it
+    auto snapshot = SmallBuilder::BNodeT::copyNode(root);
+    size_t snapshotSize = values.size();
+    auto edited = appendLeaf(std::move(root));
+    ASSERT_NE(edited.get(), snapshot.get());
+    ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(snapshot), snapshotSize);
+    for (size_t i = 0; i < snapshotSize; i++) {
+        ASSERT_EQ(valueAt(i, snapshot), values[i]);
+    }
+    snapshot = SmallBuilder::VarType();
+
+    //nothing else refers to the nodes any more, each edit reopens them in place
+    for (int edit = 0; edit < 50; edit++) {
+        const void *rootAddress = edited.get();
+        int8_t height = SmallBuilder::BNodeT::heightOf(edited);
+        edited = appendLeaf(std::move(edited));
+        if (SmallBuilder::BNodeT::heightOf(edited) == height) {
+            ASSERT_EQ(edited.get(), rootAddress) << edit;
+        }
+        ASSERT_TRUE(SmallBuilder::BNodeT::isConst(edited));
+        checkBalanced<SmallBuilder>(edited);
+        ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(edited), values.size());
+        for (size_t i = 0; i < values.size(); i++) {
+            ASSERT_EQ(valueAt(i, edited), values[i]);
+        }
+    }
+}
+
+TEST(BuilderTest, addRanges) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    std::vector<int> values(600);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = SmallBuilder::bulkLoad(values.data(), values.size());
+    SmallBuilder annotationBuilder;
+    annotationBuilder.addNode(root, 7, 450);
+    auto annotated = annotationBuilder.close();
+    std::vector<int> annotatedValues(values.begin() + 7, values.begin() + 457);
+
+    std::mt19937 gen(3);
+    for (auto [tree, treeValues]: {std::pair{&root, &values}, std::pair{&annotated, &annotatedValues}}) {
+        for (size_t maxGap: {1, 5, 40, 200}) {
+            std::uniform_int_distribution<size_t> step(0, maxGap);
+            std::vector<std::pair<size_t, size_t>> ranges;
+            std::vector<int> expected;
+            for (size_t pos = step(gen); pos < treeValues->size(); pos += step(gen)) {
+                size_t length = std::min(1 + step(gen), treeValues->size() - pos);
+                ranges.emplace_back(pos, length);
+                expected.insert(expected.end(), treeValues->begin() + pos, treeValues->begin() + pos + length);
+                pos += length;
+            }
+            SmallBuilder builder;
+            builder.addRanges(*tree, ranges);
+            auto result = builder.close();
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(result), expected.size());
+            checkBalanced<SmallBuilder>(result);
+            for (size_t i = 0; i < expected.size(); i++) {
+                ASSERT_EQ(valueAt(i, result), expected[i]) << maxGap << " " << i;
+            }
+        }
+    }
+
+    //interleaving two sources, each cursor resuming where its previous range ended
+    SmallBuilder builder;
+    SmallBuilder::SourceCursor rootCursor(root);
+    SmallBuilder::SourceCursor annotatedCursor(annotated);
+    std::vector<int> expected;
+    for (size_t pos = 0; pos + 30 <= annotatedValues.size(); pos += 30) {
+        rootCursor.append(builder, pos, 20);
+        annotatedCursor.append(builder, pos + 10, 20);
+        expected.insert(expected.end(), values.begin() + pos, values.begin() + pos + 20);
+        expected.insert(expected.end(), annotatedValues.begin() + pos + 10, annotatedValues.begin() + pos + 30);
+    }
+    auto interleaved = builder.close();
+    ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(interleaved), expected.size());
+    checkBalanced<SmallBuilder>(interleaved);
+    for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(valueAt(i, interleaved), expected[i]);
+    }
+    ASSERT_THROW(rootCursor.append(builder, 0, 1), std::logic_error);
+
+    //a range covering the whole source adds it as it is
+    SmallBuilder wholeBuilder;
+    wholeBuilder.addRanges(root, {{0, values.size()}});
+    ASSERT_EQ(wholeBuilder.close().get(), root.get());
+}
+
+TEST(BuilderTest, bulkLoad) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    using SmallLeaf = SmallBuilder::LeafT;
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    for (size_t count: {0, 1, 3, 5, 9, 17, 65, 66, 257, 1000}) {
+        auto root = SmallBuilder::bulkLoad(values.data(), count);
+        ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(root), count);
+        ASSERT_TRUE(!count || SmallBuilder::BNodeT::isConst(root));
+        checkBalanced<SmallBuilder>(root);
+        for (size_t i = 0; i < count; i++) {
+            ASSERT_EQ(valueAt(i, root), values[i]);
+        }
+    }
+
+    std::vector<SmallBuilder::LeafPtr> leaves;
+    for (size_t pos = 0; pos < 300; pos += 3) {
+        auto leaf = SmallLeaf::createLeaf(nullptr);
+        leaf.add(values.data() + pos, 3);
+        leaves.push_back(SmallLeaf::createLeafPtr(std::move(leaf)));
+    }
+    auto root = SmallBuilder::bulkLoad(std::move(leaves));
+    ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(root), 300);
+    checkBalanced<SmallBuilder>(root);
+    for (size_t i = 0; i < 300; i++) {
+        ASSERT_EQ(valueAt(i, root), values[i]);
+    }
+
+    leaves.clear();
+    for (size_t length: {3, 1}) {
+        auto leaf = SmallLeaf::createLeaf(nullptr);
+        leaf.add(values.data(), length);
+        leaves.push_back(SmallLeaf::createLeafPtr(std::move(leaf)));
+    }
+    ASSERT_THROW(SmallBuilder::bulkLoad(std::move(leaves)), std::logic_error);
+}
+
+TEST(BuilderTest, childPrefetchDistance) {
+    using WideBuilder = Builder<int, 8, 4, ArrayAdapter>;
+    static_assert(WideBuilder::BNodeT::CHILD_PREFETCH_DISTANCE == 9);
+    static_assert(WideBuilder::ANodeT::CHILD_PREFETCH_DISTANCE == 9);
+    static_assert(BuilderT::BNodeT::CHILD_PREFETCH_DISTANCE == 2);
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    auto tree = WideBuilder::bulkLoad(values.data(), values.size());
+    //annotations over slices of the tree, with their origin ranges between replaced children
+    WideBuilder builder;
+    builder.addNode(tree, 3, 500);
+    builder.addNode(tree, 700, 290);
+    auto root = builder.close();
+    for (auto [offset, length]: {std::pair<size_t, size_t>{0, 790}, {1, 788}, {497, 10}, {250, 1}}) {
+        size_t expected = offset < 500 ? offset + 3 : offset + 200;
+        WideBuilder::forEachLeaf([&](const auto &leaf, size_t leafOffset, size_t leafLength) {
+            for (size_t i = 0; i < leafLength; i++) {
+                ASSERT_EQ(leaf.at(leafOffset + i), int(expected));
+                expected = expected == 502 ? 700 : expected + 1;
+            }
+        }, root, offset, length);
+        ASSERT_EQ(expected, offset + length < 500 ? offset + length + 3 : offset + length + 200);
+    }
+}
+
+TEST(BuilderTest, parallelBulkLoad) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    std::vector<int> values(5000);
+    std::iota(values.begin(), values.end(), 0);
+    for (size_t threadCount: {1, 2, 3, 8}) {
+        for (size_t count: {0, 1, 17, 65, 1000, 5000}) {
+            auto root = SmallBuilder::parallelBulkLoad(values.data(), count, threadCount);
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(root), count);
+            checkBalanced<SmallBuilder>(root);
+            for (size_t i = 0; i < count; i++) {
+                ASSERT_EQ(valueAt(i, root), values[i]) << threadCount << " " << count;
+            }
+        }
+    }
+
+    //index trees get a session per partition, the loaded rows end up in the sessions' copy lists
+    using IndexBuilder = Builder<size_t, 4, 16, IndexAdapter>;
+    SpaceProvider<16> spaceProvider;
+    std::vector<std::unique_ptr<SpaceProvider<16>::AllocationSession>> sessions;
+    std::vector<size_t> rows(3000);
+    std::iota(rows.begin(), rows.end(), 100);
+    auto root = IndexBuilder::parallelBulkLoad(rows.data(), rows.size(), 4, [&](size_t) {
+        sessions.push_back(spaceProvider.newAllocationSession());
+        return static_cast<void *>(sessions.back().get());
+    });
+    ASSERT_EQ(sessions.size(), 4);
+    ASSERT_EQ(IndexBuilder::BNodeT::sizeOf(root), rows.size());
+    checkBalanced<IndexBuilder>(root);
+    std::map<size_t, const size_t *> copyLists;
+    std::vector<std::deque<SpaceProvider<16>::TranslationUnit>> commits;
+    for (auto &session: sessions) {
+        commits.push_back(session->close());
+        for (const auto &unit: commits.back()) {
+            copyLists[*unit.targetPointer_] = unit.sourceRows_.get();
+        }
+    }
+    for (size_t i = 0; i < rows.size(); i++) {
+        size_t address = valueAt(i, root);
+        ASSERT_EQ(copyLists.at(address / 16 * 16)[address % 16], rows[i]);
+    }
+}
+
+TEST(BuilderTest, annotationFlattening) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    using SmallLeaf = SmallBuilder::LeafT;
+    std::vector<int> values;
+    SmallBuilder builder;
+    for (int leafPos = 0; leafPos < 200; leafPos++) {
+        std::array<int, 4> leafData{};
+        for (auto &value: leafData) {
+            value = int(values.size());
+            values.push_back(value);
+        }
+        auto leaf = SmallLeaf::createLeaf(nullptr);
+        leaf.add(leafData.data(), leafData.size());
+        builder.addNode(SmallLeaf::createLeafPtr(std::move(leaf)));
+    }
+
+    //every round cuts a value out of the middle, trims both ends and appends a leaf, which nests a fresh annotation
+    //over the ones of the previous round
+    std::array<int, 4> appended{-1, -2, -3, -4};
+    auto original = builder.close();
+    for (int8_t maxDepth: {int8_t(0), int8_t(2)}) {
+        auto root = SmallBuilder::BNodeT::copyNode(original);
+        std::vector<int> expected = values;
+        FlatteningReport total;
+        int8_t deepest = 0;
+        for (int round = 0; round < 20; round++) {
+            SmallBuilder roundBuilder;
+            roundBuilder.setFlatteningPolicy({maxDepth, 0});
+            size_t size = expected.size();
+            size_t half = size / 2;
+            roundBuilder.addNode(root, 3, half - 3);
+            roundBuilder.addNode(root, half + 1, size - half - 4);
+            auto leaf = SmallLeaf::createLeaf(nullptr);
+            leaf.add(appended.data(), appended.size());
+            roundBuilder.addNode(SmallLeaf::createLeafPtr(std::move(leaf)));
+            root = roundBuilder.close();
+            expected.erase(expected.begin() + size - 3, expected.end());
+            expected.erase(expected.begin() + half);
+            expected.erase(expected.begin(), expected.begin() + 3);
+            expected.insert(expected.end(), appended.begin(), appended.end());
+            total += roundBuilder.flatteningReport();
+            deepest = std::max(deepest, SmallBuilder::BNodeT::annotationDepth(root));
+            ASSERT_EQ(SmallBuilder::BNodeT::sizeOf(root), expected.size());
+            for (size_t i = 0; i < expected.size(); i++) {
+                ASSERT_EQ(valueAt(i, root), expected[i]);
+            }
+        }
+        if (maxDepth) {
+            ASSERT_LE(deepest, maxDepth);
+            ASSERT_GT(total.annotationsFlattened, 0);
+            ASSERT_GT(total.subtreesShared, 0);
+        } else {
+            ASSERT_GT(deepest, 2);
+            ASSERT_EQ(total.annotationsFlattened, 0);
+        }
+    }
+}
+
+TEST(BuilderTest, flattenedSlicesShareArrays) {
+    using SmallBuilder = Builder<int, 4, 4, ArrayAdapter>;
+    std::vector<int> values(64);
+    std::iota(values.begin(), values.end(), 0);
+    auto tree = SmallBuilder::bulkLoad(values.data(), values.size());
+    auto leafData = [](const auto &root, size_t pos) {
+        const int *data = nullptr;
+        SmallBuilder::forEachLeaf([&](const auto &leaf, size_t offset, size_t) {
+            data = leaf.data() + offset;
+        }, root, pos, 1);
+        return data;
+    };
+    //the annotation keeps all of its origin alive for a slice, which the ratio rejects
+    SmallBuilder builder;
+    builder.setFlatteningPolicy({0, 1});
+    builder.addNode(tree, 1, 62);
+    auto root = builder.close();
+    ASSERT_EQ(builder.flatteningReport().annotationsFlattened, 1);
+    ASSERT_EQ(builder.flatteningReport().leavesSliced, 2);
+    ASSERT_EQ(builder.flatteningReport().valuesSliced, 6);
+    ASSERT_EQ(SmallBuilder::BNodeT::annotationDepth(root), 0);
+    //the leading slice is the root of target when the next piece comes, which opens it
+    for (size_t pos: {59, 60, 61}) {
+        ASSERT_EQ(leafData(root, pos), leafData(tree, pos + 1)) << pos;
+    }
+    for (size_t pos = 0; pos < 62; pos++) {
+        ASSERT_EQ(valueAt(pos, root), values[pos + 1]);
+    }
+}
+
+TEST(BuilderTest, addressReclamation) {
+    using IndexBuilder = Builder<size_t, 4, 16, IndexAdapter>;
+    SpaceProvider<16> spaceProvider;
+    std::map<size_t, size_t> released;
+    spaceProvider.setReleaseListener([&](size_t address, size_t size) {
+        ASSERT_FALSE(released.contains(address));
+        released[address] = size;
+    });
+
+    //mapped ranges come back whole to the listener and block by block to the provider
+    {
+        auto mapped = spaceProvider.mapBlock(40);
+        auto copy = mapped;
+        auto single = spaceProvider.mapBlock(1);
+        ASSERT_TRUE(released.empty());
+    }
+    ASSERT_EQ(released.size(), 2);
+    ASSERT_EQ(spaceProvider.freeBlockCount(), 4);
+
+    //a frame rewritten over and over keeps reusing the addresses of the versions it dropped
+    std::vector<size_t> rows(200);
+    std::iota(rows.begin(), rows.end(), 1000);
+    auto loadVersion = [&]() {
+        auto session = spaceProvider.newAllocationSession();
+        auto root = IndexBuilder::bulkLoad(rows.data(), rows.size(), session.get());
+        //the copy lists are only needed until the rows get copied over
+        session->close();
+        return root;
+    };
+    auto current = loadVersion();
+    size_t highestAddress = 0;
+    for (int version = 0; version < 50; version++) {
+        released.clear();
+        auto next = loadVersion();
+        std::set<size_t> previousBlocks;
+        for (size_t i = 0; i < rows.size(); i++) {
+            previousBlocks.insert(valueAt(i, current) / 16 * 16);
+            highestAddress = std::max(highestAddress, valueAt(i, next));
+        }
+        current = std::move(next);
+        ASSERT_EQ(released.size(), previousBlocks.size());
+        for (size_t block: previousBlocks) {
+            ASSERT_EQ(released.at(block), 16);
+        }
+    }
+    //two live versions and the initial mappings, give or take the ones in flight
+    ASSERT_LT(highestAddress, 16 * (2 * rows.size() / 16 + 10));
+}
+
+TEST(BuilderTest, referencesOutlivingTheProvider) {
+    using IndexBuilder = Builder<size_t, 4, 16, IndexAdapter>;
+    auto spaceProvider = std::make_unique<SpaceProvider<16>>();
+    size_t releases = 0;
+    spaceProvider->setReleaseListener([&](size_t, size_t) { releases++; });
+
+    std::vector<size_t> rows(200);
+    std::iota(rows.begin(), rows.end(), 1000);
+    auto session = spaceProvider->newAllocationSession();
+    auto root = IndexBuilder::bulkLoad(rows.data(), rows.size(), session.get());
+    session->close();
+    session.reset();
+    std::optional<SpaceProvider<16>::RefId> mapped(spaceProvider->mapBlock(40));
+    {
+        auto dropped = spaceProvider->mapBlock(1);
+    }
+    ASSERT_EQ(releases, 1);
+
+    //the way a frame gets torn down when its space goes first: the last references find the listener detached
+    spaceProvider.reset();
+    root = IndexBuilder::VarType();
+    mapped.reset();
+    ASSERT_EQ(releases, 1);
+}
+
 template<class T, size_t MAX_COUNT, size_t SIZE>
 struct TArgs {
     using type = T;
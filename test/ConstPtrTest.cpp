@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+#include "utilities.h"
+#include "../Builder.h"
+
+TEST(ConstPtrTest, sharedCount) {
+    using Leaf = Leaf<int, 16>;
+    auto leaf = Leaf::createLeaf(nullptr);
+    int sampleData[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    leaf.add(sampleData, 8);
+    auto constLeaf = makeConstFromPtr(Leaf::createLeafPtr(std::move(leaf)));
+    ASSERT_EQ(constLeaf.use_count(), 1);
+    {
+        auto copy = constLeaf;
+        ASSERT_EQ(constLeaf.use_count(), 2);
+        ASSERT_EQ(copy.get(), constLeaf.get());
+        ConstPtr<Leaf> shared(constLeaf.get());
+        ASSERT_EQ(constLeaf.use_count(), 3);
+        auto moved = std::move(copy);
+        ASSERT_EQ(constLeaf.use_count(), 3);
+        ASSERT_EQ(copy, nullptr);
+    }
+    ASSERT_EQ(constLeaf.use_count(), 1);
+    //opening copies the node, the copy is not referred by any handle
+    auto opened = openNode(constLeaf, nullptr);
+    ASSERT_EQ(opened->useCount(), 0);
+    ASSERT_EQ(constLeaf.use_count(), 1);
+}
+
+TEST(ConstPtrTest, constArraysAreShared) {
+    using Leaf = Leaf<int, 16>;
+    auto &arrayAllocator = StdFixedAllocator<CountedArray<int, 16>>::oneAndOnly();
+    size_t initialCount = arrayAllocator.allocatedCount();
+    {
+        auto leaf = Leaf::createLeaf(nullptr);
+        int sampleData[] = {1, 2, 3, 4, 5, 6, 7, 8};
+        leaf.add(sampleData, 8);
+        auto constLeaf = makeConstFromPtr(Leaf::createLeafPtr(std::move(leaf)));
+        ASSERT_EQ(arrayAllocator.allocatedCount(), initialCount + 1);
+        //a copy of a const leaf refers to the same values
+        Leaf copy(*constLeaf);
+        ASSERT_EQ(copy.data(), constLeaf->data());
+        ASSERT_EQ(arrayAllocator.allocatedCount(), initialCount + 1);
+        constLeaf.reset();
+        ASSERT_EQ(copy.at(7), 8);
+        //mutating the copy gives it its own values
+        copy.mutate(nullptr);
+        copy.setAt(0, 11);
+        ASSERT_EQ(arrayAllocator.allocatedCount(), initialCount + 1);
+        ASSERT_EQ(copy.at(0), 11);
+    }
+    ASSERT_EQ(arrayAllocator.allocatedCount(), initialCount);
+}
@@ -0,0 +1,195 @@
+#include "gtest/gtest.h"
+#include "../Builder.h"
+#include "../ContentHash.h"
+
+#include <numeric>
+#include <random>
+#include <set>
+
+template<class T>
+static ContentHash expectedHash(const std::vector<T> &values, size_t offset, size_t len) {
+    ContentHash result;
+    for (size_t i = offset; i < std::min(values.size(), offset + len); i++) {
+        result.add(values[i]);
+    }
+    return result;
+}
+
+template<class BUILDER>
+static typename BUILDER::VarType loadLeafByLeaf(const std::vector<int> &values, size_t leafSize) {
+    using LeafT = typename BUILDER::LeafT;
+    BUILDER builder;
+    for (size_t pos = 0; pos < values.size(); pos += leafSize) {
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(values.data() + pos, std::min(leafSize, values.size() - pos));
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    return builder.close();
+}
+
+TEST(ContentHashTest, monoid) {
+    std::vector<int> values(100);
+    std::iota(values.begin(), values.end(), -50);
+    for (size_t len = 0; len <= values.size(); len++) {
+        //the interleaved lanes agree with one value at a time
+        ASSERT_EQ(hashSpan(values.data(), len), expectedHash(values, 0, len));
+        ASSERT_EQ(hashSpan(values.data(), len / 3) + hashSpan(values.data() + len / 3, len - len / 3),
+                  expectedHash(values, 0, len));
+    }
+    ContentHash empty;
+    ASSERT_EQ(empty + hashSpan(values.data(), 10), hashSpan(values.data(), 10));
+    ASSERT_EQ(hashSpan(values.data(), 10) + empty, hashSpan(values.data(), 10));
+
+    //order, length and values all count
+    std::vector<int> swapped = values;
+    std::swap(swapped[3], swapped[4]);
+    ASSERT_NE(hashSpan(swapped.data(), 10), hashSpan(values.data(), 10));
+    std::vector<int> zeros(2, 0);
+    ASSERT_NE(hashSpan(zeros.data(), 1), hashSpan(zeros.data(), 2));
+    ASSERT_NE(hashSpan(values.data(), 10), hashSpan(values.data() + 1, 10));
+}
+
+TEST(ContentHashTest, sequence) {
+    for (size_t first: {size_t(0), size_t(1), size_t(123456789), (size_t(1) << 60) + 17}) {
+        std::vector<size_t> values;
+        for (size_t len = 0; len < 300; len++) {
+            ASSERT_EQ(hashSequence(first, len), hashSpan(values.data(), values.size())) << first << " " << len;
+            values.push_back(first + len);
+        }
+    }
+}
+
+TEST(ContentHashTest, leaf) {
+    using LeafT = Leaf<int, 16, HashedArrayAdapter>;
+    auto leaf = LeafT::createLeaf(nullptr);
+    std::vector<int> values{3, -1, 7, 12, 0, 5, -8, 2, 9, 4};
+    leaf.add(values.data(), values.size());
+    leaf.slice(2, 7);
+    std::vector<int> sliced(values.begin() + 2, values.begin() + 9);
+    for (size_t offset = 0; offset <= sliced.size(); offset++) {
+        for (size_t len = 0; len <= sliced.size() + 1; len++) {
+            ASSERT_EQ(leaf.contentHash(offset, len), expectedHash(sliced, offset, len));
+        }
+    }
+    ASSERT_EQ(leaf.cachedHash(), nullptr);
+    //plain arrays don't pay for hashing unless asked to
+    auto unhashed = Leaf<int, 16>::createLeaf(nullptr);
+    unhashed.add(values.data(), values.size());
+    unhashed.makeConst();
+    ASSERT_EQ(unhashed.cachedHash(), nullptr);
+    ASSERT_EQ(unhashed.contentHash(), expectedHash(values, 0, values.size()));
+    leaf.makeConst();
+    ASSERT_EQ(*leaf.cachedHash(), expectedHash(sliced, 0, sliced.size()));
+    leaf.slice(1, 3);
+    ASSERT_EQ(leaf.cachedHash(), nullptr);
+}
+
+TEST(ContentHashTest, indexLeaf) {
+    using IndexLeaf = Leaf<size_t, 16, IndexAdapter>;
+    SpaceProvider<16> spaceProvider;
+    auto session = spaceProvider.newAllocationSession();
+    auto leaf = IndexLeaf::createLeaf(session.get());
+    std::array<size_t, 16> source{};
+    leaf.add(source.data(), 12);
+    leaf.slice(1, 10);
+    leaf.makeConst();
+    std::vector<size_t> addresses;
+    for (size_t i = 0; i < leaf.size(); i++) {
+        addresses.push_back(leaf.at(i));
+    }
+    //row addresses get hashed even though they are never summarized, as runs rather than one by one
+    ASSERT_NE(leaf.cachedHash(), nullptr);
+    ASSERT_EQ(*leaf.cachedHash(), expectedHash(addresses, 0, addresses.size()));
+    ASSERT_EQ(leaf.contentHash(2, 7), expectedHash(addresses, 2, 7));
+}
+
+TEST(ContentHashTest, recycledAddresses) {
+    using IndexBuilder = Builder<size_t, 4, 16, IndexAdapter>;
+    SpaceProvider<16> spaceProvider;
+    std::vector<size_t> rows(100);
+    std::iota(rows.begin(), rows.end(), 0);
+    auto load = [&]() {
+        auto session = spaceProvider.newAllocationSession();
+        auto root = IndexBuilder::bulkLoad(rows.data(), rows.size(), session.get());
+        session->close();
+        return root;
+    };
+    auto first = load();
+    auto firstHash = IndexBuilder::contentHash(first);
+    std::set<size_t> firstAddresses;
+    for (size_t i = 0; i < rows.size(); i++) {
+        firstAddresses.insert(valueAt(i, first));
+    }
+    //copies share the blocks, so the hash holds for as long as any of them lives
+    auto copy = IndexBuilder::BNodeT::copyNode(first);
+    ASSERT_EQ(IndexBuilder::contentHash(copy), firstHash);
+    first = IndexBuilder::VarType();
+    copy = IndexBuilder::VarType();
+
+    //the next index gets the same addresses back, for other rows: its hash must not pass for the dropped one's
+    auto second = load();
+    std::set<size_t> secondAddresses;
+    for (size_t i = 0; i < rows.size(); i++) {
+        secondAddresses.insert(valueAt(i, second));
+    }
+    ASSERT_EQ(secondAddresses, firstAddresses);
+    ASSERT_NE(IndexBuilder::contentHash(second), firstHash);
+    ASSERT_NE(IndexBuilder::contentHash(second, 10, 50), firstHash);
+}
+
+TEST(ContentHashTest, shapeIndependence) {
+    using SmallBuilder = Builder<int, 4, 8, HashedArrayAdapter>;
+    using LargeBuilder = Builder<int, 16, 64, HashedArrayAdapter>;
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::vector<int> values(5000);
+    for (auto &value: values) {
+        value = dist(gen);
+    }
+    auto small = loadLeafByLeaf<SmallBuilder>(values, 5);
+    auto large = loadLeafByLeaf<LargeBuilder>(values, 64);
+    auto whole = expectedHash(values, 0, values.size());
+    ASSERT_EQ(SmallBuilder::contentHash(small), whole);
+    ASSERT_EQ(LargeBuilder::contentHash(large), whole);
+    //the whole tree answers from the root's cache
+    ASSERT_EQ(*getNode<SmallBuilder::BNodeCPtr>(small)->cachedHash(), whole);
+    for (size_t offset = 0; offset < values.size(); offset += 331) {
+        for (size_t len = 0; offset + len <= values.size() + 100; len += 457) {
+            ASSERT_EQ(SmallBuilder::contentHash(small, offset, len), expectedHash(values, offset, len));
+            ASSERT_EQ(LargeBuilder::contentHash(large, offset, len), expectedHash(values, offset, len));
+        }
+    }
+
+    //stitched slices hold the same values as the source, annotated nodes included
+    SmallBuilder stitcher;
+    stitcher.addNode(small, 0, 1234);
+    stitcher.addNode(small, 1234, 3000);
+    stitcher.addNode(small, 4234, values.size() - 4234);
+    auto stitched = stitcher.close();
+    ASSERT_EQ(SmallBuilder::contentHash(stitched), whole);
+    auto moved = SmallBuilder::moveRange(small, 100, 50, 2000);
+    ASSERT_NE(SmallBuilder::contentHash(moved), whole);
+    ASSERT_EQ(SmallBuilder::contentHash(moved, 0, 100), expectedHash(values, 0, 100));
+    ASSERT_EQ(SmallBuilder::contentHash(moved, 2000, 50), expectedHash(values, 100, 50));
+
+    SmallBuilder annotationBuilder;
+    annotationBuilder.addNode(small, 7, 3000);
+    auto annotated = annotationBuilder.close();
+    ASSERT_TRUE(SmallBuilder::BNodeT::isANode(annotated));
+    ASSERT_EQ(*getNode<SmallBuilder::ANodeCPtr>(annotated)->cachedHash(), expectedHash(values, 7, 3000));
+    ASSERT_EQ(SmallBuilder::contentHash(annotated, 10, 100), expectedHash(values, 17, 100));
+}
+
+TEST(ContentHashTest, reopenedNodes) {
+    using BuilderT = Builder<int, 4, 4, HashedArrayAdapter>;
+    std::vector<int> values(800);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = loadLeafByLeaf<BuilderT>(values, 4);
+    const auto *constRoot = getNode<BuilderT::BNodeCPtr>(root);
+    auto opened = openNode(BuilderT::BNodeCPtr(constRoot), nullptr);
+    ASSERT_EQ(opened->cachedHash(), nullptr);
+    ASSERT_EQ(opened->contentHash(), *constRoot->cachedHash());
+    opened->removeNode();
+    auto reclosed = makeConstFromPtr(std::move(opened), true);
+    ASSERT_EQ(*reclosed->cachedHash(), expectedHash(values, 0, reclosed->size()));
+}
@@ -0,0 +1,94 @@
+#include "gtest/gtest.h"
+#include "../Cursor.h"
+
+#include <random>
+
+using BuilderT = Builder<int, 4, 8, ArrayAdapter>;
+using CursorT = Cursor<int, 4, 8, ArrayAdapter>;
+using LeafT = BuilderT::LeafT;
+
+static BuilderT::VarType buildTree(std::vector<int> &values, size_t leafCount) {
+    BuilderT builder;
+    std::array<int, 8> leafData;
+    for (size_t leafPos = 0; leafPos < leafCount; leafPos++) {
+        //uneven leaves so the span boundaries don't line up with a fixed stride
+        size_t leafSize = 3 + leafPos % 6;
+        for (size_t i = 0; i < leafSize; i++) {
+            leafData[i] = int(values.size());
+            values.push_back(leafData[i]);
+        }
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), leafSize);
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    return builder.close();
+}
+
+static void checkCursor(const BuilderT::VarType &root, const std::vector<int> &values) {
+    ASSERT_EQ(CursorT(root).size(), values.size());
+
+    CursorT forward(root);
+    for (size_t i = 0; i < values.size(); i++, ++forward) {
+        ASSERT_EQ(forward.position(), i);
+        ASSERT_EQ(*forward, values[i]);
+    }
+    ASSERT_TRUE(forward.atEnd());
+
+    CursorT backward(root, values.size() - 1);
+    for (size_t i = values.size(); i-- > 0; --backward) {
+        ASSERT_EQ(*backward, values[i]) << i;
+    }
+    ASSERT_TRUE(backward.atEnd());
+
+    std::vector<int> spans;
+    for (CursorT cursor(root); !cursor.atEnd(); cursor.nextSpan()) {
+        ASSERT_GT(cursor.spanLength(), 0);
+        spans.insert(spans.end(), cursor.data(), cursor.data() + cursor.spanLength());
+    }
+    ASSERT_EQ(spans, values);
+
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<ptrdiff_t> step(-40, 40);
+    CursorT cursor(root, values.size() / 2);
+    for (int i = 0; i < 2000; i++) {
+        ptrdiff_t target = std::clamp<ptrdiff_t>(ptrdiff_t(cursor.position()) + step(gen), 0, values.size() - 1);
+        cursor += target - ptrdiff_t(cursor.position());
+        ASSERT_EQ(*cursor, values[cursor.position()]);
+        ASSERT_EQ(cursor.leaf().at(cursor.leafOffset()), *cursor);
+    }
+}
+
+TEST(CursorTest, bNodeTree) {
+    std::vector<int> values;
+    auto root = buildTree(values, 150);
+    ASSERT_FALSE(BuilderT::BNodeT::isANode(root));
+    checkCursor(root, values);
+}
+
+TEST(CursorTest, annotatedTree) {
+    std::vector<int> values;
+    auto root = buildTree(values, 150);
+    BuilderT slicedBuilder;
+    std::vector<int> slicedValues;
+    for (size_t offset = 5; offset + 70 < values.size(); offset += 111) {
+        slicedBuilder.addNode(root, offset, 70);
+        slicedValues.insert(slicedValues.end(), values.begin() + offset, values.begin() + offset + 70);
+    }
+    checkCursor(slicedBuilder.close(), slicedValues);
+
+    BuilderT annotationBuilder;
+    annotationBuilder.addNode(root, 9, 400);
+    auto annotated = annotationBuilder.close();
+    ASSERT_TRUE(BuilderT::BNodeT::isANode(annotated));
+    checkCursor(annotated, std::vector<int>(values.begin() + 9, values.begin() + 409));
+}
+
+TEST(CursorTest, leafRootAndEmpty) {
+    std::vector<int> values;
+    auto root = buildTree(values, 1);
+    checkCursor(root, values);
+
+    CursorT cursor(BuilderT::VarType{});
+    ASSERT_EQ(cursor.size(), 0);
+    ASSERT_TRUE(cursor.atEnd());
+}
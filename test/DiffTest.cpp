@@ -0,0 +1,142 @@
+#include "gtest/gtest.h"
+#include "../Builder.h"
+#include "../Diff.h"
+
+#include <numeric>
+#include <random>
+
+using BuilderT = Builder<int, 4, 8, ArrayAdapter>;
+using LeafT = BuilderT::LeafT;
+using BNodeT = BuilderT::BNodeT;
+
+static BuilderT::VarType leafOf(std::vector<int> &values, size_t count) {
+    std::array<int, 8> leafData{};
+    for (size_t i = 0; i < count; i++) {
+        leafData[i] = -int(values.size()) - 1;
+        values.push_back(leafData[i]);
+    }
+    auto leaf = LeafT::createLeaf(nullptr);
+    leaf.add(leafData.data(), count);
+    return BuilderT::VarType(LeafT::createLeafPtr(std::move(leaf)));
+}
+
+/**
+ * The ranges between two changes must hold the same values in both versions and the changes must cover the rest
+ */
+static void checkChanges(const std::vector<int> &oldValues, const std::vector<int> &newValues,
+                         const std::vector<TreeChange> &changes) {
+    size_t oldPos = 0;
+    size_t newPos = 0;
+    for (const auto &change: changes) {
+        ASSERT_TRUE(change.oldLength || change.newLength);
+        ASSERT_EQ(change.oldOffset - oldPos, change.newOffset - newPos);
+        ASSERT_TRUE(std::equal(oldValues.begin() + oldPos, oldValues.begin() + change.oldOffset,
+                               newValues.begin() + newPos));
+        oldPos = change.oldOffset + change.oldLength;
+        newPos = change.newOffset + change.newLength;
+    }
+    ASSERT_EQ(oldValues.size() - oldPos, newValues.size() - newPos);
+    ASSERT_TRUE(std::equal(oldValues.begin() + oldPos, oldValues.end(), newValues.begin() + newPos));
+}
+
+TEST(DiffTest, sameTree) {
+    std::vector<int> values(1000);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), values.size());
+    ASSERT_TRUE(diff(root, root).empty());
+    ASSERT_TRUE(diff(root, BNodeT::copyNode(root)).empty());
+    ASSERT_TRUE(diff(BuilderT::VarType(), BuilderT::VarType()).empty());
+    ASSERT_EQ(diff(BuilderT::VarType(), root), std::vector<TreeChange>({{0, 0, 0, 1000}}));
+    ASSERT_EQ(diff(root, BuilderT::VarType()), std::vector<TreeChange>({{0, 1000, 0, 0}}));
+
+    //same values, different nodes
+    auto rebuilt = BuilderT::bulkLoad(values.data(), values.size());
+    checkChanges(values, values, diff(root, rebuilt));
+}
+
+TEST(DiffTest, localEdits) {
+    std::vector<int> values(100000);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), values.size());
+
+    auto erased = BuilderT::erase(root, 50001, 10);
+    std::vector<int> erasedValues = values;
+    erasedValues.erase(erasedValues.begin() + 50001, erasedValues.begin() + 50011);
+    auto changes = diff(root, erased);
+    checkChanges(values, erasedValues, changes);
+    //only the leaves along the seam differ
+    ASSERT_EQ(changes.size(), 1);
+    ASSERT_LE(changes[0].oldLength, 10 + 4 * 8);
+    ASSERT_LE(changes[0].newLength, 4 * 8);
+
+    //an update by slicing the old tree around a new leaf
+    std::vector<int> updatedValues(values.begin(), values.begin() + 70000);
+    BuilderT builder;
+    builder.addNode(root, 0, 70000);
+    builder.addNode(leafOf(updatedValues, 5));
+    builder.addNode(root, 70005, values.size() - 70005);
+    updatedValues.insert(updatedValues.end(), values.begin() + 70005, values.end());
+    auto updated = builder.close();
+    changes = diff(root, updated);
+    checkChanges(values, updatedValues, changes);
+    ASSERT_EQ(changes.size(), 1);
+    ASSERT_LE(changes[0].oldLength, 5 + 4 * 8);
+    checkChanges(updatedValues, values, diff(updated, root));
+}
+
+TEST(DiffTest, randomVersions) {
+    std::vector<int> values(3000);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), values.size());
+    std::mt19937 gen(3);
+    auto randomBelow = [&](size_t bound) { return std::uniform_int_distribution<size_t>(0, bound)(gen); };
+    for (int version = 0; version < 100; version++) {
+        std::vector<int> newValues = values;
+        BuilderT::VarType newRoot;
+        switch (version % 3) {
+            case 0: {
+                size_t offset = randomBelow(values.size() - 1);
+                size_t length = randomBelow(50);
+                newRoot = BuilderT::erase(root, offset, length);
+                newValues.erase(newValues.begin() + offset,
+                                newValues.begin() + std::min(offset + length, newValues.size()));
+                break;
+            }
+            case 1: {
+                size_t length = randomBelow(200);
+                size_t srcOffset = randomBelow(values.size() - length);
+                size_t dstOffset = randomBelow(values.size() - length);
+                newRoot = BuilderT::moveRange(root, srcOffset, length, dstOffset);
+                std::vector<int> moved(newValues.begin() + srcOffset, newValues.begin() + srcOffset + length);
+                newValues.erase(newValues.begin() + srcOffset, newValues.begin() + srcOffset + length);
+                newValues.insert(newValues.begin() + dstOffset, moved.begin(), moved.end());
+                break;
+            }
+            default: {
+                size_t offset = randomBelow(values.size());
+                auto [left, right] = BuilderT::split(root, offset);
+                newValues.resize(offset);
+                auto inserted = leafOf(newValues, 1 + randomBelow(7));
+                newValues.insert(newValues.end(), values.begin() + offset, values.end());
+                BuilderT builder;
+                for (auto *piece: {&left, &inserted, &right}) {
+                    if (*piece) {
+                        builder.addNode(std::move(*piece));
+                    }
+                }
+                newRoot = builder.close();
+            }
+        }
+        auto changes = diff(root, newRoot);
+        checkChanges(values, newValues, changes);
+        checkChanges(newValues, values, diff(newRoot, root));
+        size_t changedLength = 0;
+        for (const auto &change: changes) {
+            changedLength += change.oldLength + change.newLength;
+        }
+        //a few leaves around each seam, nowhere near the whole tree
+        ASSERT_LT(changedLength, values.size() / 2) << version;
+        root = std::move(newRoot);
+        values = std::move(newValues);
+    }
+}
@@ -0,0 +1,71 @@
+#include "gtest/gtest.h"
+#include "../Builder.h"
+#include "../FrozenTree.h"
+
+#include <numeric>
+#include <random>
+
+using BuilderT = Builder<int, 4, 8, ArrayAdapter>;
+
+static void checkFrozen(const auto &frozen, const std::vector<int> &values) {
+    ASSERT_EQ(frozen.size(), values.size());
+    for (size_t pos = 0; pos < values.size(); pos++) {
+        ASSERT_EQ(frozen[pos], values[pos]) << pos;
+    }
+    std::mt19937 gen(values.size());
+    for (int i = 0; i < 200; i++) {
+        size_t offset = std::uniform_int_distribution<size_t>(0, values.size())(gen);
+        size_t length = std::uniform_int_distribution<size_t>(0, 100)(gen);
+        std::vector<int> read;
+        frozen.forEachLeaf([&](const auto &leaf, size_t leafOffset, size_t leafLength) {
+            ASSERT_GT(leafLength, 0);
+            for (size_t j = 0; j < leafLength; j++) {
+                read.push_back(leaf[leafOffset + j]);
+            }
+        }, offset, length);
+        std::vector<int> expected(values.begin() + offset, values.begin() + std::min(offset + length, values.size()));
+        ASSERT_EQ(read, expected) << offset << " " << length;
+    }
+}
+
+TEST(FrozenTreeTest, singleLevel) {
+    ASSERT_EQ(freeze(BuilderT::VarType()).size(), 0);
+    std::vector<int> values(50);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), values.size());
+    auto frozen = freeze(root);
+    ASSERT_EQ(frozen.pieceCount(), 7);
+    checkFrozen(frozen, values);
+}
+
+TEST(FrozenTreeTest, manyLevels) {
+    //enough pieces for three levels of 32 bit separators and four of 64 bit ones
+    std::vector<int> values(40000);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), values.size());
+    auto frozen = freeze(root);
+    ASSERT_EQ(frozen.pieceCount(), values.size() / 8);
+    checkFrozen(frozen, values);
+    checkFrozen(freeze<uint64_t>(root), values);
+}
+
+TEST(FrozenTreeTest, slicesAndAnnotations) {
+    std::vector<int> values(20000);
+    std::iota(values.begin(), values.end(), 0);
+    auto root = BuilderT::bulkLoad(values.data(), values.size());
+    std::mt19937 gen(7);
+    BuilderT builder;
+    std::vector<int> slicedValues;
+    for (int i = 0; i < 300; i++) {
+        size_t offset = std::uniform_int_distribution<size_t>(0, values.size() - 1)(gen);
+        size_t length = std::uniform_int_distribution<size_t>(1, std::min<size_t>(500, values.size() - offset))(gen);
+        builder.addNode(root, offset, length);
+        slicedValues.insert(slicedValues.end(), values.begin() + offset, values.begin() + offset + length);
+    }
+    auto sliced = builder.close();
+    auto frozen = freeze(sliced);
+    //the frozen tree keeps the leaves alive on its own
+    sliced = BuilderT::VarType();
+    root = BuilderT::VarType();
+    checkFrozen(frozen, slicedValues);
+}
@@ -0,0 +1,79 @@
+#include "gtest/gtest.h"
+#include "../Builder.h"
+#include "../MemoryReport.h"
+
+using BuilderT = Builder<int, 4, 8, ArrayAdapter>;
+using LeafT = BuilderT::LeafT;
+using BNodeT = BuilderT::BNodeT;
+
+static BuilderT::VarType buildTree(size_t leafCount) {
+    BuilderT builder;
+    std::array<int, 8> leafData{};
+    for (size_t leafPos = 0; leafPos < leafCount; leafPos++) {
+        auto leaf = LeafT::createLeaf(nullptr);
+        leaf.add(leafData.data(), leafData.size());
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    return builder.close();
+}
+
+static size_t totalBytes(const MemoryReport &report) {
+    return report.total().exclusive.bytes + report.total().shared.bytes;
+}
+
+TEST(MemoryReportTest, exclusiveTree) {
+    auto root = buildTree(100);
+    auto report = memoryReport(root);
+    ASSERT_EQ(report.leaves.exclusive.count, 100);
+    ASSERT_EQ(report.leafArrays.exclusive.count, 100);
+    ASSERT_EQ(report.leafArrays.exclusive.bytes, 100 * sizeof(CountedArray<int, 8>));
+    ASSERT_GT(report.bNodes.exclusive.count, 25);
+    ASSERT_EQ(report.aNodes.exclusive.count, 0);
+    ASSERT_EQ(report.controlBlocks.exclusive.count, 0);
+    ASSERT_EQ(report.total().shared.count, 0);
+
+    //a second handle on the root pins the whole tree
+    auto copy = BNodeT::copyNode(root);
+    auto sharedReport = memoryReport(root);
+    ASSERT_EQ(sharedReport.total().exclusive.count, 0);
+    ASSERT_EQ(totalBytes(sharedReport), totalBytes(report));
+
+    ASSERT_EQ(memoryReport(BuilderT::VarType{}).total().shared.count, 0);
+}
+
+TEST(MemoryReportTest, sharedSubtrees) {
+    auto root = buildTree(100);
+    size_t treeBytes = totalBytes(memoryReport(root));
+
+    //the same subtrees twice, counted once
+    BuilderT doubleBuilder;
+    doubleBuilder.addNode(BNodeT::copyNode(root));
+    doubleBuilder.addNode(BNodeT::copyNode(root));
+    auto doubled = doubleBuilder.close();
+    auto doubledReport = memoryReport(doubled);
+    ASSERT_EQ(doubledReport.leaves.exclusive.count + doubledReport.leaves.shared.count, 100);
+    ASSERT_EQ(doubledReport.leaves.exclusive.count, 0);
+    ASSERT_LT(totalBytes(doubledReport), 2 * treeBytes);
+
+    BuilderT sliceBuilder;
+    sliceBuilder.addNode(root, 3, 300);
+    sliceBuilder.addNode(root, 500, 200);
+    auto sliced = sliceBuilder.close();
+    auto slicedReport = memoryReport(sliced);
+    ASSERT_GT(slicedReport.total().exclusive.count, 0);
+    ASSERT_GT(slicedReport.total().shared.count, 0);
+
+    //against the tree it was sliced from only the new nodes and the sliced edge leaves are exclusive
+    auto marginal = memoryReport(sliced, root);
+    ASSERT_EQ(totalBytes(marginal), totalBytes(slicedReport));
+    ASSERT_LT(marginal.total().exclusive.bytes, marginal.total().shared.bytes);
+    ASSERT_EQ(marginal.leafArrays.exclusive.count, 0);
+    ASSERT_EQ(memoryReport(root, root).total().exclusive.count, 0);
+
+    //once the derived trees are gone everything is exclusive again
+    doubled = BuilderT::VarType{};
+    ASSERT_GT(memoryReport(root).total().shared.count, 0);
+    sliced = BuilderT::VarType{};
+    ASSERT_EQ(memoryReport(root).total().shared.count, 0);
+    ASSERT_EQ(memoryReport(root).total().exclusive.bytes, treeBytes);
+}
@@ -0,0 +1,179 @@
+#include "gtest/gtest.h"
+#include "../Builder.h"
+#include "../Reduce.h"
+
+#include <random>
+
+template<class T>
+static Summary<T> expectedSummary(const std::vector<T> &values, size_t offset, size_t len) {
+    Summary<T> result;
+    for (size_t i = offset; i < std::min(values.size(), offset + len); i++) {
+        result.add(values[i]);
+    }
+    return result;
+}
+
+template<class T>
+static void testKernels(std::vector<T> values) {
+    for (auto isa: {ReduceIsa::Scalar, ReduceIsa::Generic, ReduceIsa::Avx2}) {
+        if (!isReduceIsaSupported(isa)) {
+            continue;
+        }
+        auto kernel = reduceKernel<T>(isa);
+        for (size_t offset = 0; offset < 9; offset++) {
+            for (size_t len = 0; len + offset <= values.size(); len++) {
+                SCOPED_TRACE("isa = " + std::to_string(int(isa)) + " offset = " + std::to_string(offset) +
+                             " len = " + std::to_string(len));
+                ASSERT_EQ(kernel(values.data() + offset, len), expectedSummary(values, offset, len));
+            }
+        }
+    }
+}
+
+TEST(ReduceTest, kernels) {
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> dist(-1000, 1000);
+    std::vector<int> ints;
+    std::vector<int64_t> longs;
+    std::vector<double> doubles;
+    for (int i = 0; i < 300; i++) {
+        ints.push_back(dist(gen));
+        longs.push_back(int64_t(dist(gen)) << 33);
+        //integral values keep the floating point sums exact regardless of the summation order
+        doubles.push_back(dist(gen));
+    }
+    testKernels(ints);
+    testKernels(longs);
+    testKernels(doubles);
+}
+
+TEST(ReduceTest, emptySummary) {
+    Summary<int> empty;
+    Summary<int> one;
+    one.add(5);
+    ASSERT_EQ(empty + one, one);
+    ASSERT_EQ(one + empty, one);
+    ASSERT_EQ(reduceSpan<int>(nullptr, 0), empty);
+}
+
+TEST(ReduceTest, leaf) {
+    using LeafT = Leaf<int, 16>;
+    auto leaf = LeafT::createLeaf(nullptr);
+    std::vector<int> values{3, -1, 7, 12, 0, 5, -8, 2, 9, 4};
+    leaf.add(values.data(), values.size());
+    leaf.slice(2, 7);
+    std::vector<int> sliced(values.begin() + 2, values.begin() + 9);
+    ASSERT_EQ(leaf.data()[0], 7);
+    for (size_t offset = 0; offset <= sliced.size(); offset++) {
+        for (size_t len = 0; len <= sliced.size() + 1; len++) {
+            ASSERT_EQ(leaf.summarize(offset, len), expectedSummary(sliced, offset, len));
+        }
+    }
+    ASSERT_EQ(leaf.cachedSummary(), nullptr);
+    leaf.makeConst();
+    ASSERT_EQ(*leaf.cachedSummary(), expectedSummary(sliced, 0, sliced.size()));
+    leaf.slice(1, 3);
+    ASSERT_EQ(leaf.cachedSummary(), nullptr);
+}
+
+TEST(ReduceTest, indexLeaf) {
+    using IndexLeaf = Leaf<size_t, 16, IndexAdapter>;
+    SpaceProvider<16> spaceProvider;
+    auto session = spaceProvider.newAllocationSession();
+    auto leaf = IndexLeaf::createLeaf(session.get());
+    std::array<size_t, 16> source{};
+    leaf.add(source.data(), 12);
+    leaf.slice(1, 10);
+    leaf.makeConst();
+    Summary<size_t> expected;
+    for (size_t i = 2; i < 9; i++) {
+        expected.add(leaf.at(i));
+    }
+    ASSERT_EQ(leaf.summarize(2, 7), expected);
+    //row addresses are never aggregated so the index adapter opts out of caching
+    ASSERT_EQ(leaf.cachedSummary(), nullptr);
+}
+
+TEST(ReduceTest, builder) {
+    using BuilderT = Builder<int, 16, 16, ArrayAdapter>;
+    using LeafT = BuilderT::LeafT;
+    std::mt19937 gen(11);
+    std::uniform_int_distribution<int> dist(-100000, 100000);
+    std::vector<int> values;
+    BuilderT builder;
+    std::array<int, 16> leafData;
+    for (int leafPos = 0; leafPos < 300; leafPos++) {
+        auto leaf = LeafT::createLeaf(nullptr);
+        for (auto &value: leafData) {
+            value = dist(gen);
+            values.push_back(value);
+        }
+        leaf.add(leafData.data(), leafData.size());
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    auto root = builder.close();
+    ASSERT_EQ(BuilderT::summarize(root), expectedSummary(values, 0, values.size()));
+    ASSERT_EQ(BuilderT::summarize(root, values.size()), Summary<int>());
+    ASSERT_EQ(BuilderT::summarize(root, 5, 0), Summary<int>());
+    for (size_t offset = 0; offset < values.size(); offset += 37) {
+        for (size_t len = 1; offset + len <= values.size() + 20; len += 53) {
+            ASSERT_EQ(BuilderT::summarize(root, offset, len), expectedSummary(values, offset, len));
+        }
+    }
+
+    //slices of a const tree produce annotated nodes
+    BuilderT slicedBuilder;
+    std::vector<int> slicedValues;
+    for (size_t offset = 3; offset + 40 < values.size(); offset += 97) {
+        slicedBuilder.addNode(root, offset, 40);
+        slicedValues.insert(slicedValues.end(), values.begin() + offset, values.begin() + offset + 40);
+    }
+    auto slicedRoot = slicedBuilder.close();
+    for (size_t offset = 0; offset < slicedValues.size(); offset += 13) {
+        for (size_t len = 1; offset + len <= slicedValues.size(); len += 29) {
+            ASSERT_EQ(BuilderT::summarize(slicedRoot, offset, len), expectedSummary(slicedValues, offset, len));
+        }
+    }
+}
+
+TEST(ReduceTest, cachedSummaries) {
+    using BuilderT = Builder<int, 4, 4, ArrayAdapter>;
+    using LeafT = BuilderT::LeafT;
+    using BNodeT = BuilderT::BNodeT;
+    std::vector<int> values;
+    BuilderT builder;
+    for (int leafPos = 0; leafPos < 200; leafPos++) {
+        auto leaf = LeafT::createLeaf(nullptr);
+        std::array<int, 4> leafData{leafPos, -leafPos, 3 * leafPos % 17, leafPos * leafPos % 101};
+        leaf.add(leafData.data(), leafData.size());
+        values.insert(values.end(), leafData.begin(), leafData.end());
+        builder.addNode(LeafT::createLeafPtr(std::move(leaf)));
+    }
+    auto root = builder.close();
+    const auto *constRoot = getNode<BuilderT::BNodeCPtr>(root);
+    ASSERT_NE(constRoot->cachedSummary(), nullptr);
+    ASSERT_EQ(*constRoot->cachedSummary(), expectedSummary(values, 0, values.size()));
+    for (size_t i = 0; i < constRoot->childrenCount(); i++) {
+        visitNode([&](const auto &child) {
+            ASSERT_NE(child->cachedSummary(), nullptr);
+            ASSERT_EQ(*child->cachedSummary(), child->summarize());
+        }, constRoot->childAt(i));
+    }
+
+    //an opened copy drops the cache until it is made const again
+    auto opened = openNode(BuilderT::BNodeCPtr(constRoot), nullptr);
+    ASSERT_EQ(opened->cachedSummary(), nullptr);
+    ASSERT_EQ(opened->summarize(), *constRoot->cachedSummary());
+    opened->removeNode();
+    auto reclosed = makeConstFromPtr(std::move(opened), true);
+    ASSERT_EQ(*reclosed->cachedSummary(), expectedSummary(values, 0, reclosed->size()));
+
+    BuilderT annotationBuilder;
+    annotationBuilder.addNode(root, 7, 300);
+    auto annotated = annotationBuilder.close();
+    ASSERT_TRUE(BNodeT::isANode(annotated));
+    const auto *aNode = getNode<BuilderT::ANodeCPtr>(annotated);
+    ASSERT_NE(aNode->cachedSummary(), nullptr);
+    ASSERT_EQ(*aNode->cachedSummary(), expectedSummary(values, 7, 300));
+    ASSERT_EQ(BuilderT::summarize(annotated, 10, 100), expectedSummary(values, 17, 100));
+}
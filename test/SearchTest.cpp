@@ -0,0 +1,54 @@
+#include "gtest/gtest.h"
+#include "../Search.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+
+static void testBounds(const std::vector<size_t> &cumSize) {
+    size_t maxValue = cumSize.empty() ? 2 : cumSize.back() + 2;
+    for (size_t value = 0; value <= maxValue; value++) {
+        SCOPED_TRACE("count = " + std::to_string(cumSize.size()) + " value = " + std::to_string(value));
+        ASSERT_EQ(cumLowerBound(cumSize.data(), cumSize.size(), value),
+                  std::lower_bound(cumSize.begin(), cumSize.end(), value) - cumSize.begin());
+        ASSERT_EQ(cumUpperBound(cumSize.data(), cumSize.size(), value),
+                  std::upper_bound(cumSize.begin(), cumSize.end(), value) - cumSize.begin());
+    }
+}
+
+TEST(SearchTest, matchesStdBounds) {
+    std::mt19937_64 gen(29);
+    //zero sized steps give runs of equal cumulative sizes
+    std::uniform_int_distribution<size_t> step(0, 3);
+    for (size_t count = 0; count <= 260; count++) {
+        std::vector<size_t> cumSize(count);
+        size_t total = 0;
+        for (auto &value: cumSize) {
+            value = total += step(gen);
+        }
+        testBounds(cumSize);
+    }
+}
+
+TEST(SearchTest, largestValue) {
+    constexpr size_t MAX = std::numeric_limits<size_t>::max();
+    for (size_t count: {0, 3, 40}) {
+        std::vector<size_t> cumSize(count);
+        for (size_t i = 0; i < count; i++) {
+            cumSize[i] = i + 1 < count ? i * 10 : MAX;
+        }
+        ASSERT_EQ(cumUpperBound(cumSize.data(), count, MAX), count);
+        ASSERT_EQ(cumLowerBound(cumSize.data(), count, MAX), count ? count - 1 : 0);
+        ASSERT_EQ(cumUpperBound(cumSize.data(), count, MAX - 1), count ? count - 1 : 0);
+    }
+}
+
+TEST(SearchTest, fullNodes) {
+    for (size_t count: {16, 32, 33, 64, 128, 256}) {
+        std::vector<size_t> cumSize(count);
+        for (size_t i = 0; i < count; i++) {
+            cumSize[i] = (i + 1) * 64;
+        }
+        testBounds(cumSize);
+    }
+}
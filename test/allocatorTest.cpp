@@ -1,6 +1,11 @@
 #include "gtest/gtest.h"
 #include "../FixedSizeAllocator.h"
 
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
 TEST(FixedSizeAllocator, allocateAndDeallocateAll) {
     auto &fixedSizeAllocator = FixedSizeAllocator<64>::oneAndOnly();
     std::vector<void *> ptrs;
@@ -159,6 +164,53 @@ TEST_P(AllocateRandXDeallocateRandY, BackAndForthAllocation) {
 
 }
 
+TEST(FixedSizeAllocator, crossThreadFrees) {
+    constexpr size_t THREAD_COUNT = 4;
+    constexpr size_t ROUNDS = 2000;
+    auto &allocator = FixedSizeAllocator<136>::oneAndOnly();
+    size_t initialCount = allocator.allocatedCount();
+    //slots allocated on one thread and freed on the next, while every thread keeps allocating
+    std::mutex mutex;
+    std::unordered_set<void *> live;
+    std::array<std::vector<void *>, THREAD_COUNT> handedOver;
+    std::vector<std::thread> threads;
+    for (size_t thread = 0; thread < THREAD_COUNT; thread++) {
+        threads.emplace_back([&, thread]() {
+            for (size_t round = 0; round < ROUNDS; round++) {
+                void *slot = allocator.alloc();
+                std::vector<void *> toFree;
+                {
+                    std::lock_guard<std::mutex> guard(mutex);
+                    ASSERT_TRUE(live.insert(slot).second);
+                    handedOver[(thread + 1) % THREAD_COUNT].push_back(slot);
+                    toFree.swap(handedOver[thread]);
+                    for (void *freed: toFree) {
+                        live.erase(freed);
+                    }
+                }
+                for (void *freed: toFree) {
+                    allocator.free(freed);
+                }
+            }
+        });
+    }
+    for (auto &thread: threads) {
+        thread.join();
+    }
+    //the exited threads gave their cached slots back, so only the ones never handed over are still out
+    size_t pending = 0;
+    for (auto &slots: handedOver) {
+        pending += slots.size();
+    }
+    ASSERT_EQ(allocator.allocatedCount(), initialCount + pending);
+    for (auto &slots: handedOver) {
+        for (void *slot: slots) {
+            allocator.free(slot);
+        }
+    }
+    ASSERT_EQ(allocator.allocatedCount(), initialCount);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -40,10 +40,10 @@ void testFlipped(const BNodeT &root) {
             auto &variant = root.nodeAt(i);
             switch (variant.index()) {
                 case 2:
-                    testFlipped(*std::get<BNodeT::BNodePtr>(variant));
+                    testFlipped(*getNode<BNodeT::BNodePtr>(variant));
                     break;
                 case 5:
-                    testFlipped(*std::get<BNodeT::BNodeCPtr>(variant));
+                    testFlipped(*getNode<BNodeT::BNodeCPtr>(variant));
                     break;
                 default:
                     ASSERT_TRUE(false);
@@ -2,6 +2,7 @@
 #define EXPERIMENTS_UTILS_H
 
 #include "AllocatorHelpers.h"
+#include "NodeVariant.h"
 
 static constexpr size_t log(size_t size) {
     size_t result = 0;
@@ -26,22 +27,18 @@ openNode(std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> &&node,void*
 
 template<class NODE_T>
 auto makeConstFromPtr(std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> &&ptr, bool isRoot = false) {
-    using PtrDeleter = DeleterForFixedAllocator<NODE_T>;
-    using SharedPtr = std::shared_ptr<const NODE_T>;
-    static auto &allocator = StdFixedAllocator<NODE_T>::oneAndOnly();
     if (!ptr) {
-        return SharedPtr();
+        return ConstPtr<NODE_T>();
     }
     if (!ptr->isDeepBalanced(isRoot)) {
         assert(ptr->isDeepBalanced(isRoot));
     }
     ptr->makeConst();
-    auto rawPtr = ptr.release();
-    return SharedPtr(rawPtr, PtrDeleter(), allocator);
+    return ConstPtr<NODE_T>(std::move(ptr));
 }
 
 template<class NODE_T>
-std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> openNode(const std::shared_ptr<const NODE_T> &node,void* context) {
+std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> openNode(const ConstPtr<NODE_T> &node,void* context) {
     static auto &alloc = StdFixedAllocator<NODE_T>::oneAndOnly();
     auto pointer = alloc.allocate(1);
     alloc.construct(pointer, *node);
@@ -50,24 +47,46 @@ std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> openNode(const std::sh
     return result;
 }
 
+/**
+ * Transient opening: a node nothing else refers to is handed back in place, other ones get copied
+ */
 template<class NODE_T>
-std::shared_ptr<const NODE_T>
+std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> openNode(ConstPtr<NODE_T> &&node, void *context) {
+    if (!node.isExclusive()) {
+        return openNode(std::as_const(node), context);
+    }
+    auto result = node.takeExclusive();
+    result->thaw();
+    result->mutate(context);
+    return result;
+}
+
+template<class NODE_T>
+ConstPtr<NODE_T>
 closeNode(std::unique_ptr<NODE_T, DeleterForFixedAllocator<NODE_T>> &&node, bool isRoot = false) {
     return makeConstFromPtr(std::move(node), isRoot);
 }
 
 template<class NODE_T>
-const std::shared_ptr<const NODE_T> closeNode(const std::shared_ptr<const NODE_T> &node, bool isRoot = false) {
+const ConstPtr<NODE_T> closeNode(const ConstPtr<NODE_T> &node, bool isRoot = false) {
     return node;
 }
 
 template<class NODE_T>
-std::shared_ptr<const NODE_T> closeNode(std::shared_ptr<const NODE_T> &&node) {
+ConstPtr<NODE_T> closeNode(ConstPtr<NODE_T> &&node) {
     return node;
 }
 
 size_t sizeOf(const auto &node) {
-    return std::visit([](const auto &nodePtr) -> size_t {
+    if constexpr (is_node_variant_v<decltype(node)>) {
+        //mutable nodes go through the non const size() which refreshes their cumulative sizes
+        if (node && node.index() >= 3) {
+            return visitConstNode([](const auto &child) -> size_t {
+                return child.size();
+            }, node);
+        }
+    }
+    return visitNode([](const auto &nodePtr) -> size_t {
         if (!nodePtr) {
             return 0;
         }
@@ -77,10 +96,17 @@ size_t sizeOf(const auto &node) {
 
 
 int8_t heightOf(const auto &node) {
-    if constexpr (is_unique_ptr_v<decltype(node)> or is_shared_ptr_v<decltype(node)>) {
+    if constexpr (is_unique_ptr_v<decltype(node)> or is_const_ptr_v<decltype(node)>) {
         return node->height();
+    } else if constexpr (is_node_variant_v<decltype(node)>) {
+        if (!node) {
+            return 0;
+        }
+        return visitConstNode([](const auto &child) -> int8_t {
+            return child.height();
+        }, node);
     } else
-        return std::visit([](const auto &nodePtr) -> int8_t {
+        return visitNode([](const auto &nodePtr) -> int8_t {
             if (!nodePtr) {
                 return 0;
             }
@@ -90,7 +116,7 @@ int8_t heightOf(const auto &node) {
 
 template<class NODE>
 const NODE &getConst(const auto &node) {
-    return std::visit([](const auto &nodePtr) -> const NODE & {
+    return visitNode([](const auto &nodePtr) -> const NODE & {
         if (!nodePtr) {
             throw std::logic_error("Payload is null");
         }
@@ -104,14 +130,42 @@ const NODE &getConst(const auto &node) {
 
 template<class NODE>
 bool isDeepBalanced(const NODE &node, bool isRoot = false) {
-    return std::visit([&](const auto &nodePtr) {
+    return visitNode([&](const auto &nodePtr) {
         return nodePtr->isDeepBalanced(isRoot);
     }, node);
 }
 
+/**
+ * Summary of [offset, offset + length) of the node, taken from its cache when the whole of a const node is covered
+ */
+auto summaryOf(const auto &nodePtr, size_t offset, size_t length) {
+    if constexpr (is_const_ptr_v<decltype(nodePtr)>) {
+        if (offset == 0 && length >= nodePtr->size()) {
+            if (auto cached = nodePtr->cachedSummary()) {
+                return *cached;
+            }
+        }
+    }
+    return nodePtr->summarize(offset, length);
+}
+
+/**
+ * Hash of [offset, offset + length) of the node, taken from its cache when the whole of a const node is covered
+ */
+auto hashOf(const auto &nodePtr, size_t offset, size_t length) {
+    if constexpr (is_const_ptr_v<decltype(nodePtr)>) {
+        if (offset == 0 && length >= nodePtr->size()) {
+            if (auto cached = nodePtr->cachedHash()) {
+                return *cached;
+            }
+        }
+    }
+    return nodePtr->contentHash(offset, length);
+}
+
 auto valueAt(size_t pos, const auto &node) {
-    return std::visit([&](const auto &nodePtr) {
-        return (*nodePtr)[pos];
+    return visitConstNode([&](const auto &child) {
+        return child[pos];
     }, node);
 }
 